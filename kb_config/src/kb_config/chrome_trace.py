@@ -0,0 +1,147 @@
+import json
+from typing import Dict, Iterable, List, Optional
+
+from .kb_config import PERF_STAGE_NAMES
+from .trace import TraceDecoder, TraceStream, STREAM_PACKETS_LOST, STREAM_RECORDS_DROPPED
+
+# Capture files (written by `kbtrace capture`) hold everything needed to convert a trace without the keyboard
+CAPTURE_VERSION = 1
+
+DEFAULT_CPU_HZ = 125_000_000
+
+# Timelines (Chrome "threads") that events are placed on
+TID_SCAN        = 0
+TID_FEATURES    = 1
+TID_USB         = 2
+TID_KEYS        = 3
+TID_LOG         = 4
+
+TIMELINE_NAMES = {
+    TID_SCAN: "scan ticks",
+    TID_FEATURES: "features",
+    TID_USB: "usb",
+    TID_KEYS: "keys",
+    TID_LOG: "log",
+}
+
+# perf_stage_t values that get their own timeline, everything else is a feature span
+PERF_STAGE_TICK     = 0
+PERF_STAGE_USB_IRQ  = PERF_STAGE_NAMES.index("usb_irq")
+
+# Trace events that become something better than a log line, identified by their format (see trace_formats.h)
+FORMAT_KEY_PRESS    = "key press %u,%u -> 0x%08x"
+FORMAT_KEY_RELEASE  = "key release %u,%u -> 0x%08x"
+FORMAT_PERF_STAGE   = "stage %u took %u cycles"
+FORMAT_USB_BUFFERS  = "usb buffers complete 0x%08x"
+
+def write_capture(filename: str, formats: List[str], cpu_hz: int, packets: List[bytes]):
+    with open(filename, "w") as f:
+        json.dump({
+            "version": CAPTURE_VERSION,
+            "formats": formats,
+            "cpu_hz": cpu_hz,
+            "packets": [p.hex() for p in packets],
+        }, f)
+
+def read_capture(filename: str):
+    with open(filename) as f:
+        capture = json.load(f)
+    if capture.get("version") != CAPTURE_VERSION:
+        raise ValueError(f"unsupported capture version: {capture.get('version')}")
+    return capture["formats"], capture["cpu_hz"], [bytes.fromhex(p) for p in capture["packets"]]
+
+class Unwrapper:
+    """Extends the keyboard's 32-bit microsecond timestamps, which wrap every ~71 minutes"""
+    def __init__(self):
+        self.last = None
+        self.offset = 0
+
+    def __call__(self, timestamp: int) -> int:
+        if self.last is not None and timestamp < self.last and (self.last - timestamp) > (1 << 31):
+            self.offset += 1 << 32
+        self.last = timestamp
+        return timestamp + self.offset
+
+def metadata_events() -> List[Dict]:
+    events = [{"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "keyboard"}}]
+    for tid, name in TIMELINE_NAMES.items():
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": tid, "args": {"name": name}})
+        events.append({"name": "thread_sort_index", "ph": "M", "pid": 0, "tid": tid, "args": {"sort_index": tid}})
+    return events
+
+def instant(name: str, ts: float, tid: int, args: Optional[Dict] = None, scope: str = "t") -> Dict:
+    event = {"name": name, "ph": "i", "s": scope, "ts": ts, "pid": 0, "tid": tid}
+    if args:
+        event["args"] = args
+    return event
+
+def trace_stream_to_events(formats: List[str], packets: Iterable[bytes], cpu_hz: int = DEFAULT_CPU_HZ) -> List[Dict]:
+    """Converts captured trace stream packets into Chrome trace events"""
+    stream = TraceStream(TraceDecoder(formats))
+    unwrap = Unwrapper()
+    events = metadata_events()
+
+    # Event ids aren't sent by the keyboard, but the format table is in id order
+    format_ids = {fmt: index for index, fmt in enumerate(formats)}
+    key_press_id = format_ids.get(FORMAT_KEY_PRESS)
+    key_release_id = format_ids.get(FORMAT_KEY_RELEASE)
+    perf_stage_id = format_ids.get(FORMAT_PERF_STAGE)
+    usb_buffers_id = format_ids.get(FORMAT_USB_BUFFERS)
+
+    last_ts = 0
+    for packet in packets:
+        for item in stream.packet_records(packet):
+            if item.trace_id == STREAM_PACKETS_LOST:
+                events.append(instant("packets lost", last_ts, TID_LOG, {"count": item.args[0]}, "g"))
+                continue
+            if item.trace_id == STREAM_RECORDS_DROPPED:
+                events.append(instant("records dropped", last_ts, TID_LOG, {"count": item.args[0]}, "g"))
+                continue
+
+            ts = unwrap(item.timestamp)
+            last_ts = ts
+            args = item.args
+
+            if item.trace_id == perf_stage_id and len(args) == 2:
+                # Recorded as the stage ends, so the span finishes at the timestamp
+                stage, cycles = args
+                duration_us = cycles * 1e6 / cpu_hz
+                name = PERF_STAGE_NAMES[stage] if stage < len(PERF_STAGE_NAMES) else f"stage {stage}"
+                tid = TID_SCAN if stage == PERF_STAGE_TICK else TID_USB if stage == PERF_STAGE_USB_IRQ else TID_FEATURES
+                events.append({
+                    "name": name, "ph": "X", "ts": ts - duration_us, "dur": duration_us, "pid": 0, "tid": tid,
+                    "args": {"cycles": cycles},
+                })
+            elif item.trace_id in (key_press_id, key_release_id) and len(args) == 3:
+                row, col, key = args
+                name = "press" if item.trace_id == key_press_id else "release"
+                events.append(instant(f"{name} {row},{col}", ts, TID_KEYS, {"row": row, "col": col, "key": f"0x{key:08x}"}))
+            elif item.trace_id == usb_buffers_id and len(args) == 1:
+                events.append(instant("buffers complete", ts, TID_USB, {"buffers": f"0x{args[0]:08x}"}))
+            else:
+                events.append(instant(stream.decoder.format(item.trace_id, args), ts, TID_LOG))
+
+    return events
+
+def recorder_to_events(recorder_events: Iterable[Dict]) -> List[Dict]:
+    """Converts flight recorder events (as saved by `kbconfig --recorder`) into Chrome trace events"""
+    unwrap = Unwrapper()
+    events = metadata_events()
+    for e in recorder_events:
+        ts = unwrap(e["timestamp_us"])
+        kind = e["type"]
+        args = {"arg8": e["arg8"], "arg16": e["arg16"], "arg32": f"0x{e['arg32']:08x}"}
+
+        if kind in ("key_press", "key_release"):
+            events.append(instant(f"{kind[4:]} {e['arg8']},{e['arg16']}", ts, TID_KEYS, args))
+        elif kind.startswith("report_"):
+            events.append(instant(kind, ts, TID_USB, args))
+        elif kind == "frozen":
+            events.append(instant(kind, ts, TID_LOG, args, "g"))
+        else:
+            events.append(instant(kind, ts, TID_FEATURES, args))
+    return events
+
+def write_chrome_trace(filename: str, events: List[Dict]):
+    with open(filename, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
@@ -1,7 +1,10 @@
 import argparse
-from time import sleep
-from .kb_config import KBConfig
+import json
+from time import sleep, time
+from .kb_config import KBConfig, Timings, PERF_STAGE_NAMES, PERF_FLAG_RAM_HOT_PATH, TRACE_OPTION_PERF_SPANS, TRACE_OPTION_USB_BUFFERS
+from . import chrome_trace
 from .keyboard import KCParser, name_to_kc, print_layer
+from .trace import TraceDecoder, TraceStream
 
 parser = argparse.ArgumentParser()
 parser.add_argument("--key", "-k", nargs=4, action="append", help="Set a key. Example: `--key=0 1 2 \"KC(A)\"` set layer 0, row 1, col 2 to regular keycode 'A'")
@@ -11,6 +14,40 @@ parser.add_argument("--get-layer", "-l", type=int, help="Get and print the a key
 parser.add_argument("--reset", "-r", action='store_true', help="Reset to the bootloader. Happens after all other commands have been processed.")
 parser.add_argument("--list", action='store_true', help="Print a list of valid key names")
 parser.add_argument("--dump", type=str, help="Dump the config to a raw binary file with given filename")
+parser.add_argument("--load", type=str, help="Load a raw binary config (as produced by --dump) onto the keyboard. Use with --save to persist it")
+parser.add_argument("--export-layout", type=str, help="Write every layer of the keymap to a JSON file")
+parser.add_argument("--import-layout", type=str, help="Replace the keymap with the layers in a JSON file (as written by --export-layout). Entries can be numbers or key strings like \"KC(A)\"")
+parser.add_argument("--profile", "-p", type=int, help="Switch to a config profile. Happens before all other commands, which then apply to that profile")
+parser.add_argument("--get-timings", action="store_true", help="Print the tap-hold, double tap and combo timings of the current profile")
+parser.add_argument("--set-timings", type=int, nargs=4, metavar=("TAP_HOLD", "DOUBLE_TAP", "COMBO", "COMBO_SUPPRESS"), help="Set the timings (ms) of the current profile")
+parser.add_argument("--perf", action="store_true", help="Print per-stage CPU time and scan timer jitter for the keyboard update loop")
+parser.add_argument("--reset-perf", action="store_true", help="Reset the CPU time and scan timing counters. Happens after --perf")
+parser.add_argument("--recorder", type=str, help="Freeze the flight recorder and save its events to a JSON file")
+parser.add_argument("--resume-recorder", action="store_true", help="Clear the flight recorder and start recording again. Happens after --recorder")
+parser.add_argument("--no-crc", action="store_true", help="Don't protect messages with a CRC")
+
+def print_perf(kb: KBConfig):
+    summary, stages = kb.get_perf()
+    cycles_per_us = summary.cpu_hz / 1e6
+    budget_us = summary.tick_budget_cycles / cycles_per_us
+    print(f"tick budget: {budget_us:.0f}us, overruns: {summary.overruns}")
+    hot_path = "RAM" if summary.flags & PERF_FLAG_RAM_HOT_PATH else "flash"
+    print(
+        f"hot path in {hot_path}, XIP per tick: {summary.xip_accesses_avg} accesses, "
+        f"{summary.xip_misses_avg} misses (max {summary.xip_misses_max})"
+    )
+    print(f"{'stage':<14} {'min (us)':>10} {'avg (us)':>10} {'max (us)':>10} {'count':>10}")
+    for i, stage in enumerate(stages):
+        name = PERF_STAGE_NAMES[i] if i < len(PERF_STAGE_NAMES) else f"stage {i}"
+        print(
+            f"{name:<14} {stage.min_cycles / cycles_per_us:>10.1f} {stage.avg_cycles / cycles_per_us:>10.1f} "
+            f"{stage.max_cycles / cycles_per_us:>10.1f} {stage.count:>10}"
+        )
+
+    timing = kb.get_scan_timing()
+    print(f"scan ticks: {timing.ticks}, missed: {timing.missed_ticks}")
+    print(f"timer jitter: min {timing.jitter_min_us}us, max {timing.jitter_max_us}us, avg |{timing.jitter_avg_us}|us")
+    print(f"max tick latency: {timing.latency_max_us}us")
 
 def main():
     args = parser.parse_args()
@@ -20,9 +57,40 @@ def main():
             print(keyname)
         return
 
-    kb = KBConfig()
+    kb = KBConfig(use_crc=not args.no_crc)
     key_parser = KCParser('')
 
+    if args.profile is not None:
+        kb.set_profile(args.profile)
+        # The switch happens at the next scan
+        sleep(0.1)
+        active_profile, profile_count = kb.get_profile()
+        if active_profile != args.profile:
+            print(f"profile out of range: {args.profile}/{profile_count-1}")
+            return
+
+    if args.get_timings:
+        print(kb.get_timings())
+
+    if args.set_timings is not None:
+        kb.set_timings(Timings(*args.set_timings))
+
+    if args.perf:
+        print_perf(kb)
+
+    if args.reset_perf:
+        kb.reset_perf()
+
+    if args.recorder is not None:
+        kb.freeze_recorder()
+        events = kb.get_recorder_events()
+        with open(args.recorder, "w") as f:
+            json.dump([e.to_dict() for e in events], f, indent=2)
+        print(f"saved {len(events)} recorder events to {args.recorder}")
+
+    if args.resume_recorder:
+        kb.resume_recorder()
+
     if args.get_layer is not None:
         info = kb.get_info()
         if args.get_layer < info.layer_count:
@@ -36,6 +104,40 @@ def main():
         kb.dump_config(args.dump)
         return
 
+    if args.load is not None:
+        kb.load_config(args.load)
+
+    if args.export_layout is not None:
+        info = kb.get_info()
+        keys = kb.get_keys(0, info.layer_count * info.row_count * info.column_count)
+        layer_size = info.row_count * info.column_count
+        layers = []
+        for layer in range(info.layer_count):
+            layer_keys = keys[layer*layer_size:(layer+1)*layer_size]
+            layers.append([[f"0x{k:08x}" for k in layer_keys[r:r+info.column_count]] for r in range(0, layer_size, info.column_count)])
+        with open(args.export_layout, "w") as f:
+            json.dump({"rows": info.row_count, "columns": info.column_count, "layers": layers}, f, indent=2)
+
+    if args.import_layout is not None:
+        info = kb.get_info()
+        with open(args.import_layout, "r") as f:
+            layout = json.load(f)
+
+        if layout["rows"] != info.row_count or layout["columns"] != info.column_count or len(layout["layers"]) > info.layer_count:
+            raise Exception(f"Layout doesn't match keyboard ({info.layer_count} layers of {info.row_count}x{info.column_count})")
+
+        values = []
+        for layer in layout["layers"]:
+            for row in layer:
+                for key in row:
+                    if isinstance(key, int):
+                        values.append(key)
+                    elif key.startswith("0x"):
+                        values.append(int(key, 16))
+                    else:
+                        values.append(key_parser.parse(key))
+        kb.set_keys_range(0, values)
+
     if args.combo is not None:
         info = kb.get_info()
         for index, *keys, key_out in args.combo:
@@ -46,23 +148,93 @@ def main():
             kb.set_combo(int(index), resolved_keys, resolved_key_out, info.combo_max_size)
 
     if args.key is not None:
+        info = kb.get_info()
+        entries = []
         for layer, row, col, key_str in args.key:
             code = key_parser.parse(key_str)
             print(f"{code:08x}")
-            kb.set_key(int(layer), int(row), int(col), code)
+            index = (int(layer) * info.row_count * info.column_count) + (int(row) * info.column_count) + int(col)
+            entries.append((index, code))
+        kb.set_keys(entries)
 
+    # Edits are staged on the keyboard, and only go live when applied or saved
+    made_changes = any(a is not None for a in (args.key, args.combo, args.load, args.import_layout, args.set_timings))
     if args.save:
         kb.commit_to_flash()
         sleep(1)
+    elif made_changes:
+        kb.apply_changes()
 
     if args.reset:
         kb.reset_to_bootloader()
 
 def logger():
     kb = KBConfig()
+    stream = TraceStream(TraceDecoder(kb.get_trace_formats()))
     while True:
-        message, length = kb.get_ring_buffer_data()
-        if length == 0:
-            sleep(0.1)
-        else:
-            print(message.tobytes()[0:length].decode("utf-8"), end="")
+        packet = kb.read_trace_packet()
+        if packet is None:
+            continue
+
+        for timestamp, text in stream.feed_packet(packet):
+            if timestamp is None:
+                print(text)
+            else:
+                print(f"[{timestamp / 1e6:12.6f}] {text}")
+
+trace_parser = argparse.ArgumentParser(description="Capture firmware traces and convert them to Chrome trace JSON (chrome://tracing, ui.perfetto.dev)")
+trace_subparsers = trace_parser.add_subparsers(dest="command", required=True)
+
+capture_parser = trace_subparsers.add_parser("capture", help="Record the trace stream to a capture file")
+capture_parser.add_argument("output", type=str, help="Capture file to write")
+capture_parser.add_argument("--seconds", type=float, default=10, help="How long to capture for (default: 10)")
+capture_parser.add_argument("--spans", action="store_true", help="Also trace the duration of every scan stage")
+capture_parser.add_argument("--usb", action="store_true", help="Also trace every USB buffer completion")
+
+convert_parser = trace_subparsers.add_parser("convert", help="Convert a capture file, or a flight recorder dump, to Chrome trace JSON")
+convert_parser.add_argument("input", type=str, help="Capture file (from `kbtrace capture`) or recorder JSON (from `kbconfig --recorder`)")
+convert_parser.add_argument("output", type=str, help="Chrome trace JSON file to write")
+convert_parser.add_argument("--cpu-hz", type=int, help="CPU clock used to turn stage cycles into time (default: from the capture)")
+
+def trace_capture(args):
+    kb = KBConfig()
+    formats = kb.get_trace_formats()
+    summary, _ = kb.get_perf()
+
+    options = (TRACE_OPTION_PERF_SPANS if args.spans else 0) | (TRACE_OPTION_USB_BUFFERS if args.usb else 0)
+    kb.set_trace_options(options)
+
+    packets = []
+    end_time = time() + args.seconds
+    try:
+        while time() < end_time:
+            packet = kb.read_trace_packet()
+            if packet is not None:
+                packets.append(packet)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        kb.set_trace_options(0)
+
+    chrome_trace.write_capture(args.output, formats, summary.cpu_hz, packets)
+    print(f"captured {len(packets)} packets to {args.output}")
+
+def trace_convert(args):
+    with open(args.input) as f:
+        data = json.load(f)
+
+    if isinstance(data, list):
+        events = chrome_trace.recorder_to_events(data)
+    else:
+        formats, cpu_hz, packets = chrome_trace.read_capture(args.input)
+        events = chrome_trace.trace_stream_to_events(formats, packets, args.cpu_hz or cpu_hz)
+
+    chrome_trace.write_chrome_trace(args.output, events)
+    print(f"wrote {len(events)} trace events to {args.output}")
+
+def trace_tool():
+    args = trace_parser.parse_args()
+    if args.command == "capture":
+        trace_capture(args)
+    elif args.command == "convert":
+        trace_convert(args)
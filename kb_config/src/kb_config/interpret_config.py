@@ -1,9 +1,17 @@
 import argparse
 import struct
 import ctypes
+import zlib
 
 from keyboard import print_layer
 
+FORMAT_VERSION = 3
+
+RUN_SKIP_MASK   = 0x00ff
+RUN_COUNT_SHIFT = 8
+RUN_COUNT_MASK  = 0x7f
+RUN_WIDE        = 0x8000
+
 class kb_config_flash_header_t(ctypes.Structure):
     _fields_ = [
         ("sentinel", ctypes.c_uint32),
@@ -17,8 +25,82 @@ class kb_config_flash_header_t(ctypes.Structure):
         ("combo_count", ctypes.c_uint8),
         ("macro_max_size", ctypes.c_uint8),
         ("combo_max_size", ctypes.c_uint8),
+        ("payload_length", ctypes.c_uint16),
+        ("reserved", ctypes.c_uint16),
+        ("payload_crc", ctypes.c_uint32),
+    ]
+
+class kb_config_timings_t(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("tap_hold_delay_ms", ctypes.c_uint16),
+        ("double_tap_delay_ms", ctypes.c_uint16),
+        ("combo_delay_ms", ctypes.c_uint16),
+        ("combo_cancel_suppress_ms", ctypes.c_uint16),
     ]
 
+class Reader:
+    def __init__(self, data: bytes, offset: int = 0):
+        self.data = data
+        self.offset = offset
+
+    def read(self, fmt: str):
+        values = struct.unpack_from("<" + fmt, self.data, self.offset)
+        self.offset += struct.calcsize("<" + fmt)
+        return values if len(values) > 1 else values[0]
+
+    def read_bytes(self, length: int):
+        data = self.data[self.offset:self.offset + length]
+        self.offset += length
+        return data
+
+def decode_config(config_dump: bytes):
+    """Decodes an encoded (format version 3) config image into a dict of its contents"""
+    header = kb_config_flash_header_t.from_buffer_copy(config_dump[0:ctypes.sizeof(kb_config_flash_header_t)])
+
+    if header.sentinel != int.from_bytes(b'KEEB', 'big'):
+        raise ValueError(f"Invalid config sentinel: {header.sentinel:08x}")
+    if header.format_version != FORMAT_VERSION:
+        raise ValueError(f"Unsupported config format version: {header.format_version}")
+
+    payload_start = ctypes.sizeof(kb_config_flash_header_t)
+    payload = config_dump[payload_start:payload_start + header.payload_length]
+    if zlib.crc32(payload) != header.payload_crc:
+        raise ValueError("Config payload CRC mismatch")
+
+    reader = Reader(config_dump, payload_start)
+    timings = kb_config_timings_t.from_buffer_copy(reader.read_bytes(ctypes.sizeof(kb_config_timings_t)))
+
+    layer_size = header.row_count * header.column_count
+    layers = []
+    for _ in range(header.layer_count):
+        fill = reader.read("I")
+        run_count = reader.read("H")
+        keys = [fill] * layer_size
+        position = 0
+        for _ in range(run_count):
+            run_header = reader.read("H")
+            position += run_header & RUN_SKIP_MASK
+            count = (run_header >> RUN_COUNT_SHIFT) & RUN_COUNT_MASK
+            fmt = "I" if run_header & RUN_WIDE else "H"
+            for _ in range(count):
+                keys[position] = reader.read(fmt)
+                position += 1
+        layers.append([keys[r:r + header.column_count] for r in range(0, layer_size, header.column_count)])
+
+    macros = {}
+    for _ in range(reader.read("B")):
+        index, macro_type, length = reader.read("BBB")
+        macros[index] = (macro_type, reader.read_bytes(length))
+
+    combos = {}
+    for _ in range(reader.read("B")):
+        index, key_count = reader.read("BB")
+        keys = [reader.read("I") for _ in range(key_count)]
+        combos[index] = (keys, reader.read("I"))
+
+    return header, timings, layers, macros, combos
+
 parser = argparse.ArgumentParser()
 parser.add_argument("file", type=str, help="The raw config file")
 
@@ -28,57 +110,34 @@ def main():
     with open(args.file, "rb") as f:
         config_dump = f.read()
 
-    header = kb_config_flash_header_t.from_buffer_copy(config_dump[0:ctypes.sizeof(kb_config_flash_header_t)])
-
-    if header.sentinel != int.from_bytes(b'KEEB', 'big'):
-        print("Invalid config")
-        print(header.sentinel, hex(header.sentinel), header.sentinel.to_bytes(4, 'little'))
+    try:
+        header, timings, layers, macros, combos = decode_config(config_dump)
+    except ValueError as e:
+        print(f"Invalid config: {e}")
         exit(1)
 
-    header_size = ctypes.sizeof(kb_config_flash_header_t)
-    layer_size = ctypes.sizeof(ctypes.c_uint32) * header.row_count * header.column_count
-    layers = header.layer_count
-    macro_size = header.macro_max_size + 4
-    macros = header.macro_count
-    combo_size = 4 * 4 + 4
-    combos = header.combo_count
-
-    layers_offset = header_size
-
-    def hexdump(data, display_offset, grouping, groups_per_line):
-        hex_groups = data.hex(" ", grouping).split(" ")
-        offset = 0
-        while offset < len(hex_groups):
-            print(f"{display_offset + offset * grouping:08x}: {' '.join(hex_groups[offset:offset + groups_per_line])}")
-            offset += groups_per_line
-
-    def dump(title, start, size):
-        print(title.center(80, "."))
-        hexdump(config_dump[start:start+size], start, 4, 8)
-        print()
-        return start + size
-
-    offset = 0
-    offset = dump("header", offset, header_size)
-
-    for layer in range(layers):
-        # offset = dump(f"layer {layer}", offset, layer_size)
-        print(f"layer {layer}".center(80, "."))
-        layer_offset = layers_offset + layer * layer_size
-        layer_data = []
-        for row_offset in range(header.row_count):
-            row = []
-            for col_offset in range(header.column_count):
-                offset = layer_offset + row_offset * header.column_count + col_offset * ctypes.sizeof(ctypes.c_uint32)
-                row.append(struct.unpack("I", config_dump[offset:offset+4])[0])
-            layer_data.append(row)
+    print("header".center(80, "."))
+    for name, _ in header._fields_:
+        print(f"{name}: {getattr(header, name)}")
+    print(f"encoded size: {ctypes.sizeof(header) + header.payload_length} bytes")
+    print()
+
+    print("timings".center(80, "."))
+    for name, _ in timings._fields_:
+        print(f"{name}: {getattr(timings, name)}")
+    print()
+
+    for index, layer_data in enumerate(layers):
+        print(f"layer {index}".center(80, "."))
         print_layer(layer_data)
 
-    for macro in range(macros):
-        offset = dump(f"macro {macro}", offset, macro_size)
+    for index, (macro_type, string) in sorted(macros.items()):
+        print(f"macro {index}".center(80, "."))
+        print(f"type {macro_type}: {string.rstrip(bytes([0]))!r}")
 
-    for combo in range(combos):
-        offset = dump(f"combo {combo}", offset, combo_size)
+    for index, (keys, key_out) in sorted(combos.items()):
+        print(f"combo {index}".center(80, "."))
+        print(" + ".join(f"0x{k:08x}" for k in keys) + f" -> 0x{key_out:08x}")
 
 if __name__ == "__main__":
     main()
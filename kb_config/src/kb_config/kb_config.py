@@ -1,12 +1,13 @@
 import usb.core
-from typing import List
+from typing import List, Tuple
 from time import sleep
 from array import array
 import struct
 import ctypes
 import math
-import enum
+import zlib
 from datetime import timedelta, datetime
+from .trace import parse_formats, TRACE_STREAM_PACKET_SIZE
 
 # Need to add a udev rule like:
 # SUBSYSTEMS=="usb", ATTRS{idVendor}=="7083", ATTRS{idProduct}=="0003", GROUP="plugdev", MODE="0777"
@@ -15,6 +16,7 @@ PACKET_SIZE                         = 64
 
 KB_CONFIG_MSG_TYPE_REQ              = (0x00)
 KB_CONFIG_MSG_TYPE_RES              = (0x80)
+KB_CONFIG_MSG_TYPE_CRC              = (0x20)
 
 KB_CONFIG_MSG_GET_INFO              = (0x01)
 KB_CONFIG_MSG_GET_LAYOUT            = (0x02)
@@ -26,11 +28,71 @@ KB_CONFIG_MSG_RESET_TO_BL           = (0x07)
 KB_CONFIG_MSG_DUMP_CONFIG           = (0x08)
 KB_CONFIG_MSG_GET_COMBO             = (0x09)
 KB_CONFIG_MSG_SET_COMBO             = (0x0A)
-KB_CONFIG_MSG_GET_RING_BUFFER_DATA  = (0x0B)
+KB_CONFIG_MSG_LOAD_CONFIG           = (0x0C)
+KB_CONFIG_MSG_SET_KEYS              = (0x0D)
+KB_CONFIG_MSG_GET_KEYS              = (0x0E)
+KB_CONFIG_MSG_SET_PROFILE           = (0x0F)
+KB_CONFIG_MSG_GET_PROFILE           = (0x10)
+KB_CONFIG_MSG_SET_TIMINGS           = (0x11)
+KB_CONFIG_MSG_GET_TIMINGS           = (0x12)
+KB_CONFIG_MSG_GET_TRACE_FORMATS     = (0x13)
+KB_CONFIG_MSG_GET_PERF              = (0x14)
+KB_CONFIG_MSG_RESET_PERF            = (0x15)
+KB_CONFIG_MSG_GET_SCAN_TIMING       = (0x16)
+KB_CONFIG_MSG_RECORDER_CONTROL      = (0x17)
+KB_CONFIG_MSG_GET_RECORDER          = (0x18)
+KB_CONFIG_MSG_SET_TRACE_OPTIONS     = (0x19)
+
+KB_CONFIG_KEYS_MODE_RANGE           = (0)
+KB_CONFIG_KEYS_MODE_LIST            = (1)
 
 KB_CONFIG_COMMIT_OP_CANCEL          = (0)
 KB_CONFIG_COMMIT_OP_SAVE            = (1)
 KB_CONFIG_COMMIT_OP_ERASE           = (2)
+KB_CONFIG_COMMIT_OP_APPLY           = (3)
+
+KB_CONFIG_RECORDER_OP_FREEZE        = (0)
+KB_CONFIG_RECORDER_OP_RESUME        = (1)
+KB_CONFIG_RECORDER_EVENTS_MAX       = (256)
+
+TRACE_OPTION_PERF_SPANS             = (0x01)
+TRACE_OPTION_USB_BUFFERS            = (0x02)
+
+# Must match recorder_event_type_t in recorder.h
+RECORDER_EVENT_NAMES = [
+    "key_press",
+    "key_release",
+    "taphold_tap",
+    "taphold_hold",
+    "double_tap_single",
+    "double_tap_double",
+    "combo_fired",
+    "combo_cancelled",
+    "macro_step",
+    "report_keyboard",
+    "report_consumer",
+    "report_mouse",
+    "frozen",
+]
+
+# Must match perf_stage_t in perf.h
+PERF_STAGE_NAMES = [
+    "tick",
+    "apply_pending",
+    "matrix_scan",
+    "key_events",
+    "mouse",
+    "macro",
+    "combo",
+    "taphold",
+    "double_tap",
+    "usb_update",
+    "leds",
+    "mouse_tick",
+    "usb_irq",
+]
+
+PERF_FLAG_RAM_HOT_PATH = 0x01
 
 def struct_to_string(self):
     s = ""
@@ -63,76 +125,138 @@ class GetInfo(ctypes.Structure):
         ("combo_count", ctypes.c_uint8),
         ("macro_max_size", ctypes.c_uint8),
         ("combo_max_size", ctypes.c_uint8),
+        ("max_request_size", ctypes.c_uint16),
+        ("tx_window", ctypes.c_uint8),
+        ("profile_count", ctypes.c_uint8),
     ]
 
     def __repr__(self):
         return struct_to_string(self)
 
-class GetMacro(ctypes.Structure):
+class Timings(ctypes.Structure):
     _pack_ = 1
     _fields_ = [
-        ("macro_type", ctypes.c_uint8),
-        ("padding", ctypes.c_uint8),
-        ("length", ctypes.c_uint16),
-        ("string", ctypes.c_char * 32),
+        ("tap_hold_delay_ms", ctypes.c_uint16),
+        ("double_tap_delay_ms", ctypes.c_uint16),
+        ("combo_delay_ms", ctypes.c_uint16),
+        ("combo_cancel_suppress_ms", ctypes.c_uint16),
     ]
 
     def __repr__(self):
         return struct_to_string(self)
 
-PAYLOAD_SIZE = PACKET_SIZE - ctypes.sizeof(PacketHeader)
+class PerfSummary(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("stage_count", ctypes.c_uint8),
+        ("flags", ctypes.c_uint8),
+        ("padding", ctypes.c_uint8 * 2),
+        ("cpu_hz", ctypes.c_uint32),
+        ("tick_budget_cycles", ctypes.c_uint32),
+        ("overruns", ctypes.c_uint32),
+        ("xip_accesses_avg", ctypes.c_uint32),
+        ("xip_misses_avg", ctypes.c_uint32),
+        ("xip_misses_max", ctypes.c_uint32),
+    ]
 
-class Message:
-    class Status(enum.Enum):
-        Incomplete = 0
-        Complete = 1
-        Unexpected = 2
+    def __repr__(self):
+        return struct_to_string(self)
 
-    def __init__(self, message_type: int, length: int, data: array):
-        self.message_type = message_type
-        self.data = data
-        self.length = length
-        self.next_packet_number = 1
+class PerfStageStats(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("min_cycles", ctypes.c_uint32),
+        ("avg_cycles", ctypes.c_uint32),
+        ("max_cycles", ctypes.c_uint32),
+        ("count", ctypes.c_uint32),
+    ]
 
-    @staticmethod
-    def from_packet(packet: array):
-        header = PacketHeader.from_buffer(packet)
+    def __repr__(self):
+        return struct_to_string(self)
 
-        bytes_in_packet = min(header.payload_length, PAYLOAD_SIZE)
-        offset = ctypes.sizeof(PacketHeader)
+class ScanTiming(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("ticks", ctypes.c_uint32),
+        ("missed_ticks", ctypes.c_uint32),
+        ("jitter_min_us", ctypes.c_int32),
+        ("jitter_max_us", ctypes.c_int32),
+        ("jitter_avg_us", ctypes.c_uint32),
+        ("latency_max_us", ctypes.c_uint32),
+    ]
 
-        return Message(header.type, header.payload_length, packet[offset:offset+bytes_in_packet])
+    def __repr__(self):
+        return struct_to_string(self)
 
-    def is_complete(self):
-        return len(self.data) == self.length
+class RecorderHeader(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("event_count", ctypes.c_uint16),
+        ("returned_count", ctypes.c_uint16),
+        ("frozen", ctypes.c_uint8),
+        ("event_size", ctypes.c_uint8),
+        ("padding", ctypes.c_uint16),
+    ]
 
-    def add_packet(self, packet: array):
-        header = PacketHeader.from_buffer(packet)
-        if header.type != self.message_type:
-            return Message.Status.Unexpected
+    def __repr__(self):
+        return struct_to_string(self)
 
-        if header.packet_number != self.next_packet_number:
-            return Message.Status.Unexpected
+class RecorderEvent(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("timestamp_us", ctypes.c_uint32),
+        ("type", ctypes.c_uint8),
+        ("arg8", ctypes.c_uint8),
+        ("arg16", ctypes.c_uint16),
+        ("arg32", ctypes.c_uint32),
+    ]
 
-        bytes_remaining = self.length - len(self.data)
-        bytes_in_packet = min(bytes_remaining, PAYLOAD_SIZE)
-        offset = ctypes.sizeof(PacketHeader)
-        self.data.extend(packet[offset:offset+bytes_in_packet])
+    def name(self):
+        return RECORDER_EVENT_NAMES[self.type] if self.type < len(RECORDER_EVENT_NAMES) else f"event_{self.type}"
 
-        self.next_packet_number += 1
+    def to_dict(self):
+        return {
+            "timestamp_us": self.timestamp_us,
+            "type": self.name(),
+            "arg8": self.arg8,
+            "arg16": self.arg16,
+            "arg32": self.arg32,
+        }
 
-        if self.is_complete():
-            return Message.Status.Complete
+    def __repr__(self):
+        return struct_to_string(self)
 
-        return Message.Status.Incomplete
+class GetMacro(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("macro_type", ctypes.c_uint8),
+        ("padding", ctypes.c_uint8),
+        ("length", ctypes.c_uint16),
+        ("string", ctypes.c_char * 32),
+    ]
+
+    def __repr__(self):
+        return struct_to_string(self)
+
+PAYLOAD_SIZE = PACKET_SIZE - ctypes.sizeof(PacketHeader)
+
+CRC_SIZE = 4
+
+class Message:
+    def __init__(self, message_type: int, length: int, data: array):
+        self.message_type = message_type
+        self.data = data
+        self.length = length
 
 class KBConfig:
-    def __init__(self):
+    def __init__(self, use_crc = True):
         self.device = usb.core.find(idVendor=0x7083)
         cfg = self.device.get_active_configuration() # pyright: ignore[reportOptionalMemberAccess, reportAttributeAccessIssue]
         interface = cfg[(3, 0)] # pyright: ignore[reportIndexIssue]
         self.ep_in = interface[0]
         self.ep_out = interface[1]
+        self.ep_trace = interface[2]
+        self.use_crc = use_crc
 
     def drain_in_packets(self):
         try:
@@ -141,68 +265,102 @@ class KBConfig:
         except:
             return
 
+    @staticmethod
+    def raw_length_for_payload(payload_length: int):
+        # Number of bytes on the wire for a given payload, where only the last packet is allowed to be short
+        if payload_length == 0:
+            return ctypes.sizeof(PacketHeader)
+        full_packets, remainder = divmod(payload_length, PAYLOAD_SIZE)
+        length = full_packets * PACKET_SIZE
+        if remainder > 0:
+            length += ctypes.sizeof(PacketHeader) + remainder
+        return length
+
     def wait_for_message(self, timeout_ms = 1000):
-        message = None
         start_time = datetime.now()
-        elapsed_time = timedelta()
         while True:
+            elapsed_time = datetime.now() - start_time
+            remaining_ms = timeout_ms - int(elapsed_time.total_seconds() * 1000)
+            if remaining_ms <= 0:
+                raise TimeoutError
+
+            # The first packet tells us how long the full response is
             try:
-                packet = self.ep_in.read(PACKET_SIZE, timeout=1)
-                if message == None:
-                    if PacketHeader.from_buffer(packet).packet_number == 0:
-                        message = Message.from_packet(packet)
-                        if message.is_complete():
-                            return message
-                else:
-                    status = message.add_packet(packet)
-                    if status == Message.Status.Complete:
-                        return message
-                    elif status == Message.Status.Unexpected:
-                        message = None
-            except:
-                sleep(0.001)
-
-            elapsed_time += datetime.now() - start_time
-            if (elapsed_time.total_seconds() * 1000) > timeout_ms:
+                packet = self.ep_in.read(PACKET_SIZE, timeout=remaining_ms)
+            except usb.core.USBTimeoutError:
                 raise TimeoutError
 
-            start_time = datetime.now()
+            header = PacketHeader.from_buffer_copy(packet[:ctypes.sizeof(PacketHeader)])
+            if header.packet_number != 0:
+                # Tail of some earlier response; keep looking for the start of a message
+                continue
+
+            header_size = ctypes.sizeof(PacketHeader)
+            data = packet[header_size:header_size + min(header.payload_length, PAYLOAD_SIZE)]
+
+            # Everything else is read in a single transfer, which the keyboard streams a window at a time
+            remaining_length = header.payload_length - len(data)
+            if remaining_length > 0:
+                raw = self.ep_in.read(KBConfig.raw_length_for_payload(remaining_length), timeout=timeout_ms)
+                expected_packet_number = 1
+                for offset in range(0, len(raw), PACKET_SIZE):
+                    packet_header = PacketHeader.from_buffer_copy(raw[offset:offset + header_size])
+                    if packet_header.type != header.type or packet_header.packet_number != expected_packet_number:
+                        raise IOError("Out of sequence packet in response")
+                    bytes_in_packet = min(header.payload_length - len(data), PAYLOAD_SIZE)
+                    data.extend(raw[offset + header_size:offset + header_size + bytes_in_packet])
+                    expected_packet_number += 1
+
+            if len(data) != header.payload_length:
+                raise IOError("Truncated response")
+
+            message_type = header.type
+            if message_type & KB_CONFIG_MSG_TYPE_CRC:
+                crc = int.from_bytes(data[-CRC_SIZE:].tobytes(), "little")
+                data = data[:-CRC_SIZE]
+                if zlib.crc32(data.tobytes()) != crc:
+                    raise IOError("CRC mismatch in response")
+                message_type &= ~KB_CONFIG_MSG_TYPE_CRC
+
+            return Message(message_type, len(data), data)
 
     @staticmethod
-    def prepare_message(message_type: int, data: bytearray | bytes | None = None):
+    def prepare_message(message_type: int, data: bytearray | bytes | None = None, use_crc = False):
         if data is None:
             data = bytearray([])
 
-        message_size = max(1, math.ceil( len(data) / (PACKET_SIZE - ctypes.sizeof(PacketHeader)) )) * PACKET_SIZE
-        message_buffer = array("B", [0] * message_size)
-        packet_number = 0
-        data_offset = 0
-        header = PacketHeader()
-        message_offset = 0
+        payload = bytes(data)
+        if use_crc:
+            payload += struct.pack("<I", zlib.crc32(payload))
+            message_type |= KB_CONFIG_MSG_TYPE_CRC
 
-        while message_offset < message_size:
-            message_offset = packet_number * PACKET_SIZE
+        header_size = ctypes.sizeof(PacketHeader)
+        packet_count = max(1, math.ceil(len(payload) / PAYLOAD_SIZE))
+        message_buffer = array("B", [0] * (packet_count * PACKET_SIZE))
+
+        for packet_number in range(packet_count):
+            header = PacketHeader()
             header.type = message_type
             header.packet_number = packet_number
-            header.payload_length = len(data)
+            header.payload_length = len(payload)
 
-            message_buffer[message_offset:ctypes.sizeof(PacketHeader)] = array("B", bytes(header))
-
-            packet_payload_size = min(PAYLOAD_SIZE, len(data) - data_offset)
-            message_offset += ctypes.sizeof(PacketHeader)
-            message_buffer[message_offset:message_offset+packet_payload_size] = array("B", data[data_offset:packet_payload_size])
+            message_offset = packet_number * PACKET_SIZE
+            message_buffer[message_offset:message_offset+header_size] = array("B", bytes(header))
 
-            packet_number += 1
-            data_offset += PAYLOAD_SIZE
-            message_offset += PACKET_SIZE
+            chunk = payload[packet_number*PAYLOAD_SIZE:(packet_number+1)*PAYLOAD_SIZE]
+            message_offset += header_size
+            message_buffer[message_offset:message_offset+len(chunk)] = array("B", chunk)
 
         return message_buffer
 
+    def send_message(self, message_type: int, data: bytearray | bytes | None = None):
+        self.ep_out.write(KBConfig.prepare_message(message_type, data, self.use_crc))
+
     def get_info(self):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_GET_INFO | KB_CONFIG_MSG_TYPE_REQ,
             bytearray()
-        ))
+        )
 
         response = self.wait_for_message()
         assert(response.message_type == KB_CONFIG_MSG_GET_INFO | KB_CONFIG_MSG_TYPE_RES)
@@ -211,26 +369,26 @@ class KBConfig:
         return info
 
     def get_macro(self, index):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_GET_MACRO | KB_CONFIG_MSG_TYPE_REQ,
             bytearray([index])
-        ))
+        )
 
         response = self.wait_for_message()
         assert(response.message_type == KB_CONFIG_MSG_GET_MACRO | KB_CONFIG_MSG_TYPE_RES)
         return response.data
 
     def set_macro(self, index, string: bytearray | bytes):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_SET_MACRO | KB_CONFIG_MSG_TYPE_REQ,
             bytes([index, 0x01, 0x00]) + (len(string) + 1).to_bytes(2, "little") + string + b'\x00'
-        ))
+        )
 
     def get_layout(self, layer: int):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_GET_LAYOUT | KB_CONFIG_MSG_TYPE_REQ,
             bytearray([layer])
-        ))
+        )
 
         message = self.wait_for_message()
         assert(message.message_type == KB_CONFIG_MSG_GET_LAYOUT | KB_CONFIG_MSG_TYPE_RES)
@@ -243,38 +401,176 @@ class KBConfig:
         return keys
 
     def set_key(self, layer: int, row: int, col: int, key: int):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_SET_KEY | KB_CONFIG_MSG_TYPE_REQ,
             bytearray([layer, row, col, 0xff]) + struct.pack("<I", key)
-        ))
+        )
+
+    def set_keys_range(self, start: int, values: List[int]):
+        self.send_message(
+            KB_CONFIG_MSG_SET_KEYS | KB_CONFIG_MSG_TYPE_REQ,
+            struct.pack("<BBHH", KB_CONFIG_KEYS_MODE_RANGE, 0, start, len(values)) + struct.pack(f"<{len(values)}I", *values)
+        )
+
+    def set_keys(self, entries: List[Tuple[int, int]]):
+        # Sparse (flat index, value) pairs, applied by the keyboard all at once
+        payload = struct.pack("<BBHH", KB_CONFIG_KEYS_MODE_LIST, 0, 0, len(entries))
+        for index, value in entries:
+            payload += struct.pack("<HI", index, value)
+
+        self.send_message(
+            KB_CONFIG_MSG_SET_KEYS | KB_CONFIG_MSG_TYPE_REQ,
+            payload
+        )
+
+    def get_keys(self, start: int, count: int):
+        self.send_message(
+            KB_CONFIG_MSG_GET_KEYS | KB_CONFIG_MSG_TYPE_REQ,
+            struct.pack("<BBHH", KB_CONFIG_KEYS_MODE_RANGE, 0, start, count)
+        )
+
+        message = self.wait_for_message()
+        assert(message.message_type == KB_CONFIG_MSG_GET_KEYS | KB_CONFIG_MSG_TYPE_RES)
+        return list(struct.unpack(f"<{count}I", message.data.tobytes()))
+
+    def set_profile(self, profile: int):
+        self.send_message(
+            KB_CONFIG_MSG_SET_PROFILE | KB_CONFIG_MSG_TYPE_REQ,
+            bytearray([profile])
+        )
+
+    def get_profile(self):
+        self.send_message(KB_CONFIG_MSG_GET_PROFILE | KB_CONFIG_MSG_TYPE_REQ)
+
+        message = self.wait_for_message()
+        assert(message.message_type == KB_CONFIG_MSG_GET_PROFILE | KB_CONFIG_MSG_TYPE_RES)
+        active_profile, profile_count = message.data[0], message.data[1]
+        return active_profile, profile_count
+
+    def set_timings(self, timings: Timings):
+        self.send_message(
+            KB_CONFIG_MSG_SET_TIMINGS | KB_CONFIG_MSG_TYPE_REQ,
+            bytes(timings)
+        )
+
+    def get_timings(self):
+        self.send_message(KB_CONFIG_MSG_GET_TIMINGS | KB_CONFIG_MSG_TYPE_REQ)
+
+        message = self.wait_for_message()
+        assert(message.message_type == KB_CONFIG_MSG_GET_TIMINGS | KB_CONFIG_MSG_TYPE_RES)
+        return Timings.from_buffer_copy(message.data.tobytes())
+
+    def get_perf(self):
+        self.send_message(KB_CONFIG_MSG_GET_PERF | KB_CONFIG_MSG_TYPE_REQ)
+
+        message = self.wait_for_message()
+        assert(message.message_type == KB_CONFIG_MSG_GET_PERF | KB_CONFIG_MSG_TYPE_RES)
+        data = message.data.tobytes()
+        summary = PerfSummary.from_buffer_copy(data)
+
+        stages = []
+        offset = ctypes.sizeof(PerfSummary)
+        for _ in range(summary.stage_count):
+            stages.append(PerfStageStats.from_buffer_copy(data, offset))
+            offset += ctypes.sizeof(PerfStageStats)
+        return summary, stages
+
+    def get_scan_timing(self):
+        self.send_message(KB_CONFIG_MSG_GET_SCAN_TIMING | KB_CONFIG_MSG_TYPE_REQ)
+
+        message = self.wait_for_message()
+        assert(message.message_type == KB_CONFIG_MSG_GET_SCAN_TIMING | KB_CONFIG_MSG_TYPE_RES)
+        return ScanTiming.from_buffer_copy(message.data.tobytes())
+
+    def freeze_recorder(self):
+        self.send_message(
+            KB_CONFIG_MSG_RECORDER_CONTROL | KB_CONFIG_MSG_TYPE_REQ,
+            bytearray([KB_CONFIG_RECORDER_OP_FREEZE])
+        )
+
+    def resume_recorder(self):
+        self.send_message(
+            KB_CONFIG_MSG_RECORDER_CONTROL | KB_CONFIG_MSG_TYPE_REQ,
+            bytearray([KB_CONFIG_RECORDER_OP_RESUME])
+        )
+
+    def get_recorder_events(self):
+        # Events are fetched oldest first, a response at a time. The recorder should be frozen first
+        events: List[RecorderEvent] = []
+        while True:
+            self.send_message(
+                KB_CONFIG_MSG_GET_RECORDER | KB_CONFIG_MSG_TYPE_REQ,
+                struct.pack("<HH", len(events), KB_CONFIG_RECORDER_EVENTS_MAX)
+            )
+
+            message = self.wait_for_message()
+            assert(message.message_type == KB_CONFIG_MSG_GET_RECORDER | KB_CONFIG_MSG_TYPE_RES)
+            data = message.data.tobytes()
+            header = RecorderHeader.from_buffer_copy(data)
+
+            offset = ctypes.sizeof(RecorderHeader)
+            for _ in range(header.returned_count):
+                events.append(RecorderEvent.from_buffer_copy(data, offset))
+                offset += header.event_size
+
+            if header.returned_count == 0 or len(events) >= header.event_count:
+                return events
+
+    def reset_perf(self):
+        self.send_message(KB_CONFIG_MSG_RESET_PERF | KB_CONFIG_MSG_TYPE_REQ)
 
     def commit_to_flash(self):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_COMMIT | KB_CONFIG_MSG_TYPE_REQ,
             bytearray([0x4c, 0x4f, 0x4f, 0x43, KB_CONFIG_COMMIT_OP_SAVE])
-        ))
+        )
+
+    def apply_changes(self):
+        self.send_message(
+            KB_CONFIG_MSG_COMMIT | KB_CONFIG_MSG_TYPE_REQ,
+            bytearray([0x4c, 0x4f, 0x4f, 0x43, KB_CONFIG_COMMIT_OP_APPLY])
+        )
+
+    def cancel_changes(self):
+        self.send_message(
+            KB_CONFIG_MSG_COMMIT | KB_CONFIG_MSG_TYPE_REQ,
+            bytearray([0x4c, 0x4f, 0x4f, 0x43, KB_CONFIG_COMMIT_OP_CANCEL])
+        )
 
     def erase_flash_config(self):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_COMMIT | KB_CONFIG_MSG_TYPE_REQ,
             bytearray([0x4c, 0x4f, 0x4f, 0x43, KB_CONFIG_COMMIT_OP_ERASE])
-        ))
+        )
 
     def reset_to_bootloader(self):
-        self.ep_out.write(KBConfig.prepare_message(KB_CONFIG_MSG_RESET_TO_BL | KB_CONFIG_MSG_TYPE_REQ))
+        self.send_message(KB_CONFIG_MSG_RESET_TO_BL | KB_CONFIG_MSG_TYPE_REQ)
 
     def dump_config(self, filename: str):
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_DUMP_CONFIG | KB_CONFIG_MSG_TYPE_REQ
-        ))
+        )
 
         message = self.wait_for_message()
         assert(message.message_type == KB_CONFIG_MSG_DUMP_CONFIG | KB_CONFIG_MSG_TYPE_RES)
-        assert(len(message.data) == 4096)
+        if len(message.data) == 0:
+            raise ValueError("The config is too large to be encoded")
 
         with open(filename, "wb") as f:
             f.write(message.data.tobytes())
 
+    def load_config(self, filename: str):
+        with open(filename, "rb") as f:
+            image = f.read()
+
+        if len(image) > 4096:
+            raise ValueError(f"Config image must be at most 4096 bytes (got {len(image)})")
+
+        self.send_message(
+            KB_CONFIG_MSG_LOAD_CONFIG | KB_CONFIG_MSG_TYPE_REQ,
+            image
+        )
+
     def set_combo(self, index: int, keys: List[int], key_out: int, max_keys_per_combo=4):
         keys = keys + ([0] * (max_keys_per_combo - len(keys)))
         payload = index.to_bytes(1, 'little')
@@ -282,17 +578,27 @@ class KBConfig:
             payload += k.to_bytes(4, "little")
         payload += key_out.to_bytes(4, "little")
 
-        self.ep_out.write(KBConfig.prepare_message(
+        self.send_message(
             KB_CONFIG_MSG_SET_COMBO | KB_CONFIG_MSG_TYPE_REQ,
             payload
-        ))
+        )
+
+    def read_trace_packet(self, timeout_ms = 100):
+        # The keyboard only queues a trace packet when it has something to send, so a timeout just means it's quiet
+        try:
+            return self.ep_trace.read(TRACE_STREAM_PACKET_SIZE, timeout=timeout_ms).tobytes()
+        except usb.core.USBTimeoutError:
+            return None
+
+    def set_trace_options(self, options: int):
+        self.send_message(
+            KB_CONFIG_MSG_SET_TRACE_OPTIONS | KB_CONFIG_MSG_TYPE_REQ,
+            struct.pack("<I", options)
+        )
 
-    def get_ring_buffer_data(self):
-        self.ep_out.write(KBConfig.prepare_message(
-            KB_CONFIG_MSG_GET_RING_BUFFER_DATA | KB_CONFIG_MSG_TYPE_REQ,
-            bytearray([])
-        ))
+    def get_trace_formats(self):
+        self.send_message(KB_CONFIG_MSG_GET_TRACE_FORMATS | KB_CONFIG_MSG_TYPE_REQ)
 
         message = self.wait_for_message()
-        assert(message.message_type == KB_CONFIG_MSG_GET_RING_BUFFER_DATA | KB_CONFIG_MSG_TYPE_RES)
-        return message.data, message.length
+        assert(message.message_type == KB_CONFIG_MSG_GET_TRACE_FORMATS | KB_CONFIG_MSG_TYPE_RES)
+        return parse_formats(message.data.tobytes())
@@ -17,6 +17,9 @@ ENTRY_ARG8_MASK         = (0x00ff0000)
 ENTRY_ARG8_SHIFT        = (16)
 
 KC_MASK                 = (0x000000ff)
+
+CC_PAGE_MASK            = ENTRY_ARG8_MASK
+CC_PAGE_SYSTEM          = (0x01 << ENTRY_ARG8_SHIFT)
 KEY_MODS_MASK           = (0x0000ff00)
 KEY_MODS_SHIFT          = (8)
 
@@ -451,6 +454,8 @@ def kbc_to_str(key: int):
 
 def cc_to_str(key: int):
     code = key & 0xffff
+    if (key & CC_PAGE_MASK) == CC_PAGE_SYSTEM:
+        return f"SC({code})"
     return f"CC({code})"
 
 def mo_to_str(key: int):
@@ -626,6 +631,12 @@ class KCParser:
         self.check_and_consume(')')
         return ENTRY_TYPE_CC | index
 
+    def parse_sc(self):
+        self.check_and_consume("(")
+        index = self.parse_number()
+        self.check_and_consume(')')
+        return ENTRY_TYPE_CC | CC_PAGE_SYSTEM | index
+
     def parse_mo(self):
         self.check_and_consume("(")
         operation = self.parse_number()
@@ -658,6 +669,9 @@ class KCParser:
         if self.string.startswith("CC"):
             self.consume(2)
             return self.parse_cc()
+        if self.string.startswith("SC"):
+            self.consume(2)
+            return self.parse_sc()
         if self.string.startswith("MO"):
             self.consume(2)
             return self.parse_mo()
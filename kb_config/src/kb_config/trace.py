@@ -0,0 +1,128 @@
+import re
+import struct
+from typing import Iterator, List, NamedTuple, Optional, Tuple
+
+# Must match src/trace.h
+TRACE_HEADER_WORDS          = 2
+TRACE_RECORD_MARKER         = 0xa5000000
+TRACE_RECORD_MARKER_MASK    = 0xff000000
+TRACE_RECORD_ARGC_SHIFT     = 16
+TRACE_RECORD_ARGC_MASK      = 0xff
+TRACE_RECORD_ID_MASK        = 0xffff
+
+TRACE_STREAM_PACKET_SIZE    = 64
+TRACE_STREAM_HEADER         = struct.Struct("<HBBI") # sequence, word_count, flags, dropped
+TRACE_STREAM_FLAG_OVERFLOW  = 0x01
+
+# Only integer conversions make sense for raw argument words
+SIGNED_CONVERSION = re.compile(r"%[-+ #0-9.]*[di]")
+
+# Pseudo trace ids for stream notices, which aren't records from the keyboard
+STREAM_PACKETS_LOST         = -1
+STREAM_RECORDS_DROPPED      = -2
+
+class StreamItem(NamedTuple):
+    trace_id: int
+    timestamp: Optional[int]
+    args: List[int]
+
+def words_from_bytes(data: bytes) -> List[int]:
+    count = len(data) // 4
+    return list(struct.unpack(f"<{count}I", data[:count * 4]))
+
+def parse_formats(data: bytes) -> List[str]:
+    """Splits the NUL separated format table returned by GET_TRACE_FORMATS"""
+    return [f.decode("utf-8") for f in data.rstrip(b"\x00").split(b"\x00")]
+
+class TraceDecoder:
+    """
+    Turns a stream of trace words into formatted events. Records can be split across reads, so partial
+    records are kept until the rest arrives.
+    """
+    def __init__(self, formats: List[str]):
+        self.formats = formats
+        self.pending: List[int] = []
+
+    def feed_bytes(self, data: bytes):
+        return self.feed(words_from_bytes(data))
+
+    def records(self, words: List[int]) -> Iterator[Tuple[int, int, List[int]]]:
+        """Yields (trace_id, timestamp, args) for every complete record"""
+        self.pending.extend(words)
+        while self.pending:
+            header = self.pending[0]
+            if (header & TRACE_RECORD_MARKER_MASK) != TRACE_RECORD_MARKER:
+                # Not the start of a record (e.g. joined a stream midway). Skip until the next marker
+                self.pending.pop(0)
+                continue
+
+            argc = (header >> TRACE_RECORD_ARGC_SHIFT) & TRACE_RECORD_ARGC_MASK
+            if len(self.pending) < TRACE_HEADER_WORDS + argc:
+                return
+
+            trace_id = header & TRACE_RECORD_ID_MASK
+            timestamp = self.pending[1]
+            args = self.pending[TRACE_HEADER_WORDS:TRACE_HEADER_WORDS + argc]
+            del self.pending[:TRACE_HEADER_WORDS + argc]
+
+            yield trace_id, timestamp, args
+
+    def feed(self, words: List[int]) -> Iterator[Tuple[int, str]]:
+        for trace_id, timestamp, args in self.records(words):
+            yield timestamp, self.format(trace_id, args)
+
+    def format(self, trace_id: int, args: List[int]) -> str:
+        if trace_id >= len(self.formats):
+            return f"<unknown trace id {trace_id}> " + " ".join(f"0x{a:08x}" for a in args)
+
+        fmt = self.formats[trace_id]
+        # Reinterpret words as signed where the format asks for it
+        signed_positions = {m.start() for m in SIGNED_CONVERSION.finditer(fmt)}
+        values = []
+        for index, match in enumerate(re.finditer(r"%[-+ #0-9.]*[a-zA-Z%]", fmt)):
+            if match.group().endswith("%"):
+                continue
+            value = args[len(values)] if len(values) < len(args) else 0
+            if match.start() in signed_positions and value & 0x80000000:
+                value -= 1 << 32
+            values.append(value)
+
+        try:
+            return fmt % tuple(values)
+        except (TypeError, ValueError):
+            return f"{fmt} " + " ".join(f"0x{a:08x}" for a in args)
+
+class TraceStream:
+    """Unpacks packets from the trace streaming endpoint, tracking sequence gaps and reported overflows"""
+    def __init__(self, decoder: TraceDecoder):
+        self.decoder = decoder
+        self.next_sequence = None
+        self.last_dropped = None
+
+    def packet_records(self, packet: bytes) -> Iterator[StreamItem]:
+        """Yields the records in a packet, preceded by any lost packet or dropped record notices"""
+        sequence, word_count, flags, dropped = TRACE_STREAM_HEADER.unpack_from(packet)
+
+        if self.next_sequence is not None and sequence != self.next_sequence:
+            yield StreamItem(STREAM_PACKETS_LOST, None, [(sequence - self.next_sequence) & 0xffff])
+            # Whatever record was in progress can't be completed now
+            self.decoder.pending.clear()
+        self.next_sequence = (sequence + 1) & 0xffff
+
+        if flags & TRACE_STREAM_FLAG_OVERFLOW:
+            new_drops = dropped - self.last_dropped if self.last_dropped is not None else dropped
+            yield StreamItem(STREAM_RECORDS_DROPPED, None, [new_drops & 0xffffffff])
+        self.last_dropped = dropped
+
+        words = packet[TRACE_STREAM_HEADER.size:TRACE_STREAM_HEADER.size + word_count * 4]
+        for trace_id, timestamp, args in self.decoder.records(words_from_bytes(words)):
+            yield StreamItem(trace_id, timestamp, args)
+
+    def feed_packet(self, packet: bytes) -> Iterator[Tuple[Optional[int], str]]:
+        for item in self.packet_records(packet):
+            if item.trace_id == STREAM_PACKETS_LOST:
+                yield None, f"<{item.args[0]} trace packets lost>"
+            elif item.trace_id == STREAM_RECORDS_DROPPED:
+                yield None, f"<{item.args[0]} trace records dropped>"
+            else:
+                yield item.timestamp, self.decoder.format(item.trace_id, item.args)
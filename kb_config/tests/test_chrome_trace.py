@@ -0,0 +1,72 @@
+import json
+import os
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "src"))
+
+from kb_config.chrome_trace import read_capture, trace_stream_to_events, write_chrome_trace
+
+# Four packets from the trace stream: a key press, tick and usb_irq spans, a buffer completion, a key release, a
+# matrix_scan span split across two packets, then a lost packet and 3 dropped records before a combo firing
+CAPTURE = os.path.join(os.path.dirname(__file__), "data", "trace_capture.json")
+
+class TestChromeTrace(unittest.TestCase):
+    def convert(self):
+        formats, cpu_hz, packets = read_capture(CAPTURE)
+        events = trace_stream_to_events(formats, packets, cpu_hz)
+
+        # Round trip through the file, so the checks see what Chrome would
+        with tempfile.TemporaryDirectory() as tmp:
+            filename = os.path.join(tmp, "trace.json")
+            write_chrome_trace(filename, events)
+            with open(filename) as f:
+                trace = json.load(f)
+
+        return [e for e in trace["traceEvents"] if e["ph"] != "M"]
+
+    def test_events(self):
+        events = self.convert()
+
+        self.assertEqual([(e["name"], e["ph"], e["tid"]) for e in events], [
+            ("press 1,2", "i", 3),
+            ("tick", "X", 0),
+            ("usb_irq", "X", 2),
+            ("buffers complete", "i", 2),
+            ("release 1,2", "i", 3),
+            ("matrix_scan", "X", 1),
+            ("packets lost", "i", 4),
+            ("records dropped", "i", 4),
+            ("combo 1 fired -> 0x00000029", "i", 4),
+        ])
+
+    def test_key_events(self):
+        press = self.convert()[0]
+
+        self.assertEqual(press["ts"], 1000)
+        self.assertEqual(press["args"], {"row": 1, "col": 2, "key": "0x00000004"})
+
+    def test_spans_end_at_their_timestamp(self):
+        tick = self.convert()[1]
+
+        # 62500 cycles at 125MHz is 500us, recorded at 1010us
+        self.assertAlmostEqual(tick["dur"], 500)
+        self.assertAlmostEqual(tick["ts"], 510)
+        self.assertEqual(tick["args"], {"cycles": 62500})
+
+    def test_record_split_across_packets(self):
+        scan = self.convert()[5]
+
+        self.assertAlmostEqual(scan["dur"], 200)
+        self.assertAlmostEqual(scan["ts"], 1800)
+
+    def test_stream_notices(self):
+        events = self.convert()
+
+        self.assertEqual(events[6]["args"], {"count": 1})
+        self.assertEqual(events[7]["args"], {"count": 3})
+        self.assertEqual(events[6]["ts"], 2000)
+
+if __name__ == "__main__":
+    unittest.main()
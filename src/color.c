@@ -1,4 +1,26 @@
 #include "color.h"
+#include "hot_path.h"
+
+// statics
+// round(255 * (i / 255) ^ 2.2): maps linear 8-bit intensities onto the LEDs' roughly exponential response
+static const uint8_t color_gamma[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
 
 // private functions
 static uint8_t color_hue2rgb(uint16_t p, uint16_t q, uint16_t t) {
@@ -69,3 +91,17 @@ void color_hsl2rgb(const uint8_t* hsl, uint8_t* rgb) {
     rgb[1] = color_hue2rgb(p, q, h);
     rgb[2] = color_hue2rgb(p, q, h - 85);
 }
+
+void color_build_brightness_lut(uint8_t brightness, uint8_t* lut) {
+    // brightness + 1 so that full brightness (255) leaves the gamma curve untouched
+    const uint32_t scale = (uint32_t)brightness + 1;
+    for (uint i = 0; i < 256; i++) {
+        lut[i] = (uint8_t)((color_gamma[i] * scale) >> 8);
+    }
+}
+
+void HOT_PATH_FUNC(color_apply_lut)(const uint8_t* lut, const uint8_t* rgb, uint8_t* rgb_out) {
+    rgb_out[0] = lut[rgb[0]];
+    rgb_out[1] = lut[rgb[1]];
+    rgb_out[2] = lut[rgb[2]];
+}
@@ -18,5 +18,12 @@
 // typedefs
 
 // public functions
+
+// HSL conversions use several divides each, so they're for generating effect colors, not for per-LED output
 void color_rgb2hsl(const uint8_t* rgb, uint8_t* hsl);
 void color_hsl2rgb(const uint8_t* hsl, uint8_t* rgb);
+
+// Output colors go through a 256 entry table combining gamma correction and brightness scaling. The table is rebuilt
+// only when the brightness changes; applying it is three loads per LED.
+void color_build_brightness_lut(uint8_t brightness, uint8_t* lut);
+void color_apply_lut(const uint8_t* lut, const uint8_t* rgb, uint8_t* rgb_out);
@@ -6,15 +6,19 @@
 
 #include "combo.h"
 #include "matrix.h"
-#include "log.h"
+#include "trace.h"
+#include "recorder.h"
+#include "hot_path.h"
 
 #include <string.h>
 
 // statics
 static combo_t* combos = NULL;
+static uint16_t combo_delay_ms = COMBO_DELAY_MS;
+static uint16_t combo_cancel_suppress_ms = COMBO_CANCEL_SUPPRESS_MS;
 
 // private functions
-static int combo_get_key_index(uint combo_index, keymap_entry_t key) {
+static int HOT_PATH_FUNC(combo_get_key_index)(uint combo_index, keymap_entry_t key) {
     for (uint key_index = 0; key_index < COMBO_KEYS_MAX; key_index++) {
         if (combos[combo_index].keys[key_index] == key) return key_index;
         if (combos[combo_index].keys[key_index] == KC_NONE) return -1;
@@ -22,7 +26,7 @@ static int combo_get_key_index(uint combo_index, keymap_entry_t key) {
     return -1;
 }
 
-static int combo_find_next_with_key(uint start_index, keymap_entry_t key) {
+static int HOT_PATH_FUNC(combo_find_next_with_key)(uint start_index, keymap_entry_t key) {
     for (uint i = start_index; i < COMBO_MAX; i++) {
         if (combos[start_index].state == combo_state_invalid) return -1;
 
@@ -34,14 +38,14 @@ static int combo_find_next_with_key(uint start_index, keymap_entry_t key) {
     return -1;
 }
 
-static void combo_update_key_in_active(uint combo_index, uint key_index, uint row, uint col) {
+static void HOT_PATH_FUNC(combo_update_key_in_active)(uint combo_index, uint key_index, uint row, uint col) {
     combos[combo_index].keys_pressed_bitmask |= (1 << key_index);
     combos[combo_index].key_positions[key_index].row = row;
     combos[combo_index].key_positions[key_index].col = col;
     matrix_mark_key_as_handled(row, col);
 }
 
-static void combo_start(uint combo_index, uint key_index) {
+static void HOT_PATH_FUNC(combo_start)(uint combo_index, uint key_index) {
     combos[combo_index].state = combo_state_active;
 
     // Set all the key positions to 0xff, since 0x00 will always be a valid column and row and could cause misfires
@@ -50,7 +54,7 @@ static void combo_start(uint combo_index, uint key_index) {
     combos[combo_index].keys_pressed_bitmask = 0;
 }
 
-static bool combo_is_complete(uint combo_index) {
+static bool HOT_PATH_FUNC(combo_is_complete)(uint combo_index) {
     for (uint key_index = 0; key_index < COMBO_KEYS_MAX; key_index++) {
         if (combos[combo_index].keys[key_index] == KC_NONE) break;
         if ((combos[combo_index].keys_pressed_bitmask & (1 << key_index)) == 0) {
@@ -60,7 +64,7 @@ static bool combo_is_complete(uint combo_index) {
     return true;
 }
 
-static int combo_get_single_pressed_index(uint combo_index) {
+static int HOT_PATH_FUNC(combo_get_single_pressed_index)(uint combo_index) {
     uint8_t mask = combos[combo_index].keys_pressed_bitmask;
 
     for (uint key_index = 0; key_index < COMBO_KEYS_MAX; key_index++) {
@@ -84,7 +88,7 @@ static int combo_get_single_pressed_index(uint combo_index) {
     return -1;
 }
 
-static void combo_mark_keys_as_handled(uint combo_index) {
+static void HOT_PATH_FUNC(combo_mark_keys_as_handled)(uint combo_index) {
     // Mark the keys involved as handled
     for (uint key_index = 0; key_index < COMBO_KEYS_MAX; key_index++) {
         if (combos[combo_index].keys[key_index] == KC_NONE) break;
@@ -92,7 +96,7 @@ static void combo_mark_keys_as_handled(uint combo_index) {
     }
 }
 
-static void combo_deactivate_unfinished_overlapping_combos(uint combo_index) {
+static void HOT_PATH_FUNC(combo_deactivate_unfinished_overlapping_combos)(uint combo_index) {
     for (uint key_index = 0; key_index < COMBO_KEYS_MAX; key_index++) {
         keymap_entry_t key = combos[combo_index].keys[key_index];
         if (key == KC_NONE) break;
@@ -110,7 +114,7 @@ static void combo_deactivate_unfinished_overlapping_combos(uint combo_index) {
     }
 }
 
-static bool combo_have_all_keys_been_released(uint combo_index) {
+static bool HOT_PATH_FUNC(combo_have_all_keys_been_released)(uint combo_index) {
     rowcol_t* rowcol = NULL;
     const uint32_t* pressed = matrix_get_pressed_bitmap();
 
@@ -145,7 +149,12 @@ void combo_reset(void) {
     }
 }
 
-bool combo_on_key_press(uint row, uint col, keymap_entry_t key) {
+void combo_set_timings(uint16_t delay_ms, uint16_t cancel_suppress_ms) {
+    combo_delay_ms = delay_ms;
+    combo_cancel_suppress_ms = cancel_suppress_ms;
+}
+
+bool HOT_PATH_FUNC(combo_on_key_press)(uint row, uint col, keymap_entry_t key) {
     bool was_handled = false;
     int combo_index = combo_find_next_with_key(0, key);
 
@@ -170,9 +179,8 @@ bool combo_on_key_press(uint row, uint col, keymap_entry_t key) {
             }
 
             if (combo_is_complete(combo_index)) {
-                log_str("Combo ");
-                log_hex(combo_index, true);
-                log_str("\n");
+                trace2(TRACE_COMBO_FIRED, combo_index, combos[combo_index].key_out);
+                recorder_log(RECORDER_COMBO_FIRED, combo_index, 0, combos[combo_index].key_out);
 
                 keyboard_send_key(combos[combo_index].key_out);
                 combos[combo_index].state = combo_state_wait_for_all_released;
@@ -189,7 +197,7 @@ bool combo_on_key_press(uint row, uint col, keymap_entry_t key) {
     return was_handled;
 }
 
-bool combo_on_key_release(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(combo_on_key_release)(uint row, uint col, keymap_entry_t key) {
     bool was_handled = false;
     int combo_index = combo_find_next_with_key(0, key);
 
@@ -209,6 +217,7 @@ bool combo_on_key_release(uint row, uint col, keymap_entry_t key) {
                 int single_key_index = combo_get_single_pressed_index(combo_index);
                 if (single_key_index == -1) {
                     // There was more than one key pressed, go to the cooldown state
+                    recorder_log(RECORDER_COMBO_CANCELLED, combo_index, 0, 0);
                     combos[combo_index].state = combo_state_cooldown;
                     combos[combo_index].time_since_first_press = 0;
 
@@ -231,7 +240,7 @@ bool combo_on_key_release(uint row, uint col, keymap_entry_t key) {
     return was_handled;
 }
 
-bool combo_update(void) {
+bool HOT_PATH_FUNC(combo_update)(uint16_t elapsed_ms) {
     bool there_are_unresolved_combos = false;
 
     for (uint combo_index = 0; combo_index < COMBO_MAX; combo_index++) {
@@ -240,8 +249,8 @@ bool combo_update(void) {
 
         if (combos[combo_index].state == combo_state_cooldown) {
             // If the configured time has passed, go to inactive
-            combos[combo_index].time_since_first_press += MATRIX_SCAN_INTERVAL_MS;
-            if (combos[combo_index].time_since_first_press >= COMBO_CANCEL_SUPPRESS_MS) {
+            combos[combo_index].time_since_first_press += elapsed_ms;
+            if (combos[combo_index].time_since_first_press >= combo_cancel_suppress_ms) {
                 combos[combo_index].state = combo_state_inactive;
             } else {
                 combo_mark_keys_as_handled(combo_index);
@@ -257,13 +266,14 @@ bool combo_update(void) {
         } else if (combos[combo_index].state == combo_state_active) {
             there_are_unresolved_combos = true;
 
-            combos[combo_index].time_since_first_press += MATRIX_SCAN_INTERVAL_MS;
-            if (combos[combo_index].time_since_first_press >= COMBO_DELAY_MS) {
+            combos[combo_index].time_since_first_press += elapsed_ms;
+            if (combos[combo_index].time_since_first_press >= combo_delay_ms) {
 
                 // When only a single key was pressed, we can emit the key immediately
                 int single_key_index = combo_get_single_pressed_index(combo_index);
                 if (single_key_index == -1) {
                     // There was more than one key pressed, go to the cooldown state
+                    recorder_log(RECORDER_COMBO_CANCELLED, combo_index, 0, 0);
                     combos[combo_index].state = combo_state_cooldown;
                     combos[combo_index].time_since_first_press = 0;
                     combo_mark_keys_as_handled(combo_index);
@@ -26,7 +26,7 @@ typedef enum combo_state_t {
 
 typedef struct combo_t {
     combo_state_t state;
-    uint8_t time_since_first_press;
+    uint16_t time_since_first_press;
     uint8_t keys_pressed_bitmask;
     keymap_entry_t keys[COMBO_KEYS_MAX];
     rowcol_t key_positions[COMBO_KEYS_MAX];
@@ -44,6 +44,7 @@ typedef struct combo_t {
 // public functions
 void combo_init(combo_t* combo_table);
 void combo_reset(void);
-bool combo_update(void);
+void combo_set_timings(uint16_t delay_ms, uint16_t cancel_suppress_ms);
+bool combo_update(uint16_t elapsed_ms);
 bool combo_on_key_press(uint row, uint col, keymap_entry_t key);
 bool combo_on_key_release(uint row, uint col, keymap_entry_t key);
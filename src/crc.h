@@ -0,0 +1,17 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+
+// defines
+#define CRC32_INITIAL_VALUE     (0)
+
+// public functions
+
+// Standard (zlib/IEEE 802.3) CRC-32. Pass CRC32_INITIAL_VALUE to start, or a previous result to continue
+uint32_t crc32_update(uint32_t crc, const void* data, uint32_t length);
@@ -7,7 +7,7 @@
 #pragma once
 
 #include "pico/types.h"
-#include "ll_alloc.h"
+#include "pool.h"
 #include "keyboard.h"
 
 // typedefs
@@ -18,23 +18,20 @@ typedef enum dt_state_t {
     dt_state_double_tap
 } dt_state_t;
 
-typedef struct double_tap_data_t {
-    uint8_t row;
-    uint8_t col;
-    uint8_t layer;
-    uint8_t time_since_first_tap;
-    dt_state_t state;
-} double_tap_data_t;
-
+// Active double taps, one pool slot each. The entry is captured at the first press
 typedef struct double_tap_state_t {
-    double_tap_data_t data_array[DOUBLE_TAP_MAX];
-    ll_node_t node_array[DOUBLE_TAP_MAX];
-    ll_allocator_t allocator;
+    pool_t pool;
+    uint8_t row[DOUBLE_TAP_MAX];
+    uint8_t col[DOUBLE_TAP_MAX];
+    keymap_entry_t key[DOUBLE_TAP_MAX];
+    uint16_t time_since_first_tap[DOUBLE_TAP_MAX];
+    dt_state_t state[DOUBLE_TAP_MAX];
 } double_tap_state_t;
 
 // public functions
 void double_tap_init(void);
 void double_tap_reset(void);
-bool double_tap_update(void);
+void double_tap_set_delay(uint16_t delay_ms);
+bool double_tap_update(uint16_t elapsed_ms);
 bool double_tap_on_key_release(uint row, uint col, keymap_entry_t key);
 bool double_tap_on_key_press(uint row, uint col, keymap_entry_t key);
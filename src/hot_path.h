@@ -0,0 +1,19 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+// Functions on the scan -> report pipeline and in the USB interrupt are defined with HOT_PATH_FUNC(name). With
+// KB_RAM_HOT_PATH they're linked into SRAM (the .time_critical sections copied at boot), so they never wait on an
+// XIP cache miss and keep running while flash is busy. Otherwise they stay in flash like everything else.
+#ifdef KB_RAM_HOT_PATH
+#include "pico.h"
+#define HOT_PATH_FUNC(name)         __not_in_flash_func(name)
+#define HOT_PATH_IN_RAM             (1)
+#else
+#define HOT_PATH_FUNC(name)         name
+#define HOT_PATH_IN_RAM             (0)
+#endif
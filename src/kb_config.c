@@ -1,4 +1,5 @@
 #include <hardware/flash.h>
+#include <hardware/sync.h>
 #include <pico/bootrom.h>
 
 #include "kb_config.h"
@@ -6,60 +7,83 @@
 #include "macro.h"
 #include "combo.h"
 #include "leds.h"
-
+#include "taphold.h"
+#include "doubletap.h"
+#include "kb_config_codec.h"
+#include "crc.h"
+#include "trace.h"
+#include "perf.h"
+#include "scan_timer.h"
+#include "recorder.h"
+#include "hot_path.h"
+
+#include <stddef.h>
 #include <string.h>
 
 // forward declarations
-static void kb_config_rx_complete(void);
+static void kb_config_rx_complete(const uint8_t* packet, uint16_t len);
 static void kb_config_tx_complete(void);
 
 // defines
-#define RING_BUFFER_SIZE            (1024)
-#define RING_BUFFER_MASK            (RING_BUFFER_SIZE - 1)
-
 #define PACKET_SIZE                 (64)
-#define PAYLOAD_SIZE                (64 - sizeof(kb_config_msg_header_t))
-#define ROUND_TO_PACKET_SIZE(n)     (((n) + PACKET_SIZE-1) & ~(PACKET_SIZE-1))
+#define PAYLOAD_SIZE                (PACKET_SIZE - sizeof(kb_config_msg_header_t))
+#define TX_SEGMENTS_PER_PACKET      (3)     // Header, data and CRC
 
 #define SECTORS_PER_PAGE            (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
-#define KB_CONFIG_FLASH_OFFSET      (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
-
-#define FLASH_KEYMAP_PTR            (void*)(flash_buffer + sizeof(kb_config_flash_header_t))
-#define FLASH_MACROS_PTR            (FLASH_KEYMAP_PTR + sizeof(keymap))
-#define FLASH_MACRO(index)          (&((kb_config_macro_t*)(FLASH_MACROS_PTR))[index])
+#define KB_CONFIG_FLASH_OFFSET(profile)     (PICO_FLASH_SIZE_BYTES - ((KB_CONFIG_PROFILE_MAX - (profile)) * FLASH_SECTOR_SIZE))
+#define KB_CONFIG_FLASH_IMAGE(profile)      ((const uint8_t*)&APP_DATA_START_ADDR + ((profile) * FLASH_SECTOR_SIZE))
 
-#define KEY_LAYER_PTR(layer)        (FLASH_KEYMAP_PTR + ((layer) * MATRIX_ROWS * MATRIX_COLS * sizeof(uint32_t)))
-#define KEY_ROW_PTR(layer, row)     (KEY_LAYER_PTR(layer) + ((row) * MATRIX_COLS * sizeof(uint32_t)))
-#define KEY_PTR(layer, row, col)    (uint32_t*)(KEY_ROW_PTR(layer, row) + ((col) * sizeof(uint32_t)))
-
-#define FLASH_COMBOS_START           (FLASH_MACROS_PTR + (MACRO_MAX * sizeof(kb_config_macro_t)))
-#define FLASH_COMBO(index)           (&((kb_config_combo_t*)FLASH_COMBOS_START)[((index))])
+#define KEY_INDEX_PTR(image, index)  (&((uint32_t*)(image)->keymap)[(index)])
 
 // typedefs
-typedef struct kb_config_ring_buffer_t {
-    uint8_t buffer[RING_BUFFER_SIZE];
-    uint16_t write_index;
-    uint16_t read_index;
-} kb_config_ring_buffer_t;
+// GET_PERF response: a perf_summary_t followed by a perf_stage_stats_t per stage
+typedef struct kb_config_perf_response_t {
+    perf_summary_t summary;
+    perf_stage_stats_t stages[PERF_STAGE_COUNT];
+} __packed kb_config_perf_response_t;
 
-typedef struct kb_config_rb_contiguous_read_result_t {
-    uint16_t length;
-    uint8_t* ptr;
-} kb_config_rb_contiguous_read_result_t;
+typedef struct kb_config_recorder_response_t {
+    kb_config_recorder_header_t header;
+    recorder_event_t events[KB_CONFIG_RECORDER_EVENTS_MAX];
+} kb_config_recorder_response_t;
 
 // statics
-static uint8_t tmp_rx_buffer[PACKET_SIZE] = {0};
-static uint8_t working_rx_buffer[PACKET_SIZE] = {0};
-static uint8_t tmp_tx_buffer[PACKET_SIZE] = {0};
-static uint8_t flash_buffer[FLASH_SECTOR_SIZE] = {0};
+// Requests that fit in one packet are handled where they were received. Only longer ones are reassembled here
+static uint8_t rx_request_buffer[KB_CONFIG_MAX_REQUEST_SIZE] = {0};
+
+// A tx window is described to USB as segments, which it copies straight into the endpoint buffers. Each packet's
+// header needs its own copy, as the packet number changes
+static kb_config_msg_header_t tx_window_headers[KB_CONFIG_TX_WINDOW_PACKETS] = {0};
+static usb_transfer_segment_t tx_window_segments[KB_CONFIG_TX_WINDOW_PACKETS * TX_SEGMENTS_PER_PACKET] = {0};
+static kb_config_image_t image_buffers[2] = {0};
+
+// The firmware's own macros and combos. macros[] and combos[] are pointed at the live image once a profile is applied,
+// so the defaults are captured from them once, at init, before that happens
+static kb_config_macro_t default_macros[MACRO_MAX] = {0};
+static kb_config_combo_t default_combos[COMBO_MAX] = {0};
+
+// Encoded images, for DUMP_CONFIG responses and for programming flash. These are separate so that saving
+// can't corrupt a dump that is still being transmitted.
+static uint8_t tx_encoded_buffer[FLASH_SECTOR_SIZE] = {0};
+static uint8_t flash_encoded_buffer[FLASH_SECTOR_SIZE] = {0};
+
+// The live image is what the keyboard is using. Edits from the host are staged into the shadow image (the
+// other buffer), which is seeded from the live image on the first edit. Publishing makes the shadow live
+// at a scan boundary.
+static const kb_config_image_t* live_image = &image_buffers[0];
+static kb_config_image_t* shadow_image = &image_buffers[1];
+static bool shadow_open = false;
+static uint8_t active_profile = 0;
+
+// Requests from the host that have to wait for the scan boundary (see kb_config_apply_pending)
+static volatile bool publish_pending = false;
+static volatile bool save_pending = false;
+static volatile bool erase_pending = false;
+static volatile int16_t profile_pending = -1;
+
+// The live image differs from what's in flash
 static bool has_uncommitted_state = false;
 
-static kb_config_ring_buffer_t ring_buffer = {
-    .buffer = {0},
-    .read_index = 0,
-    .write_index = 0
-};
-
 static kb_config_bulk_ptrs_t bulk_ptrs = {
     .rx_complete = kb_config_rx_complete,
     .tx_complete = kb_config_tx_complete,
@@ -68,7 +92,7 @@ static kb_config_bulk_ptrs_t bulk_ptrs = {
 };
 
 static const kb_config_get_info_t get_info = {
-    .protocol_version = 1,
+    .protocol_version = KB_CONFIG_CURRENT_PROTOCOL_VERSION,
     .column_count = MATRIX_COLS,
     .row_count = MATRIX_ROWS,
     .layer_count = LAYER_MAX,
@@ -76,7 +100,10 @@ static const kb_config_get_info_t get_info = {
     .macro_count = MACRO_MAX,
     .combo_count = COMBO_MAX,
     .macro_max_size = MACRO_SIZE_MAX,
-    .combo_max_size = COMBO_KEYS_MAX
+    .combo_max_size = COMBO_KEYS_MAX,
+    .max_request_size = KB_CONFIG_MAX_REQUEST_SIZE,
+    .tx_window = KB_CONFIG_TX_WINDOW_PACKETS,
+    .profile_count = KB_CONFIG_PROFILE_MAX
 };
 
 extern const keymap_entry_t keymap[LAYER_MAX][MATRIX_ROWS][MATRIX_COLS];
@@ -85,187 +112,315 @@ extern combo_t combos[COMBO_MAX];
 
 static const uint16_t layout_size = MATRIX_COLS * MATRIX_ROWS * sizeof(uint32_t);
 
+static kb_config_perf_response_t perf_response = {0};
+static scan_timing_stats_t scan_timing_response = {0};
+static kb_config_recorder_response_t recorder_response = {0};
+
 static kb_config_message_state_t message_state = {0};
+static kb_config_rx_state_t rx_state = {0};
 
 // symbols provided by linker
 extern uint32_t APP_DATA_START_ADDR;
 
 // private functions
-static void kb_config_load_from_flash(void) {
-    // Load the flash region and check if it's valid
-    kb_config_flash_header_t* flash_header = (kb_config_flash_header_t*)&APP_DATA_START_ADDR;
-    if (flash_header->sentinel == KB_CONFIG_SENTINEL_VALUE) {
-        void* app_data_start = (void*)&APP_DATA_START_ADDR;
-        memcpy(flash_buffer, app_data_start, sizeof(flash_buffer));
-
-        // Copy the macros to the main buffer
-        for (int i = 0; i < MACRO_MAX; i++) {
-            macros[i].type = FLASH_MACRO(i)->macro_type;
-            macros[i].send_string.length = FLASH_MACRO(i)->length;
-            macros[i].send_string.buffer = FLASH_MACRO(i)->string;
-        }
+static void kb_config_apply_image(const kb_config_image_t* image) {
+    // Copy the macros to the main buffer
+    for (int i = 0; i < MACRO_MAX; i++) {
+        macros[i].type = image->macros[i].macro_type;
+        macros[i].send_string.length = image->macros[i].length;
+        macros[i].send_string.buffer = image->macros[i].string;
+    }
 
-        // Copy the combos to the main buffer
-        for (int i = 0; i < COMBO_MAX; i++) {
-            combos[i].key_out = FLASH_COMBO(i)->key_out;
-            combos[i].state = combos[i].key_out == 0 ? combo_state_invalid : combo_state_inactive;
-            memcpy(combos[i].keys, FLASH_COMBO(i)->keys, sizeof(combos[i].keys));
-        }
-    } else {
-        // There is no valid structure in flash. Create on in RAM ready to be written if needed
-        *((kb_config_flash_header_t*)flash_buffer) = (kb_config_flash_header_t) {
-            .sentinel       = KB_CONFIG_SENTINEL_VALUE,
-            .format_version = KB_CONFIG_CURRENT_FORMAT_VERSION,
-            .write_count    = 0,
-            .column_count   = MATRIX_COLS,
-            .row_count      = MATRIX_ROWS,
-            .layer_count    = LAYER_MAX,
-            .led_count      = LEDS_MAX,
-            .macro_count    = MACRO_MAX,
-            .combo_count    = COMBO_MAX,
-            .macro_max_size = MACRO_SIZE_MAX,
-            .combo_max_size = COMBO_KEYS_MAX
-        };
+    // Copy the combos to the main buffer
+    for (int i = 0; i < COMBO_MAX; i++) {
+        combos[i].key_out = image->combos[i].key_out;
+        combos[i].state = combos[i].key_out == 0 ? combo_state_invalid : combo_state_inactive;
+        memcpy(combos[i].keys, image->combos[i].keys, sizeof(combos[i].keys));
+    }
 
-        // Copy the keymap to the buffer
-        memcpy(FLASH_KEYMAP_PTR, keymap, sizeof(keymap));
+    taphold_set_delay(image->timings.tap_hold_delay_ms);
+    double_tap_set_delay(image->timings.double_tap_delay_ms);
+    combo_set_timings(image->timings.combo_delay_ms, image->timings.combo_cancel_suppress_ms);
 
-        // Copy the macro definitions to the buffer
-        for (int i = 0; i < MACRO_MAX; i++) {
-            FLASH_MACRO(i)->macro_type = macros[i].type;
-            FLASH_MACRO(i)->length = macros[i].send_string.length;
-            memcpy(FLASH_MACRO(i)->string, macros[i].send_string.buffer, MACRO_SIZE_MAX);
-        }
+    keyboard_set_keymap_ptr((void*)image->keymap);
+}
+
+static void kb_config_build_default_image(kb_config_image_t* image) {
+    memset(image, 0, sizeof(kb_config_image_t));
+
+    image->header = (kb_config_flash_header_t) {
+        .sentinel       = KB_CONFIG_SENTINEL_VALUE,
+        .format_version = KB_CONFIG_CURRENT_FORMAT_VERSION,
+        .write_count    = 0,
+        .column_count   = MATRIX_COLS,
+        .row_count      = MATRIX_ROWS,
+        .layer_count    = LAYER_MAX,
+        .led_count      = LEDS_MAX,
+        .macro_count    = MACRO_MAX,
+        .combo_count    = COMBO_MAX,
+        .macro_max_size = MACRO_SIZE_MAX,
+        .combo_max_size = COMBO_KEYS_MAX
+    };
+
+    image->timings = (kb_config_timings_t) {
+        .tap_hold_delay_ms        = TAP_HOLD_DELAY_MS,
+        .double_tap_delay_ms      = DOUBLE_TAP_DELAY_MS,
+        .combo_delay_ms           = COMBO_DELAY_MS,
+        .combo_cancel_suppress_ms = COMBO_CANCEL_SUPPRESS_MS
+    };
+
+    // Copy the keymap to the buffer
+    memcpy(image->keymap, keymap, sizeof(keymap));
 
-        // Copy the combo definitions to the buffer
-        for (int i = 0; i < COMBO_MAX; i++) {
-            FLASH_COMBO(i)->key_out = combos[i].key_out;
-            memcpy(FLASH_COMBO(i)->keys, combos[i].keys, sizeof(combos[i].keys));
+    // Copy the firmware's macro and combo definitions to the buffer
+    memcpy(image->macros, default_macros, sizeof(default_macros));
+    memcpy(image->combos, default_combos, sizeof(default_combos));
+}
+
+// Only called from kb_config_init, while macros[] and combos[] still hold the firmware definitions
+static void kb_config_capture_defaults(void) {
+    for (int i = 0; i < MACRO_MAX; i++) {
+        default_macros[i].macro_type = macros[i].type;
+        if (macros[i].type == macro_type_send_string) {
+            default_macros[i].length = MIN(macros[i].send_string.length, MACRO_SIZE_MAX);
+            memcpy(default_macros[i].string, macros[i].send_string.buffer, default_macros[i].length);
         }
     }
 
-    // Either way, set the keymap to what's in RAM
-    keyboard_set_keymap_ptr(FLASH_KEYMAP_PTR);
+    for (int i = 0; i < COMBO_MAX; i++) {
+        default_combos[i].key_out = combos[i].key_out;
+        memcpy(default_combos[i].keys, combos[i].keys, sizeof(combos[i].keys));
+    }
 }
 
-static void kb_config_write_to_flash(void) {
+// Only called from kb_config_apply_pending, with interrupts disabled. Returns false if the encoded image doesn't fit.
+static bool kb_config_write_to_flash(void) {
+    kb_config_image_t* image = (kb_config_image_t*)live_image;
+
     // Increment the write counter
-    ((kb_config_flash_header_t*)flash_buffer)->write_count++;
+    image->header.write_count++;
+
+    // Unused space is left as erased flash
+    memset(flash_encoded_buffer, 0xff, sizeof(flash_encoded_buffer));
+    if (kb_config_codec_encode(image, flash_encoded_buffer, sizeof(flash_encoded_buffer)) == 0) {
+        image->header.write_count--;
+        return false;
+    }
 
     // Erase the current flash contents
-    flash_range_erase(KB_CONFIG_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_erase(KB_CONFIG_FLASH_OFFSET(active_profile), FLASH_SECTOR_SIZE);
 
-    // Program the flash buffer
-    flash_range_program(KB_CONFIG_FLASH_OFFSET, flash_buffer, FLASH_SECTOR_SIZE);
+    // Program the encoded image
+    flash_range_program(KB_CONFIG_FLASH_OFFSET(active_profile), flash_encoded_buffer, FLASH_SECTOR_SIZE);
+    return true;
 }
 
-static void kb_config_erase_from_flash(void) {
-    // Erase the current flash contents
-    flash_range_erase(KB_CONFIG_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+static kb_config_image_t* kb_config_other_buffer(const kb_config_image_t* image) {
+    return (image == &image_buffers[0]) ? &image_buffers[1] : &image_buffers[0];
+}
+
+// Returns the image that edits should be made to, seeding the shadow from the live image if this is the first edit
+static kb_config_image_t* kb_config_edit_image(void) {
+    if (!shadow_open) {
+        memcpy(shadow_image, live_image, sizeof(kb_config_image_t));
+        shadow_open = true;
+    }
+    return shadow_image;
+}
+
+// Reads from the host see their own staged edits
+static const kb_config_image_t* kb_config_view_image(void) {
+    return shadow_open ? shadow_image : live_image;
+}
+
+// Only called from kb_config_apply_pending, with interrupts disabled
+static void kb_config_publish(void) {
+    live_image = shadow_image;
+    shadow_image = kb_config_other_buffer(live_image);
+    shadow_open = false;
+
+    // Running macros could index past the end of a replaced string
+    macro_reset();
+    kb_config_apply_image(live_image);
+}
+
+// Makes a profile live by decoding its flash sector into the shadow image and publishing it
+static void kb_config_activate_profile(uint8_t profile) {
+    active_profile = profile;
+    shadow_open = false;
+    has_uncommitted_state = false;
 
-    // Setup a new flash structure in memory
-    kb_config_load_from_flash();
+    bool from_flash = kb_config_codec_decode(KB_CONFIG_FLASH_IMAGE(profile), FLASH_SECTOR_SIZE, shadow_image);
+    if (!from_flash) {
+        // There is no valid structure in flash. Create one in RAM ready to be written if needed
+        kb_config_build_default_image(shadow_image);
+    }
+    trace2(TRACE_KB_CONFIG_PROFILE_ACTIVATED, profile, from_flash);
+
+    kb_config_publish();
 }
 
-static void kb_config_transmit_message(void) {
-    // Prepare the transmission
-    uint16_t bytes_to_send = MIN((message_state.header.payload_length - message_state.data_bytes_written), PAYLOAD_SIZE);
-    memcpy(tmp_tx_buffer, &message_state.header, sizeof(kb_config_msg_header_t));
-    memcpy(tmp_tx_buffer + sizeof(kb_config_msg_header_t), message_state.data_buffer, bytes_to_send);
+static void HOT_PATH_FUNC(kb_config_queue_rx)(void) {
+    bulk_ptrs.rx();
+}
 
-    message_state.data_bytes_written += bytes_to_send;
-    message_state.data_buffer += bytes_to_send;
-    ++message_state.header.packet_number;
+// Copies a fixed size request struct out of the reassembled payload. A request may leave off an unused tail (e.g. the
+// rest of a macro string) but must carry at least min_size bytes, otherwise it's rejected. The missing tail is zeroed.
+static bool kb_config_read_request(void* dst, uint16_t dst_size, uint16_t min_size, const uint8_t* payload, uint16_t length) {
+    if (length < min_size) return false;
+
+    uint16_t bytes_to_copy = MIN(dst_size, length);
+    memcpy(dst, payload, bytes_to_copy);
+    memset((uint8_t*)dst + bytes_to_copy, 0, dst_size - bytes_to_copy);
+    return true;
+}
+
+static void HOT_PATH_FUNC(kb_config_add_segment)(uint8_t* count, const uint8_t* data, uint16_t length) {
+    if (length > 0) {
+        tx_window_segments[(*count)++] = (usb_transfer_segment_t) { .data = data, .length = length };
+    }
+}
+
+static void HOT_PATH_FUNC(kb_config_transmit_message)(void) {
+    // Describe as many packets of the tx window as the remaining payload needs: a header, then the slice of the
+    // logical payload (data followed by the optional CRC) it carries. Every packet is full sized except the final
+    // one of the message, which is trimmed so the host sees a short packet.
+    uint8_t packets = 0;
+    uint8_t segments = 0;
+
+    do {
+        uint16_t offset = message_state.payload_bytes_written;
+        uint16_t bytes_to_send = MIN((message_state.header.payload_length - offset), PAYLOAD_SIZE);
+
+        tx_window_headers[packets] = message_state.header;
+        kb_config_add_segment(&segments, (const uint8_t*)&tx_window_headers[packets], sizeof(kb_config_msg_header_t));
+
+        uint16_t data_bytes = (offset < message_state.data_length) ? MIN(bytes_to_send, message_state.data_length - offset) : 0;
+        kb_config_add_segment(&segments, &message_state.data_buffer[offset], data_bytes);
+        if (data_bytes < bytes_to_send) {
+            const uint8_t* crc_bytes = (const uint8_t*)&message_state.crc;
+            kb_config_add_segment(&segments, &crc_bytes[offset + data_bytes - message_state.data_length], bytes_to_send - data_bytes);
+        }
+
+        message_state.payload_bytes_written += bytes_to_send;
+        ++message_state.header.packet_number;
+        ++packets;
+    } while (packets < KB_CONFIG_TX_WINDOW_PACKETS && message_state.payload_bytes_written < message_state.header.payload_length);
 
     message_state.transmitting = true;
-    bulk_ptrs.tx(tmp_tx_buffer, PACKET_SIZE);
+    bulk_ptrs.tx(tx_window_segments, segments);
+}
+
+// Validates a whole SET_KEYS request before anything is written, so a batch is either applied completely or not at all
+static bool kb_config_set_keys(const uint8_t* payload, uint16_t length) {
+    kb_config_keys_header_t keys_header;
+    if (length < sizeof(keys_header)) return false;
+    memcpy(&keys_header, payload, sizeof(keys_header));
+
+    const uint8_t* body = payload + sizeof(keys_header);
+    uint16_t body_length = length - sizeof(keys_header);
+
+    if (keys_header.mode == KB_CONFIG_KEYS_MODE_RANGE) {
+        if (body_length != keys_header.count * sizeof(uint32_t)) return false;
+        if ((uint32_t)keys_header.start + keys_header.count > KB_CONFIG_KEY_COUNT) return false;
+
+        memcpy(KEY_INDEX_PTR(kb_config_edit_image(), keys_header.start), body, body_length);
+    } else if (keys_header.mode == KB_CONFIG_KEYS_MODE_LIST) {
+        if (body_length != keys_header.count * sizeof(kb_config_key_entry_t)) return false;
+
+        const kb_config_key_entry_t* entries = (const kb_config_key_entry_t*)body;
+        for (uint16_t i = 0; i < keys_header.count; i++) {
+            if (entries[i].index >= KB_CONFIG_KEY_COUNT) return false;
+        }
+
+        kb_config_image_t* image = kb_config_edit_image();
+        for (uint16_t i = 0; i < keys_header.count; i++) {
+            *KEY_INDEX_PTR(image, entries[i].index) = entries[i].value;
+        }
+    } else {
+        return false;
+    }
+
+    return true;
 }
 
-static kb_config_rb_contiguous_read_result_t kb_config_drain_ring_buffer(void) {
-    uint16_t read_index = ring_buffer.read_index;
-    uint16_t write_index = ring_buffer.write_index;
-    uint16_t length = (write_index - read_index) & RING_BUFFER_MASK;
-    uint16_t new_read_index = (read_index + length) & RING_BUFFER_MASK;
+static void kb_config_send_response(uint8_t request_type, const uint8_t* data, uint16_t length) {
+    // Responses are protected by a CRC when the request was
+    bool with_crc = (request_type & KB_CONFIG_MSG_TYPE_CRC_MASK) != 0;
 
-    kb_config_rb_contiguous_read_result_t result = {
-        .length = length,
-        .ptr = &ring_buffer.buffer[read_index]
+    message_state.header = (kb_config_msg_header_t) {
+        .packet_number = 0,
+        .payload_length = length + (with_crc ? sizeof(uint32_t) : 0),
+        .type = (request_type & (KB_CONFIG_MSG_TYPE_VALUE_MASK | KB_CONFIG_MSG_TYPE_CRC_MASK)) | KB_CONFIG_MSG_TYPE_RES
     };
-    ring_buffer.read_index = new_read_index;
+    message_state.payload_bytes_written = 0;
+    message_state.data_length = length;
+    message_state.data_buffer = data;
+    message_state.crc = with_crc ? crc32_update(CRC32_INITIAL_VALUE, data, length) : 0;
 
-    return result;
+    kb_config_transmit_message();
 }
 
-static void kb_config_update(void) {
+static void HOT_PATH_FUNC(kb_config_update)(void) {
     if (message_state.transmitting) {
-        if (message_state.data_bytes_written == message_state.header.payload_length) {
+        if (message_state.payload_bytes_written == message_state.header.payload_length) {
             message_state.transmitting = false;
-            bulk_ptrs.rx(tmp_rx_buffer, PACKET_SIZE);
+            kb_config_queue_rx();
         } else {
             kb_config_transmit_message();
         }
     }
 }
 
-static void kb_config_rx_complete(void) {
-    memcpy(working_rx_buffer, tmp_rx_buffer, PACKET_SIZE);
-
-    uint8_t msg_type = working_rx_buffer[0] & KB_CONFIG_MSG_TYPE_VALUE_MASK;
+// Handles a fully reassembled request. Returns true if a response is being transmitted, in which
+// case the next rx is queued once the response has been sent.
+static bool kb_config_handle_request(uint8_t request_type, const uint8_t* payload, uint16_t length) {
+    uint8_t msg_type = request_type & KB_CONFIG_MSG_TYPE_VALUE_MASK;
     switch (msg_type) {
         case KB_CONFIG_MSG_GET_INFO: {
-            message_state.header = (kb_config_msg_header_t) {
-                .packet_number = 0,
-                .payload_length = sizeof(get_info),
-                .type = KB_CONFIG_MSG_GET_INFO | KB_CONFIG_MSG_TYPE_RES
-            };
-            message_state.data_bytes_written = 0;
-            message_state.data_buffer = (const uint8_t*)&get_info;
-
-            kb_config_transmit_message();
-            return;
+            kb_config_send_response(request_type, (const uint8_t*)&get_info, sizeof(get_info));
+            return true;
         } break;
 
         case KB_CONFIG_MSG_GET_LAYOUT: {
-            const uint8_t layer_index = tmp_rx_buffer[sizeof(kb_config_msg_header_t)];
-            if (layer_index >= LAYER_MAX) break;
+            if (length < 1) break;
 
-            message_state.header = (kb_config_msg_header_t) {
-                .packet_number = 0,
-                .payload_length = layout_size,
-                .type = KB_CONFIG_MSG_GET_LAYOUT | KB_CONFIG_MSG_TYPE_RES
-            };
-            message_state.data_bytes_written = 0;
-            message_state.data_buffer = (const uint8_t*)KEY_LAYER_PTR(layer_index);
+            const uint8_t layer_index = payload[0];
+            if (layer_index >= LAYER_MAX) break;
 
-            kb_config_transmit_message();
-            return;
+            kb_config_send_response(request_type, (const uint8_t*)kb_config_view_image()->keymap[layer_index], layout_size);
+            return true;
         } break;
 
         case KB_CONFIG_MSG_SET_KEY: {
-            const kb_config_set_key_t* set_key_msg = (const kb_config_set_key_t*)&tmp_rx_buffer[sizeof(kb_config_msg_header_t)];
+            kb_config_set_key_t set_key_msg;
+            if (!kb_config_read_request(&set_key_msg, sizeof(set_key_msg), sizeof(set_key_msg), payload, length)) break;
 
-            if (set_key_msg->row >= MATRIX_ROWS || set_key_msg->col >= MATRIX_COLS || set_key_msg->layer >= LAYER_MAX) break;
+            if (set_key_msg.row >= MATRIX_ROWS || set_key_msg.col >= MATRIX_COLS || set_key_msg.layer >= LAYER_MAX) break;
 
-            uint32_t* key_ptr = KEY_PTR(set_key_msg->layer, set_key_msg->row, set_key_msg->col);
-            *key_ptr = set_key_msg->value;
-
-            has_uncommitted_state = true;
+            kb_config_edit_image()->keymap[set_key_msg.layer][set_key_msg.row][set_key_msg.col] = set_key_msg.value;
         } break;
 
         case KB_CONFIG_MSG_COMMIT: {
-            const kb_config_commit_t* commit_msg = (const kb_config_commit_t*)&tmp_rx_buffer[sizeof(kb_config_msg_header_t)];
-
-            if (commit_msg->commit_value != KB_CONFIG_COMMIT_VALUE) break;
-
-            if (commit_msg->operation == KB_CONFIG_COMMIT_OP_CANCEL) {
-                // Restore the unmodified config
-                kb_config_load_from_flash();
-            } else if (commit_msg->operation == KB_CONFIG_COMMIT_OP_SAVE && has_uncommitted_state) {
-                // Store the new, uncommitted config
-                kb_config_write_to_flash();
-            } else if (commit_msg->operation == KB_CONFIG_COMMIT_OP_ERASE) {
+            kb_config_commit_t commit_msg;
+            if (!kb_config_read_request(&commit_msg, sizeof(commit_msg), sizeof(commit_msg), payload, length)) break;
+
+            if (commit_msg.commit_value != KB_CONFIG_COMMIT_VALUE) break;
+
+            if (commit_msg.operation == KB_CONFIG_COMMIT_OP_CANCEL) {
+                // Throw away the staged edits. The live config is untouched
+                publish_pending = false;
+                shadow_open = false;
+            } else if (commit_msg.operation == KB_CONFIG_COMMIT_OP_APPLY) {
+                // Make the staged edits live
+                publish_pending = shadow_open;
+            } else if (commit_msg.operation == KB_CONFIG_COMMIT_OP_SAVE) {
+                // Make any staged edits live, and store the result
+                publish_pending = shadow_open;
+                save_pending = true;
+            } else if (commit_msg.operation == KB_CONFIG_COMMIT_OP_ERASE) {
                 // Erase the current config, and return to the original firmware configuration
-                kb_config_erase_from_flash();
+                erase_pending = true;
             }
         } break;
 
@@ -274,117 +429,308 @@ static void kb_config_rx_complete(void) {
         } break;
 
         case KB_CONFIG_MSG_GET_MACRO: {
-            const uint8_t macro_index = tmp_rx_buffer[sizeof(kb_config_msg_header_t)];
+            if (length < 1) break;
+
+            const uint8_t macro_index = payload[0];
             if (macro_index >= MACRO_MAX) break;
 
-            message_state.header = (kb_config_msg_header_t) {
-                .packet_number = 0,
-                .payload_length = sizeof(kb_config_macro_t),
-                .type = KB_CONFIG_MSG_GET_MACRO | KB_CONFIG_MSG_TYPE_RES
-            };
+            kb_config_send_response(request_type, (const uint8_t*)&kb_config_view_image()->macros[macro_index], sizeof(kb_config_macro_t));
+            return true;
+        } break;
 
-            message_state.data_bytes_written = 0;
-            message_state.data_buffer = (const uint8_t*)FLASH_MACRO(macro_index);
+        case KB_CONFIG_MSG_SET_MACRO: {
+            kb_config_set_macro_t set_macro;
+            const uint16_t string_offset = offsetof(kb_config_set_macro_t, macro.string);
+            if (!kb_config_read_request(&set_macro, sizeof(set_macro), string_offset, payload, length)) break;
+            if (set_macro.index >= MACRO_MAX || set_macro.macro.length > MACRO_SIZE_MAX) break;
+            if (length < string_offset + set_macro.macro.length) break;
 
-            kb_config_transmit_message();
-            return;
+            kb_config_edit_image()->macros[set_macro.index] = set_macro.macro;
         } break;
 
-        case KB_CONFIG_MSG_SET_MACRO: {
-            kb_config_set_macro_t* set_macro = (kb_config_set_macro_t*)&tmp_rx_buffer[sizeof(kb_config_msg_header_t)];
-            if (set_macro->index >= MACRO_MAX) break;
+        case KB_CONFIG_MSG_DUMP_CONFIG: {
+            uint16_t encoded_length = kb_config_codec_encode(kb_config_view_image(), tx_encoded_buffer, sizeof(tx_encoded_buffer));
+
+            // An empty response means the config is too large to be saved
+            kb_config_send_response(request_type, tx_encoded_buffer, encoded_length);
+            return true;
+        } break;
 
-            *FLASH_MACRO(set_macro->index) = set_macro->macro;
+        case KB_CONFIG_MSG_SET_COMBO: {
+            kb_config_set_combo_t set_combo;
+            if (!kb_config_read_request(&set_combo, sizeof(set_combo), sizeof(set_combo), payload, length)) break;
+            if (set_combo.index >= COMBO_MAX) break;
 
-            macros[set_macro->index].type = set_macro->macro.macro_type;
-            macros[set_macro->index].send_string.length = set_macro->macro.length;
-            macros[set_macro->index].send_string.buffer = FLASH_MACRO(set_macro->index)->string;
+            kb_config_edit_image()->combos[set_combo.index] = set_combo.combo;
         } break;
 
-        case KB_CONFIG_MSG_DUMP_CONFIG: {
-            message_state.header = (kb_config_msg_header_t) {
-                .packet_number = 0,
-                .payload_length = FLASH_SECTOR_SIZE,
-                .type = KB_CONFIG_MSG_DUMP_CONFIG | KB_CONFIG_MSG_TYPE_RES
+        case KB_CONFIG_MSG_GET_TRACE_FORMATS: {
+            uint16_t formats_length;
+            const char* formats = trace_get_formats(&formats_length);
+
+            kb_config_send_response(request_type, (const uint8_t*)formats, formats_length);
+            return true;
+        } break;
+
+        case KB_CONFIG_MSG_SET_KEYS: {
+            kb_config_set_keys(payload, length);
+        } break;
+
+        case KB_CONFIG_MSG_GET_KEYS: {
+            kb_config_keys_header_t keys_header;
+            if (!kb_config_read_request(&keys_header, sizeof(keys_header), sizeof(keys_header), payload, length)) break;
+
+            if (keys_header.mode != KB_CONFIG_KEYS_MODE_RANGE) break;
+            if ((uint32_t)keys_header.start + keys_header.count > KB_CONFIG_KEY_COUNT) break;
+
+            kb_config_send_response(request_type, (const uint8_t*)KEY_INDEX_PTR(kb_config_view_image(), keys_header.start), keys_header.count * sizeof(uint32_t));
+            return true;
+        } break;
+
+        case KB_CONFIG_MSG_SET_PROFILE: {
+            if (length < 1) break;
+            kb_config_select_profile(payload[0]);
+        } break;
+
+        case KB_CONFIG_MSG_GET_PROFILE: {
+            static kb_config_profile_t profile_info;
+            profile_info = (kb_config_profile_t) {
+                .active_profile = active_profile,
+                .profile_count = KB_CONFIG_PROFILE_MAX
             };
-            message_state.data_bytes_written = 0;
-            message_state.data_buffer = (const uint8_t*)flash_buffer;
 
-            kb_config_transmit_message();
-            return;
+            kb_config_send_response(request_type, (const uint8_t*)&profile_info, sizeof(profile_info));
+            return true;
         } break;
 
-        case KB_CONFIG_MSG_SET_COMBO: {
-            kb_config_set_combo_t* set_combo = (kb_config_set_combo_t*)&tmp_rx_buffer[sizeof(kb_config_msg_header_t)];
-            if (set_combo->index >= COMBO_MAX) break;
+        case KB_CONFIG_MSG_SET_TIMINGS: {
+            if (length < sizeof(kb_config_timings_t)) break;
+            memcpy(&kb_config_edit_image()->timings, payload, sizeof(kb_config_timings_t));
+        } break;
+
+        case KB_CONFIG_MSG_GET_TIMINGS: {
+            kb_config_send_response(request_type, (const uint8_t*)&kb_config_view_image()->timings, sizeof(kb_config_timings_t));
+            return true;
+        } break;
+
+        case KB_CONFIG_MSG_SET_TRACE_OPTIONS: {
+            uint32_t options;
+            if (!kb_config_read_request(&options, sizeof(options), sizeof(options), payload, length)) break;
+            trace_set_options(options);
+        } break;
 
-            *FLASH_COMBO(set_combo->index) = set_combo->combo;
+        case KB_CONFIG_MSG_GET_PERF: {
+            perf_get_stats(&perf_response.summary, perf_response.stages);
+            kb_config_send_response(request_type, (const uint8_t*)&perf_response, sizeof(perf_response));
+            return true;
+        } break;
 
-            combos[set_combo->index].key_out = FLASH_COMBO(set_combo->index)->key_out;
-            combos[set_combo->index].state = combo_state_inactive;
-            memcpy(combos[set_combo->index].keys, FLASH_COMBO(set_combo->index)->keys, sizeof(combos[set_combo->index].keys));
+        case KB_CONFIG_MSG_RESET_PERF: {
+            perf_reset();
+            scan_timer_reset_stats();
         } break;
 
-        case KB_CONFIG_MSG_GET_RING_BUFFER_DATA: {
-            kb_config_rb_contiguous_read_result_t read_result = kb_config_drain_ring_buffer();
+        case KB_CONFIG_MSG_GET_SCAN_TIMING: {
+            scan_timer_get_stats(&scan_timing_response);
+            kb_config_send_response(request_type, (const uint8_t*)&scan_timing_response, sizeof(scan_timing_response));
+            return true;
+        } break;
+
+        case KB_CONFIG_MSG_RECORDER_CONTROL: {
+            if (length < 1) break;
+            switch (payload[0]) {
+                case KB_CONFIG_RECORDER_OP_FREEZE: recorder_freeze(RECORDER_FREEZE_HOST); break;
+                case KB_CONFIG_RECORDER_OP_RESUME: recorder_resume(); break;
+            }
+        } break;
 
-            // It's possible and valid for there to be no bytes to send, but we need to send a response anyway
-            message_state.header = (kb_config_msg_header_t) {
-                .packet_number = 0,
-                .payload_length = read_result.length,
-                .type = KB_CONFIG_MSG_GET_RING_BUFFER_DATA | KB_CONFIG_MSG_TYPE_RES
+        case KB_CONFIG_MSG_GET_RECORDER: {
+            // The recording keeps moving unless it's frozen, so the host freezes it before downloading
+            kb_config_get_recorder_t get_recorder;
+            if (!kb_config_read_request(&get_recorder, sizeof(get_recorder), sizeof(get_recorder), payload, length)) break;
+
+            const uint16_t returned = recorder_read(
+                recorder_response.events,
+                get_recorder.start,
+                MIN(get_recorder.count, KB_CONFIG_RECORDER_EVENTS_MAX)
+            );
+            recorder_response.header = (kb_config_recorder_header_t) {
+                .event_count = recorder_get_event_count(),
+                .returned_count = returned,
+                .frozen = recorder_state.frozen,
+                .event_size = sizeof(recorder_event_t),
             };
-            message_state.data_bytes_written = 0;
-            message_state.data_buffer = (const uint8_t*)read_result.ptr;
 
-            kb_config_transmit_message();
+            const uint16_t response_length = sizeof(kb_config_recorder_header_t) + (returned * sizeof(recorder_event_t));
+            kb_config_send_response(request_type, (const uint8_t*)&recorder_response, response_length);
+            return true;
+        } break;
+
+        case KB_CONFIG_MSG_LOAD_CONFIG: {
+            // A complete encoded config image, as produced by DUMP_CONFIG. It's staged like any other edit.
+            if (length > FLASH_SECTOR_SIZE) break;
+            if (!kb_config_codec_decode(payload, length, NULL)) break;
+
+            kb_config_image_t* image = kb_config_edit_image();
+            uint32_t write_count = image->header.write_count;
+            kb_config_codec_decode(payload, length, image);
+            image->header.write_count = write_count;
+        } break;
+    }
+
+    return false;
+}
+
+// packet is the endpoint's own buffer, and is only valid until this returns
+static void HOT_PATH_FUNC(kb_config_rx_complete)(const uint8_t* packet, uint16_t len) {
+    if (len < sizeof(kb_config_msg_header_t)) {
+        kb_config_queue_rx();
+        return;
+    }
+
+    const kb_config_msg_header_t* header = (const kb_config_msg_header_t*)packet;
+    const uint8_t* packet_payload = packet + sizeof(kb_config_msg_header_t);
+
+    if (header->packet_number == 0) {
+        // The start of a request always restarts reassembly, discarding any partially received request
+        rx_state = (kb_config_rx_state_t) {
+            .in_progress = header->payload_length <= sizeof(rx_request_buffer),
+            .header = *header,
+            .next_packet_number = 1,
+            .bytes_received = 0
+        };
+    } else if (rx_state.in_progress && header->packet_number == rx_state.next_packet_number && header->type == rx_state.header.type) {
+        ++rx_state.next_packet_number;
+    } else {
+        // Out of sequence packet. Drop the whole request, and wait for the host to restart it
+        rx_state.in_progress = false;
+    }
+
+    if (!rx_state.in_progress) {
+        kb_config_queue_rx();
+        return;
+    }
+
+    // The header's payload_length says how much this packet should carry. If less than that actually arrived, the
+    // rest of the buffer is stale, so the whole request is dropped
+    uint16_t bytes_in_packet = MIN((rx_state.header.payload_length - rx_state.bytes_received), PAYLOAD_SIZE);
+    if (bytes_in_packet > (len - sizeof(kb_config_msg_header_t))) {
+        rx_state.in_progress = false;
+        kb_config_queue_rx();
+        return;
+    }
+
+    const uint8_t* payload = packet_payload;
+
+    // A request that fits in one packet is parsed where it is. Anything longer is reassembled first
+    if (rx_state.header.payload_length > PAYLOAD_SIZE) {
+        memcpy(&rx_request_buffer[rx_state.bytes_received], packet_payload, bytes_in_packet);
+        payload = rx_request_buffer;
+    }
+    rx_state.bytes_received += bytes_in_packet;
+
+    // More packets to come
+    if (rx_state.bytes_received < rx_state.header.payload_length) {
+        kb_config_queue_rx();
+        return;
+    }
+
+    rx_state.in_progress = false;
+
+    uint8_t request_type = rx_state.header.type;
+    uint16_t length = rx_state.header.payload_length;
+
+    if (request_type & KB_CONFIG_MSG_TYPE_CRC_MASK) {
+        // The CRC covers the payload only, and is transmitted little-endian after it
+        if (length < sizeof(uint32_t)) {
+            kb_config_queue_rx();
+            return;
+        }
+
+        length -= sizeof(uint32_t);
+
+        uint32_t expected_crc;
+        memcpy(&expected_crc, &payload[length], sizeof(expected_crc));
+        if (crc32_update(CRC32_INITIAL_VALUE, payload, length) != expected_crc) {
+            trace1(TRACE_KB_CONFIG_CRC_MISMATCH, request_type);
+            kb_config_queue_rx();
             return;
         }
     }
 
-    // If we get here, no messages we're processed, or there's more data to come. Queue the next rx
-    bulk_ptrs.rx(tmp_rx_buffer, PACKET_SIZE);
+    // Handling the request stays in flash: it runs once per request rather than per packet, and saving or loading a
+    // profile has to stop flash reads anyway
+    if (!kb_config_handle_request(request_type, payload, length)) {
+        // No response to send, so queue the next rx straight away
+        kb_config_queue_rx();
+    }
 }
 
-static void kb_config_tx_complete(void) {
+static void HOT_PATH_FUNC(kb_config_tx_complete)(void) {
     kb_config_update();
 }
 
 // public functions
 void kb_config_init(void) {
-    kb_config_load_from_flash();
+    kb_config_capture_defaults();
+    kb_config_activate_profile(0);
 
     // Queue the reception of a packet
-    bulk_ptrs.rx(tmp_rx_buffer, PACKET_SIZE);
+    kb_config_queue_rx();
 }
 
 void kb_config_reset(void) {
 
 }
 
-kb_config_bulk_ptrs_t* kb_config_get_bulk_ptrs(void) {
-    return &bulk_ptrs;
+void kb_config_select_profile(uint8_t profile) {
+    if (profile < KB_CONFIG_PROFILE_MAX) {
+        profile_pending = profile;
+    }
 }
 
-void kb_config_log_to_ring_buffer(void* data, uint16_t length) {
-    // This ring buffer doesn't try to protect against overwriting old data. If the user is logging, they
-    // are expected to pull data fast enough, and the keyboard is expected to not over-produce data.
+void kb_config_next_profile(void) {
+    kb_config_select_profile((active_profile + 1) % KB_CONFIG_PROFILE_MAX);
+}
 
-    // Truncate messages that are too long. This will result in data loss from the end of messages.
-    if (length > RING_BUFFER_SIZE) {
-        length = RING_BUFFER_SIZE;
+// Called from the main loop between scans, so the keymap never changes underneath a scan in progress
+void HOT_PATH_FUNC(kb_config_apply_pending)(void) {
+    if (!publish_pending && !save_pending && !erase_pending && profile_pending < 0) return;
+
+    uint32_t interrupt_state = save_and_disable_interrupts();
+
+    if (profile_pending >= 0) {
+        // Switching profile discards anything staged or unsaved in the current one
+        kb_config_activate_profile(profile_pending);
+    } else if (erase_pending) {
+        // Erase the current flash contents, and publish the original firmware configuration
+        flash_range_erase(KB_CONFIG_FLASH_OFFSET(active_profile), FLASH_SECTOR_SIZE);
+        kb_config_build_default_image(shadow_image);
+        kb_config_publish();
+        has_uncommitted_state = false;
+    } else {
+        if (publish_pending && shadow_open) {
+            kb_config_publish();
+            has_uncommitted_state = true;
+        }
+
+        if (save_pending && has_uncommitted_state) {
+            if (kb_config_write_to_flash()) {
+                has_uncommitted_state = false;
+            } else {
+                trace0(TRACE_KB_CONFIG_SAVE_TOO_LARGE);
+            }
+        }
     }
 
-    uint16_t write_index = ring_buffer.write_index;
-    uint16_t new_write_index = (write_index + length) & RING_BUFFER_MASK;
+    publish_pending = false;
+    save_pending = false;
+    erase_pending = false;
+    profile_pending = -1;
 
-    if (new_write_index > write_index) {
-        memcpy(&ring_buffer.buffer[write_index], data, length);
-    } else {
-        uint16_t first_copy_len = RING_BUFFER_SIZE - write_index;
-        memcpy(&ring_buffer.buffer[write_index], data, first_copy_len);
-        memcpy(&ring_buffer.buffer[0], &((uint8_t*)data)[first_copy_len], length - first_copy_len);
-    }
+    restore_interrupts(interrupt_state);
+}
 
-    ring_buffer.write_index = new_write_index;
-}
\ No newline at end of file
+kb_config_bulk_ptrs_t* kb_config_get_bulk_ptrs(void) {
+    return &bulk_ptrs;
+}
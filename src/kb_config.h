@@ -8,14 +8,16 @@
 
 #include "pico/types.h"
 #include "keyboard.h"
+#include "usb_transfer.h"
 
 // defines
-#define KB_CONFIG_CURRENT_PROTOCOL_VERSION  (1)
-#define KB_CONFIG_CURRENT_FORMAT_VERSION    (1)
+#define KB_CONFIG_CURRENT_PROTOCOL_VERSION  (3)
+#define KB_CONFIG_CURRENT_FORMAT_VERSION    (3)
 
 #define KB_CONFIG_MSG_TYPE_VALUE_MASK       (0x1f)
 #define KB_CONFIG_MSG_TYPE_REQ_RES_MASK     (0x80)
 #define KB_CONFIG_MSG_TYPE_ACK_MASK         (0x40)
+#define KB_CONFIG_MSG_TYPE_CRC_MASK         (0x20) // Payload is followed by a CRC-32 of the payload (counted in payload_length)
 
 #define KB_CONFIG_MSG_TYPE_REQ              (0x00)
 #define KB_CONFIG_MSG_TYPE_RES              (0x80)
@@ -30,24 +32,67 @@
 #define KB_CONFIG_MSG_DUMP_CONFIG           (0x08)
 #define KB_CONFIG_MSG_GET_COMBO             (0x09)
 #define KB_CONFIG_MSG_SET_COMBO             (0x0A)
-#define KB_CONFIG_MSG_GET_RING_BUFFER_DATA  (0x0B)
+// 0x0B is unused: trace data is streamed on its own endpoint (see trace.h)
+#define KB_CONFIG_MSG_LOAD_CONFIG           (0x0C)
+#define KB_CONFIG_MSG_SET_KEYS              (0x0D)
+#define KB_CONFIG_MSG_GET_KEYS              (0x0E)
+#define KB_CONFIG_MSG_SET_PROFILE           (0x0F)
+#define KB_CONFIG_MSG_GET_PROFILE           (0x10)
+#define KB_CONFIG_MSG_SET_TIMINGS           (0x11)
+#define KB_CONFIG_MSG_GET_TIMINGS           (0x12)
+#define KB_CONFIG_MSG_GET_TRACE_FORMATS     (0x13)
+#define KB_CONFIG_MSG_GET_PERF              (0x14)
+#define KB_CONFIG_MSG_RESET_PERF            (0x15) // Also resets the scan timing statistics
+#define KB_CONFIG_MSG_GET_SCAN_TIMING       (0x16)
+#define KB_CONFIG_MSG_RECORDER_CONTROL      (0x17)
+#define KB_CONFIG_MSG_GET_RECORDER          (0x18)
+#define KB_CONFIG_MSG_SET_TRACE_OPTIONS     (0x19) // uint32_t of TRACE_OPTION_* flags
 
 #define KB_CONFIG_SENTINEL_VALUE            (0x4b454542) // "KEEB"
 #define KB_CONFIG_COMMIT_VALUE              (0x434f4f4c) // "COOL"
 #define KB_CONFIG_COMMIT_OP_CANCEL          (0)
 #define KB_CONFIG_COMMIT_OP_SAVE            (1)
 #define KB_CONFIG_COMMIT_OP_ERASE           (2)
+#define KB_CONFIG_COMMIT_OP_APPLY           (3) // Make staged edits live at the next scan boundary, without saving
+
+#define KB_CONFIG_RECORDER_OP_FREEZE        (0)
+#define KB_CONFIG_RECORDER_OP_RESUME        (1) // Clears the recording and starts again
+
+// Most flight recorder events returned by a single GET_RECORDER response
+#define KB_CONFIG_RECORDER_EVENTS_MAX       (256)
+
+// Each profile is a complete config image in its own flash sector, at the top of flash. The build sets this (see
+// CMakeLists.txt), so linkerscript.ld reserves the same number of sectors
+#ifndef KB_CONFIG_PROFILE_MAX
+#define KB_CONFIG_PROFILE_MAX               (4)
+#endif
+
+// SET_KEYS / GET_KEYS address keys by a flat index: (layer * MATRIX_ROWS * MATRIX_COLS) + (row * MATRIX_COLS) + col
+#define KB_CONFIG_KEY_COUNT                 (LAYER_MAX * MATRIX_ROWS * MATRIX_COLS)
+#define KB_CONFIG_KEYS_MODE_RANGE           (0) // count values follow, written from start onwards
+#define KB_CONFIG_KEYS_MODE_LIST            (1) // count kb_config_key_entry_t follow
+
+// Number of packets queued to the bulk IN endpoint per transfer when streaming a response
+#ifndef KB_CONFIG_TX_WINDOW_PACKETS
+#define KB_CONFIG_TX_WINDOW_PACKETS         (8)
+#endif
+
+// Largest request payload that can be reassembled (a full encoded config image plus its CRC)
+#define KB_CONFIG_MAX_REQUEST_SIZE          (FLASH_SECTOR_SIZE + sizeof(uint32_t))
 
 // typedefs
 typedef void (*kb_config_transfer_complete_cb_t)(void);
+typedef void (*kb_config_rx_complete_cb_t)(const uint8_t* packet, uint16_t len);
 typedef struct kb_config_bulk_ptrs_t {
-    // Written by kb_config to be used by usb
+    // Written by kb_config to be used by usb. rx_complete is handed the packet where it was received, which is only
+    // valid until it returns
     kb_config_transfer_complete_cb_t tx_complete;
-    kb_config_transfer_complete_cb_t rx_complete;
+    kb_config_rx_complete_cb_t rx_complete;
 
-    // Written by usb to be used by kb_config
-    void (*tx)(uint8_t* buf, uint16_t len);
-    void (*rx)(uint8_t* buf, uint16_t len);
+    // Written by usb to be used by kb_config. tx sends the segments end to end, and they must stay valid until
+    // tx_complete. rx asks for the next packet
+    void (*tx)(const usb_transfer_segment_t* segments, uint8_t count);
+    void (*rx)(void);
 } kb_config_bulk_ptrs_t;
 
 // 4 byte header
@@ -67,6 +112,9 @@ typedef struct kb_config_get_info_t {
     uint8_t combo_count;            // How many combo slots are available
     uint8_t macro_max_size;         // Maximum length of a macro string
     uint8_t combo_max_size;         // Maximum number of keys allowed in a combo
+    uint16_t max_request_size;      // Largest request payload (including CRC) that the keyboard can reassemble
+    uint8_t tx_window;              // How many packets are streamed back-to-back in a response before waiting
+    uint8_t profile_count;          // How many config profiles can be stored
 } __packed kb_config_get_info_t;
 
 typedef struct kb_config_set_key_t {
@@ -77,6 +125,18 @@ typedef struct kb_config_set_key_t {
     uint32_t value;
 } __packed kb_config_set_key_t;
 
+typedef struct kb_config_keys_header_t {
+    uint8_t mode;                   // KB_CONFIG_KEYS_MODE_*. GET_KEYS only supports ranges
+    uint8_t padding;
+    uint16_t start;                 // First flat key index (range mode only)
+    uint16_t count;                 // Number of keys in the range or entries in the list
+} __packed kb_config_keys_header_t;
+
+typedef struct kb_config_key_entry_t {
+    uint16_t index;
+    uint32_t value;
+} __packed kb_config_key_entry_t;
+
 typedef struct kb_config_commit_t {
     uint32_t commit_value;
     uint8_t operation;
@@ -93,6 +153,32 @@ typedef struct kb_config_combo_t {
     uint32_t key_out;
 } __packed kb_config_combo_t;
 
+typedef struct kb_config_timings_t {
+    uint16_t tap_hold_delay_ms;
+    uint16_t double_tap_delay_ms;
+    uint16_t combo_delay_ms;
+    uint16_t combo_cancel_suppress_ms;
+} __packed kb_config_timings_t;
+
+typedef struct kb_config_profile_t {
+    uint8_t active_profile;
+    uint8_t profile_count;
+} __packed kb_config_profile_t;
+
+typedef struct kb_config_get_recorder_t {
+    uint16_t start;                 // Index of the first event, where 0 is the oldest held
+    uint16_t count;
+} __packed kb_config_get_recorder_t;
+
+// GET_RECORDER response header, followed by the events (recorder_event_t)
+typedef struct kb_config_recorder_header_t {
+    uint16_t event_count;           // Total events held by the recorder
+    uint16_t returned_count;        // Events in this response
+    uint8_t frozen;
+    uint8_t event_size;
+    uint16_t padding;
+} __packed kb_config_recorder_header_t;
+
 typedef struct kb_config_set_macro_t {
     uint8_t index;
     kb_config_macro_t macro;
@@ -106,10 +192,19 @@ typedef struct kb_config_set_combo_t {
 typedef struct kb_config_message_state_t {
     bool transmitting;
     kb_config_msg_header_t header;
-    uint16_t data_bytes_written;
+    uint16_t payload_bytes_written;
+    uint16_t data_length;
     const uint8_t* data_buffer;
+    uint32_t crc;
 } kb_config_message_state_t;
 
+typedef struct kb_config_rx_state_t {
+    bool in_progress;
+    kb_config_msg_header_t header;
+    uint8_t next_packet_number;
+    uint16_t bytes_received;
+} kb_config_rx_state_t;
+
 typedef struct kb_config_flash_header_t {
     uint32_t sentinel;
     uint32_t format_version;
@@ -124,10 +219,26 @@ typedef struct kb_config_flash_header_t {
     uint8_t combo_count;
     uint8_t macro_max_size;
     uint8_t combo_max_size;
+
+    // Encoded image only (see kb_config_codec.h)
+    uint16_t payload_length;
+    uint16_t reserved;
+    uint32_t payload_crc;
 } kb_config_flash_header_t;
 
+// The decoded config, as used at runtime. Flash holds the compact encoding of this (see kb_config_codec.h)
+typedef struct kb_config_image_t {
+    kb_config_flash_header_t header;
+    kb_config_timings_t timings;
+    uint32_t keymap[LAYER_MAX][MATRIX_ROWS][MATRIX_COLS];
+    kb_config_macro_t macros[MACRO_MAX];
+    kb_config_combo_t combos[COMBO_MAX];
+} kb_config_image_t;
+
 // public functions
 void kb_config_init(void);
 void kb_config_reset(void);
+void kb_config_apply_pending(void);
+void kb_config_select_profile(uint8_t profile);
+void kb_config_next_profile(void);
 kb_config_bulk_ptrs_t* kb_config_get_bulk_ptrs(void);
-void kb_config_log_to_ring_buffer(void* data, uint16_t length);
@@ -0,0 +1,303 @@
+#include "kb_config_codec.h"
+#include "macro.h"
+#include "crc.h"
+
+#include <string.h>
+
+// defines
+#define LAYER_SIZE      (MATRIX_ROWS * MATRIX_COLS)
+
+// typedefs
+typedef struct codec_writer_t {
+    uint8_t* buffer;
+    uint16_t capacity;
+    uint16_t length;
+    bool overflow;
+} codec_writer_t;
+
+typedef struct codec_reader_t {
+    const uint8_t* buffer;
+    uint16_t length;
+    uint16_t offset;
+    bool underflow;
+} codec_reader_t;
+
+_Static_assert(MACRO_MAX < 256 && COMBO_MAX < 256, "macro and combo indices and record counts are encoded as uint8_t");
+_Static_assert(MACRO_SIZE_MAX <= 255, "macro lengths are encoded as uint8_t");
+
+// private functions
+static void codec_write(codec_writer_t* w, const void* data, uint16_t length) {
+    if (w->overflow || (uint32_t)w->length + length > w->capacity) {
+        w->overflow = true;
+        return;
+    }
+
+    if (w->buffer != NULL) {
+        memcpy(&w->buffer[w->length], data, length);
+    }
+    w->length += length;
+}
+
+static void codec_write_u8(codec_writer_t* w, uint8_t value) {
+    codec_write(w, &value, sizeof(value));
+}
+
+static void codec_write_u16(codec_writer_t* w, uint16_t value) {
+    codec_write(w, &value, sizeof(value));
+}
+
+static void codec_write_u32(codec_writer_t* w, uint32_t value) {
+    codec_write(w, &value, sizeof(value));
+}
+
+static void codec_patch_u16(codec_writer_t* w, uint16_t offset, uint16_t value) {
+    if (!w->overflow && w->buffer != NULL) {
+        memcpy(&w->buffer[offset], &value, sizeof(value));
+    }
+}
+
+static void codec_read(codec_reader_t* r, void* data, uint16_t length) {
+    if (r->underflow || (uint32_t)r->offset + length > r->length) {
+        r->underflow = true;
+        memset(data, 0, length);
+        return;
+    }
+
+    memcpy(data, &r->buffer[r->offset], length);
+    r->offset += length;
+}
+
+static uint8_t codec_read_u8(codec_reader_t* r) {
+    uint8_t value;
+    codec_read(r, &value, sizeof(value));
+    return value;
+}
+
+static uint16_t codec_read_u16(codec_reader_t* r) {
+    uint16_t value;
+    codec_read(r, &value, sizeof(value));
+    return value;
+}
+
+static uint32_t codec_read_u32(codec_reader_t* r) {
+    uint32_t value;
+    codec_read(r, &value, sizeof(value));
+    return value;
+}
+
+static void codec_encode_layer(codec_writer_t* w, const uint32_t* keys) {
+    // Most positions in a layer are either transparent or unused, so whichever is more common is the fill
+    uint16_t trans_count = 0;
+    uint16_t none_count = 0;
+    for (uint16_t i = 0; i < LAYER_SIZE; i++) {
+        if (keys[i] == KC_TRANS) trans_count++;
+        else if (keys[i] == KC_NONE) none_count++;
+    }
+    const uint32_t fill = (trans_count > none_count) ? KC_TRANS : KC_NONE;
+
+    codec_write_u32(w, fill);
+    uint16_t run_count_offset = w->length;
+    codec_write_u16(w, 0);
+
+    uint16_t run_count = 0;
+    uint16_t i = 0;
+    while (i < LAYER_SIZE) {
+        uint16_t skip = 0;
+        while (i < LAYER_SIZE && keys[i] == fill && skip < KB_CONFIG_CODEC_RUN_SKIP_MASK) {
+            skip++;
+            i++;
+        }
+
+        // Entries that fit in 16 bits (plain keycodes with modifiers) are stored short
+        const uint16_t run_start = i;
+        const bool wide = (i < LAYER_SIZE) && (keys[i] > 0xffff);
+        uint16_t count = 0;
+        while (i < LAYER_SIZE && keys[i] != fill && ((keys[i] > 0xffff) == wide) && count < KB_CONFIG_CODEC_RUN_COUNT_MAX) {
+            count++;
+            i++;
+        }
+
+        // Trailing fill doesn't need a run
+        if (count == 0 && i == LAYER_SIZE) break;
+
+        codec_write_u16(w, skip | (count << KB_CONFIG_CODEC_RUN_COUNT_SHIFT) | (wide ? KB_CONFIG_CODEC_RUN_WIDE : 0));
+        for (uint16_t k = run_start; k < run_start + count; k++) {
+            if (wide) {
+                codec_write_u32(w, keys[k]);
+            } else {
+                codec_write_u16(w, keys[k]);
+            }
+        }
+        run_count++;
+    }
+
+    codec_patch_u16(w, run_count_offset, run_count);
+}
+
+static void codec_decode_layer(codec_reader_t* r, uint32_t* keys) {
+    const uint32_t fill = codec_read_u32(r);
+    const uint16_t run_count = codec_read_u16(r);
+
+    if (keys != NULL) {
+        for (uint16_t i = 0; i < LAYER_SIZE; i++) {
+            keys[i] = fill;
+        }
+    }
+
+    uint16_t position = 0;
+    for (uint16_t run = 0; run < run_count && !r->underflow; run++) {
+        const uint16_t run_header = codec_read_u16(r);
+        const uint16_t count = (run_header >> KB_CONFIG_CODEC_RUN_COUNT_SHIFT) & KB_CONFIG_CODEC_RUN_COUNT_MAX;
+        const bool wide = (run_header & KB_CONFIG_CODEC_RUN_WIDE) != 0;
+
+        position += run_header & KB_CONFIG_CODEC_RUN_SKIP_MASK;
+        if (position + count > LAYER_SIZE) {
+            r->underflow = true;
+            return;
+        }
+
+        for (uint16_t k = 0; k < count; k++) {
+            const uint32_t value = wide ? codec_read_u32(r) : codec_read_u16(r);
+            if (keys != NULL) {
+                keys[position] = value;
+            }
+            position++;
+        }
+    }
+}
+
+// public functions
+uint16_t kb_config_codec_encode(const kb_config_image_t* image, uint8_t* dst, uint16_t capacity) {
+    codec_writer_t w = { .buffer = dst, .capacity = capacity, .length = 0, .overflow = false };
+
+    // The header is patched with the payload length and CRC at the end
+    kb_config_flash_header_t header = image->header;
+    header.format_version = KB_CONFIG_CURRENT_FORMAT_VERSION;
+    codec_write(&w, &header, sizeof(header));
+
+    const uint16_t payload_start = w.length;
+    codec_write(&w, &image->timings, sizeof(image->timings));
+
+    for (uint16_t layer = 0; layer < LAYER_MAX; layer++) {
+        codec_encode_layer(&w, &image->keymap[layer][0][0]);
+    }
+
+    uint8_t macro_record_count = 0;
+    for (uint16_t i = 0; i < MACRO_MAX; i++) {
+        if (image->macros[i].macro_type != macro_type_unused) macro_record_count++;
+    }
+
+    codec_write_u8(&w, macro_record_count);
+    for (uint16_t i = 0; i < MACRO_MAX; i++) {
+        const kb_config_macro_t* macro = &image->macros[i];
+        if (macro->macro_type == macro_type_unused) continue;
+
+        const uint8_t length = MIN(macro->length, MACRO_SIZE_MAX);
+        codec_write_u8(&w, i);
+        codec_write_u8(&w, macro->macro_type);
+        codec_write_u8(&w, length);
+        codec_write(&w, macro->string, length);
+    }
+
+    uint8_t combo_record_count = 0;
+    for (uint16_t i = 0; i < COMBO_MAX; i++) {
+        if (image->combos[i].key_out != KC_NONE) combo_record_count++;
+    }
+
+    codec_write_u8(&w, combo_record_count);
+    for (uint16_t i = 0; i < COMBO_MAX; i++) {
+        const kb_config_combo_t* combo = &image->combos[i];
+        if (combo->key_out == KC_NONE) continue;
+
+        uint8_t key_count = COMBO_KEYS_MAX;
+        while (key_count > 0 && combo->keys[key_count - 1] == KC_NONE) key_count--;
+
+        codec_write_u8(&w, i);
+        codec_write_u8(&w, key_count);
+        codec_write(&w, combo->keys, key_count * sizeof(uint32_t));
+        codec_write_u32(&w, combo->key_out);
+    }
+
+    if (w.overflow) return 0;
+
+    if (dst != NULL) {
+        kb_config_flash_header_t* encoded_header = (kb_config_flash_header_t*)dst;
+        header.payload_length = w.length - payload_start;
+        header.payload_crc = crc32_update(CRC32_INITIAL_VALUE, &dst[payload_start], header.payload_length);
+        memcpy(encoded_header, &header, sizeof(header));
+    }
+
+    return w.length;
+}
+
+bool kb_config_codec_decode(const uint8_t* src, uint16_t length, kb_config_image_t* dst) {
+    codec_reader_t r = { .buffer = src, .length = length, .offset = 0, .underflow = false };
+
+    kb_config_flash_header_t header;
+    codec_read(&r, &header, sizeof(header));
+    if (r.underflow) return false;
+
+    if (header.sentinel       != KB_CONFIG_SENTINEL_VALUE
+     || header.format_version != KB_CONFIG_CURRENT_FORMAT_VERSION
+     || header.row_count      != MATRIX_ROWS
+     || header.column_count   != MATRIX_COLS
+     || header.layer_count    != LAYER_MAX
+     || header.macro_count    != MACRO_MAX
+     || header.combo_count    != COMBO_MAX
+     || header.macro_max_size != MACRO_SIZE_MAX
+     || header.combo_max_size != COMBO_KEYS_MAX) {
+        return false;
+    }
+
+    if ((uint32_t)r.offset + header.payload_length > length) return false;
+    if (crc32_update(CRC32_INITIAL_VALUE, &src[r.offset], header.payload_length) != header.payload_crc) return false;
+    r.length = r.offset + header.payload_length;
+
+    if (dst != NULL) {
+        memset(dst, 0, sizeof(kb_config_image_t));
+        dst->header = header;
+    }
+
+    kb_config_timings_t timings;
+    codec_read(&r, &timings, sizeof(timings));
+    if (dst != NULL) dst->timings = timings;
+
+    for (uint16_t layer = 0; layer < LAYER_MAX; layer++) {
+        codec_decode_layer(&r, (dst != NULL) ? &dst->keymap[layer][0][0] : NULL);
+    }
+
+    const uint8_t macro_record_count = codec_read_u8(&r);
+    for (uint16_t record = 0; record < macro_record_count && !r.underflow; record++) {
+        const uint8_t index = codec_read_u8(&r);
+        const uint8_t macro_type = codec_read_u8(&r);
+        const uint8_t macro_length = codec_read_u8(&r);
+        if (index >= MACRO_MAX || macro_length > MACRO_SIZE_MAX) return false;
+
+        char string[MACRO_SIZE_MAX];
+        codec_read(&r, string, macro_length);
+
+        if (dst != NULL) {
+            dst->macros[index].macro_type = macro_type;
+            dst->macros[index].length = macro_length;
+            memcpy(dst->macros[index].string, string, macro_length);
+        }
+    }
+
+    const uint8_t combo_record_count = codec_read_u8(&r);
+    for (uint16_t record = 0; record < combo_record_count && !r.underflow; record++) {
+        const uint8_t index = codec_read_u8(&r);
+        const uint8_t key_count = codec_read_u8(&r);
+        if (index >= COMBO_MAX || key_count > COMBO_KEYS_MAX) return false;
+
+        uint32_t keys[COMBO_KEYS_MAX] = {0};
+        codec_read(&r, keys, key_count * sizeof(uint32_t));
+        const uint32_t key_out = codec_read_u32(&r);
+
+        if (dst != NULL) {
+            memcpy(dst->combos[index].keys, keys, sizeof(keys));
+            dst->combos[index].key_out = key_out;
+        }
+    }
+
+    return !r.underflow && r.offset == r.length;
+}
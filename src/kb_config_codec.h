@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+#include "kb_config.h"
+
+// Encoded config image (format version 3). All fields are little-endian and byte packed.
+//
+//   kb_config_flash_header_t       (payload_length / payload_crc describe everything after the header)
+//   kb_config_timings_t
+//   layer_count x layer:
+//       uint32_t fill              value of every position not covered by a run
+//       uint16_t run_count
+//       run_count x run:
+//           uint16_t run_header    bits 0-7: positions to skip (left as fill), bits 8-14: entry count, bit 15: 32-bit entries
+//           entries                uint16_t or uint32_t each
+//   uint8_t macro_record_count
+//   macro_record_count x { uint8_t index; uint8_t macro_type; uint8_t length; char string[length]; }
+//   uint8_t combo_record_count
+//   combo_record_count x { uint8_t index; uint8_t key_count; uint32_t keys[key_count]; uint32_t key_out; }
+
+// defines
+#define KB_CONFIG_CODEC_RUN_SKIP_MASK       (0x00ff)
+#define KB_CONFIG_CODEC_RUN_COUNT_SHIFT     (8)
+#define KB_CONFIG_CODEC_RUN_COUNT_MAX       (0x7f)
+#define KB_CONFIG_CODEC_RUN_WIDE            (0x8000)
+
+// public functions
+
+// Returns the encoded length, or 0 if the image doesn't fit in capacity bytes. dst may be NULL to just measure.
+uint16_t kb_config_codec_encode(const kb_config_image_t* image, uint8_t* dst, uint16_t capacity);
+
+// Decodes and validates an encoded image. dst may be NULL to only validate.
+bool kb_config_codec_decode(const uint8_t* src, uint16_t length, kb_config_image_t* dst);
@@ -13,7 +13,13 @@
 #include "macro.h"
 #include "mouse.h"
 #include "leds.h"
+#include "led_effects.h"
 #include "matrix.h"
+#include "perf.h"
+#include "scan_timer.h"
+#include "recorder.h"
+#include "trace.h"
+#include "hot_path.h"
 
 #include <string.h>
 
@@ -27,13 +33,34 @@ extern const keymap_entry_t keymap[LAYER_MAX][MATRIX_ROWS][MATRIX_COLS];
 
 // statics
 static uint8_t* keyboard_hid_report_ref = NULL;
-static uint16_t* cc_hid_report_ref = NULL;
+static consumer_report_t* consumer_report_ref = NULL;
+static system_report_t* system_report_ref = NULL;
 static mouse_report_t* mouse_hid_report_ref = NULL;
 static uint8_t report_press_count = 0;
+static uint8_t consumer_usage_count = 0;
 static const keymap_entry_t (*keymap_ptr)[LAYER_MAX][MATRIX_ROWS][MATRIX_COLS] = &keymap;
 
 // private functions
-static void keyboard_handle_remaining_presses(void) {
+static void HOT_PATH_FUNC(keyboard_send_cc)(keymap_entry_t key) {
+    const uint16_t usage = key & CC_INDEX_MASK;
+
+    if ((key & CC_PAGE_MASK) == CC_PAGE_SYSTEM) {
+        if ((usage >= HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN) && (usage <= HID_USAGE_DESKTOP_SYSTEM_WAKE_UP)) {
+            system_report_ref->controls |= 1 << (usage - HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN);
+        }
+        return;
+    }
+
+    // Every held usage gets a slot, so chorded media keys all go out. Past CONSUMER_USAGES_MAX, later keys are dropped
+    for (uint i = 0; i < consumer_usage_count; i++) {
+        if (consumer_report_ref->usages[i] == usage) return;
+    }
+    if (consumer_usage_count < CONSUMER_USAGES_MAX) {
+        consumer_report_ref->usages[consumer_usage_count++] = usage;
+    }
+}
+
+static void HOT_PATH_FUNC(keyboard_handle_remaining_presses)(void) {
     keymap_entry_t key = KC_NONE;
 
     // Now we have some certainty about the current layer, check for keypresses
@@ -53,14 +80,14 @@ static void keyboard_handle_remaining_presses(void) {
                 } break;
 
                 case ENTRY_TYPE_CC: {
-                    cc_hid_report_ref[0] = key & CC_INDEX_MASK;
+                    keyboard_send_cc(key);
                 } break;
             }
         }
     }
 }
 
-static void keyboard_on_key_release(uint row, uint col, keymap_entry_t key) {
+static void HOT_PATH_FUNC(keyboard_on_key_release)(uint row, uint col, keymap_entry_t key) {
     if (mouse_on_key_release(row, col, key)) return;
     if (kbc_on_key_release(row, col, key)) return;
     if (macro_on_key_release(row, col, key)) return;
@@ -70,7 +97,7 @@ static void keyboard_on_key_release(uint row, uint col, keymap_entry_t key) {
     if (double_tap_on_key_release(row, col, key)) return;
 }
 
-static void keyboard_on_key_press(uint row, uint col, keymap_entry_t key) {
+static void HOT_PATH_FUNC(keyboard_on_key_press)(uint row, uint col, keymap_entry_t key) {
     if (mouse_on_key_press(row, col, key)) return;
     if (kbc_on_key_press(row, col, key)) return;
     if (macro_on_key_press(row, col, key)) return;
@@ -84,7 +111,7 @@ static void keyboard_on_key_press(uint row, uint col, keymap_entry_t key) {
     if (double_tap_on_key_press(row, col, key)) return;
 }
 
-static void keyboard_handle_virtual_key(keymap_entry_t key) {
+static void HOT_PATH_FUNC(keyboard_handle_virtual_key)(keymap_entry_t key) {
     if (kbc_on_virtual_key(key)) return;
     if (macro_on_virtual_key(key)) return;
     if (layers_on_virtual_key(key)) return;
@@ -100,9 +127,10 @@ static void keyboard_bootmagic(void) {
 }
 
 // public functions
-void keyboard_init(uint8_t* keyboard_hid_report, uint16_t* cc_hid_report, mouse_report_t* mouse_hid_report) {
+void keyboard_init(uint8_t* keyboard_hid_report, consumer_report_t* consumer_report, system_report_t* system_report, mouse_report_t* mouse_hid_report) {
     keyboard_hid_report_ref = keyboard_hid_report;
-    cc_hid_report_ref = cc_hid_report;
+    consumer_report_ref = consumer_report;
+    system_report_ref = system_report;
     mouse_hid_report_ref = mouse_hid_report;
 
     // Reset to the bootrom if the escape key is held during boot
@@ -137,7 +165,7 @@ void keyboard_reset(void) {
     matrix_reset();
 }
 
-bool keyboard_send_key(keymap_entry_t key) {
+bool HOT_PATH_FUNC(keyboard_send_key)(keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) != ENTRY_TYPE_KC) {
         keyboard_handle_virtual_key(key);
         return true;
@@ -170,35 +198,45 @@ bool keyboard_send_key(keymap_entry_t key) {
     return true;
 }
 
-void keyboard_send_modifiers(uint8_t modifiers) {
+void HOT_PATH_FUNC(keyboard_send_modifiers)(uint8_t modifiers) {
     keyboard_hid_report_ref[0] |= modifiers;
 }
 
-void keyboard_clear_sent_keys(void) {
+void HOT_PATH_FUNC(keyboard_clear_sent_keys)(void) {
     memset(keyboard_hid_report_ref, 0, 8);
 }
 
-void keyboard_clear_sent_mouse_commands(void) {
-    memset(mouse_hid_report_ref, 0, sizeof(mouse_report_t));
+void HOT_PATH_FUNC(keyboard_clear_sent_mouse_commands)(void) {
+    // Motion is left alone: the mouse engine adds it at the USB poll rate, and it's cleared as it's sent
+    mouse_hid_report_ref->buttons = 0;
 }
 
-void keyboard_post_scan(void) {
+void HOT_PATH_FUNC(keyboard_post_scan)(void) {
     // Clear the report
     keyboard_clear_sent_keys();
     report_press_count = 0;
 
-    // Clear the consumer report
-    *cc_hid_report_ref = 0;
+    // Clear the consumer and system reports (but not their report IDs)
+    memset(consumer_report_ref->usages, 0, sizeof(consumer_report_ref->usages));
+    consumer_usage_count = 0;
+    system_report_ref->controls = 0;
 
     // Clear the mouse report
     keyboard_clear_sent_mouse_commands();
 
+    // Timers in the feature engines advance by the real time since the last tick
+    const uint16_t elapsed_ms = scan_timer_get_elapsed_ms();
+
     // Before processing the keypresses, handle any released keys
+    uint32_t stage_start = perf_begin();
     const uint32_t* released_bitmap = matrix_get_released_this_scan_bitmap();
     for (uint row = 0; row < MATRIX_ROWS; row++) {
         for (uint col = 0; col < MATRIX_COLS; col++) {
             if (released_bitmap[row] & (1 << col)) {
-                keyboard_on_key_release(row, col, keyboard_resolve_key(row, col));
+                const keymap_entry_t key = keyboard_resolve_key(row, col);
+                recorder_log(RECORDER_KEY_RELEASE, row, col, key);
+                trace3(TRACE_KEY_RELEASE, row, col, key);
+                keyboard_on_key_release(row, col, key);
             }
         }
     }
@@ -208,22 +246,39 @@ void keyboard_post_scan(void) {
     for (uint row = 0; row < MATRIX_ROWS; row++) {
         for (uint col = 0; col < MATRIX_COLS; col++) {
             if (pressed_bitmap[row] & (1 << col)) {
-                keyboard_on_key_press(row, col, keyboard_resolve_key(row, col));
+                const keymap_entry_t key = keyboard_resolve_key(row, col);
+                recorder_log(RECORDER_KEY_PRESS, row, col, key);
+                trace3(TRACE_KEY_PRESS, row, col, key);
+                led_effects_on_key_press(row, col);
+                keyboard_on_key_press(row, col, key);
             }
         }
     }
+    perf_end(PERF_STAGE_KEY_EVENTS, stage_start);
 
+    stage_start = perf_begin();
     mouse_update();
+    perf_end(PERF_STAGE_MOUSE, stage_start);
+
+    stage_start = perf_begin();
+    const bool macro_running = macro_update();
+    perf_end(PERF_STAGE_MACRO, stage_start);
 
-    if (!macro_update()) {
+    if (!macro_running) {
         // Handle combos before layer change operations to allow for the layer changing keys themselves to be used for combos
-        bool ignore_remaining_keypresses = combo_update();
+        stage_start = perf_begin();
+        bool ignore_remaining_keypresses = combo_update(elapsed_ms);
+        perf_end(PERF_STAGE_COMBO, stage_start);
 
         // Tapholds
-        ignore_remaining_keypresses = taphold_update() || ignore_remaining_keypresses;
+        stage_start = perf_begin();
+        ignore_remaining_keypresses = taphold_update(elapsed_ms) || ignore_remaining_keypresses;
+        perf_end(PERF_STAGE_TAPHOLD, stage_start);
 
         // Double taps
-        ignore_remaining_keypresses = double_tap_update() || ignore_remaining_keypresses;
+        stage_start = perf_begin();
+        ignore_remaining_keypresses = double_tap_update(elapsed_ms) || ignore_remaining_keypresses;
+        perf_end(PERF_STAGE_DOUBLE_TAP, stage_start);
 
         // Regular keypresses that haven't been suppressed by other functionalities
         if (!ignore_remaining_keypresses) {
@@ -234,7 +289,7 @@ void keyboard_post_scan(void) {
     keyboard_on_scan_complete((const uint8_t*)keyboard_hid_report_ref);
 }
 
-keymap_entry_t keyboard_resolve_key(uint row, uint col) {
+keymap_entry_t HOT_PATH_FUNC(keyboard_resolve_key)(uint row, uint col) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return KC_NONE;
 
     keymap_entry_t key = (*keymap_ptr)[layers_get_current()][row][col];
@@ -245,7 +300,7 @@ keymap_entry_t keyboard_resolve_key(uint row, uint col) {
     return key;
 }
 
-keymap_entry_t keyboard_resolve_key_on_layer(uint row, uint col, uint layer) {
+keymap_entry_t HOT_PATH_FUNC(keyboard_resolve_key_on_layer)(uint row, uint col, uint layer) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS || layer >= LAYER_MAX) return KC_NONE;
 
     keymap_entry_t key = (*keymap_ptr)[layer][row][col];
@@ -256,7 +311,7 @@ keymap_entry_t keyboard_resolve_key_on_layer(uint row, uint col, uint layer) {
     return key;
 }
 
-uint8_t keyboard_get_current_layer(void) {
+uint8_t HOT_PATH_FUNC(keyboard_get_current_layer)(void) {
     return layers_get_current();
 }
 
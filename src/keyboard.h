@@ -89,6 +89,12 @@ typedef uint32_t keymap_entry_t;
 
 #define CC(index)                   (ENTRY_TYPE_CC | index)
 #define CC_INDEX_MASK               (0xffff)
+#define CC_PAGE_MASK                ENTRY_ARG8_MASK
+#define CC_PAGE_CONSUMER            (0x00 << ENTRY_ARG8_SHIFT)
+#define CC_PAGE_SYSTEM              (0x01 << ENTRY_ARG8_SHIFT)
+
+// System control usages (Generic Desktop page). Only power down, sleep and wake up are reported
+#define SYS(usage)                  (ENTRY_TYPE_CC | CC_PAGE_SYSTEM | usage)
 
 #define MOUSE(action)               (ENTRY_TYPE_MOUSE | action)
 #define MOUSE_ACTION_MASK           (0xffff)
@@ -99,6 +105,10 @@ typedef uint32_t keymap_entry_t;
 #define MOUSE_ACTION_MOVE_RIGHT     (4)
 #define MOUSE_ACTION_MOVE_UP        (5)
 #define MOUSE_ACTION_MOVE_DOWN      (6)
+#define MOUSE_ACTION_WHEEL_UP       (7)
+#define MOUSE_ACTION_WHEEL_DOWN     (8)
+#define MOUSE_ACTION_PAN_LEFT       (9)
+#define MOUSE_ACTION_PAN_RIGHT      (10)
 
 #define MOUSE_LC                    MOUSE(MOUSE_ACTION_LEFT_CLICK)
 #define MOUSE_MC                    MOUSE(MOUSE_ACTION_MIDDLE_CLICK)
@@ -107,6 +117,10 @@ typedef uint32_t keymap_entry_t;
 #define MOUSE_R                     MOUSE(MOUSE_ACTION_MOVE_RIGHT)
 #define MOUSE_U                     MOUSE(MOUSE_ACTION_MOVE_UP)
 #define MOUSE_D                     MOUSE(MOUSE_ACTION_MOVE_DOWN)
+#define MOUSE_WU                    MOUSE(MOUSE_ACTION_WHEEL_UP)
+#define MOUSE_WD                    MOUSE(MOUSE_ACTION_WHEEL_DOWN)
+#define MOUSE_WL                    MOUSE(MOUSE_ACTION_PAN_LEFT)
+#define MOUSE_WR                    MOUSE(MOUSE_ACTION_PAN_RIGHT)
 
 #define MOUSE_BUTTON_LEFT           (1 << 0)
 #define MOUSE_BUTTON_MIDDLE         (1 << 1)
@@ -205,15 +219,17 @@ typedef uint32_t keymap_entry_t;
 #define KC_UP       KEY(HID_KEY_ARROW_UP)
 
 #define KC_PTSC     KEY(HID_KEY_PRINT_SCREEN)
-#define KC_POWER    KEY(HID_KEY_POWER)
-#define KC_MUTE     KEY(HID_KEY_MUTE)
-#define KC_VOL_UP   KEY(HID_KEY_VOLUME_UP)
-#define KC_VOL_DN   KEY(HID_KEY_VOLUME_DOWN)
+#define KC_POWER    SYS(HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN)
+#define KC_SLEEP    SYS(HID_USAGE_DESKTOP_SYSTEM_SLEEP)
+#define KC_WAKE     SYS(HID_USAGE_DESKTOP_SYSTEM_WAKE_UP)
+#define KC_MUTE     CC(HID_USAGE_CONSUMER_MUTE)
+#define KC_VOL_UP   CC(HID_USAGE_CONSUMER_VOLUME_INCREMENT)
+#define KC_VOL_DN   CC(HID_USAGE_CONSUMER_VOLUME_DECREMENT)
 #define KC_BGT_UP   CC(HID_USAGE_CONSUMER_BRIGHTNESS_INCREMENT)
 #define KC_BGT_DN   CC(HID_USAGE_CONSUMER_BRIGHTNESS_DECREMENT)
 
 // public functions
-void keyboard_init(uint8_t* keyboard_hid_report, uint16_t* cc_hid_report, mouse_report_t* mouse_hid_report);
+void keyboard_init(uint8_t* keyboard_hid_report, consumer_report_t* consumer_report, system_report_t* system_report, mouse_report_t* mouse_hid_report);
 void keyboard_reset(void);
 bool keyboard_send_key(keymap_entry_t key);
 void keyboard_send_modifiers(uint8_t modifiers);
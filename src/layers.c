@@ -1,12 +1,14 @@
 #include "layers.h"
 #include "keyboard.h"
 #include "matrix.h"
+#include "led_effects.h"
+#include "hot_path.h"
 
 // statics
 static layer_state_t layer_state = {0};
 
 // public functions
-bool layers_on_key_press(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(layers_on_key_press)(uint row, uint col, keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) == ENTRY_TYPE_LAYER) {
         if ((key & ENTRY_ARG8_MASK) == LAYER_COM_MO) {
             // A momentary layer switch is only active while the key is pressed
@@ -21,7 +23,7 @@ bool layers_on_key_press(uint row, uint col, keymap_entry_t key) {
 
     return false;
 }
-bool layers_on_key_release(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(layers_on_key_release)(uint row, uint col, keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) == ENTRY_TYPE_LAYER) {
         if ((key & ENTRY_ARG8_MASK) == LAYER_COM_MO) {
             layers_set(layer_state.base);
@@ -35,7 +37,7 @@ bool layers_on_key_release(uint row, uint col, keymap_entry_t key) {
 
     return false;
 }
-bool layers_on_virtual_key(keymap_entry_t key) {
+bool HOT_PATH_FUNC(layers_on_virtual_key)(keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) == ENTRY_TYPE_LAYER) {
         if ((key & ENTRY_ARG8_MASK) == LAYER_COM_MO) {
             layers_set(key & KC_MASK);
@@ -46,15 +48,18 @@ bool layers_on_virtual_key(keymap_entry_t key) {
     return false;
 }
 
-uint8_t layers_get_current(void) {
+uint8_t HOT_PATH_FUNC(layers_get_current)(void) {
     return layer_state.current;
 }
 
-uint8_t layers_get_base(void) {
+uint8_t HOT_PATH_FUNC(layers_get_base)(void) {
     return layer_state.base;
 }
 
-void layers_set(uint8_t layer) {
+void HOT_PATH_FUNC(layers_set)(uint8_t layer) {
+    if (layer != layer_state.current) {
+        led_effects_on_layer_change();
+    }
     layer_state.current = layer;
     layer_post_set(layer);
 }
@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "led_effects.h"
+#include "leds.h"
+#include "hot_path.h"
+
+#include "hardware/timer.h"
+
+#include <string.h>
+
+// statics
+static led_effects_state_t led_effects_state = {0};
+
+// externs
+// Matrix position each LED sits over, used by ripples
+extern const leds_position_t leds_positions[LEDS_MAX];
+
+// private functions
+static inline uint led_effects_abs_diff(uint a, uint b) {
+    return (a > b) ? (a - b) : (b - a);
+}
+
+static inline uint8_t led_effects_lerp(uint8_t from, uint8_t to, uint32_t progress) {
+    return (uint8_t)((int32_t)from + ((((int32_t)to - (int32_t)from) * (int32_t)progress) >> 8));
+}
+
+// Everything that's the same for every LED is worked out once, at the start of the frame
+static void HOT_PATH_FUNC(led_effects_begin_frame)(uint32_t now_us) {
+    const uint32_t elapsed_us = now_us - led_effects_state.frame_start_us;
+    led_effects_state.frame_start_us = now_us;
+
+    // Breathing: a triangle wave between LED_EFFECTS_BREATHE_MIN and full
+    led_effects_state.breathe_phase_us = (led_effects_state.breathe_phase_us + elapsed_us) % LED_EFFECTS_BREATHE_PERIOD_US;
+    const uint32_t half_period = LED_EFFECTS_BREATHE_PERIOD_US / 2;
+    const uint32_t phase = led_effects_state.breathe_phase_us;
+    const uint32_t wave = (phase < half_period) ? phase : (LED_EFFECTS_BREATHE_PERIOD_US - phase);
+    led_effects_state.breathe_level = LED_EFFECTS_BREATHE_MIN + ((wave * (255 - LED_EFFECTS_BREATHE_MIN)) / half_period);
+
+    // Ripples grow outwards and fade, until they've lived out their time
+    for (uint i = 0; i < LED_EFFECTS_RIPPLE_MAX; i++) {
+        led_effects_ripple_t* ripple = &led_effects_state.ripples[i];
+        if (!ripple->active) continue;
+
+        const uint32_t age_us = now_us - ripple->start_us;
+        if (age_us >= LED_EFFECTS_RIPPLE_US) {
+            ripple->active = false;
+            continue;
+        }
+        ripple->radius = (age_us * LED_EFFECTS_RIPPLE_SPEED * (1 << LED_EFFECTS_POS_SHIFT)) / 1000000;
+        ripple->strength = 255 - ((age_us * 255) / LED_EFFECTS_RIPPLE_US);
+    }
+
+    if (led_effects_state.transitioning) {
+        const uint32_t transition_us = now_us - led_effects_state.transition_start_us;
+        if (transition_us >= LED_EFFECTS_TRANSITION_US) {
+            led_effects_state.transitioning = false;
+            led_effects_state.transition_progress = 256;
+        } else {
+            led_effects_state.transition_progress = (transition_us * 256) / LED_EFFECTS_TRANSITION_US;
+        }
+    }
+
+    led_effects_state.next_led = 0;
+    led_effects_state.rendering = true;
+    led_effects_state.frame_sliced = false;
+}
+
+static uint8_t HOT_PATH_FUNC(led_effects_ripple_level)(uint index) {
+    const uint led_col = leds_positions[index].col;
+    const uint led_row = leds_positions[index].row;
+    uint level = 0;
+
+    for (uint i = 0; i < LED_EFFECTS_RIPPLE_MAX; i++) {
+        const led_effects_ripple_t* ripple = &led_effects_state.ripples[i];
+        if (!ripple->active) continue;
+
+        // Distance from the key to the LED, against how far the ring has travelled
+        const uint distance = (led_effects_abs_diff(led_col, ripple->col) + led_effects_abs_diff(led_row, ripple->row)) << LED_EFFECTS_POS_SHIFT;
+        const uint from_ring = led_effects_abs_diff(distance, ripple->radius);
+        if (from_ring >= LED_EFFECTS_RIPPLE_WIDTH) continue;
+
+        const uint ring_level = ((LED_EFFECTS_RIPPLE_WIDTH - from_ring) * 255) / LED_EFFECTS_RIPPLE_WIDTH;
+        const uint ripple_level = (ring_level * ripple->strength) >> 8;
+        if (ripple_level > level) {
+            level = ripple_level;
+        }
+    }
+
+    return (uint8_t)level;
+}
+
+static void HOT_PATH_FUNC(led_effects_render_led)(uint index) {
+    const uint8_t* base = leds_get_color(index);
+    uint8_t* out = led_effects_state.frame[index];
+
+    switch (led_effects_state.effect) {
+        case LED_EFFECT_BREATHING: {
+            const uint32_t level = led_effects_state.breathe_level;
+            out[0] = (base[0] * level) >> 8;
+            out[1] = (base[1] * level) >> 8;
+            out[2] = (base[2] * level) >> 8;
+            break;
+        }
+
+        case LED_EFFECT_REACTIVE: {
+            // Lift the color towards white as a ring passes
+            const uint32_t level = led_effects_ripple_level(index);
+            out[0] = led_effects_lerp(base[0], 255, level);
+            out[1] = led_effects_lerp(base[1], 255, level);
+            out[2] = led_effects_lerp(base[2], 255, level);
+            break;
+        }
+
+        default: {
+            out[0] = base[0];
+            out[1] = base[1];
+            out[2] = base[2];
+            break;
+        }
+    }
+
+    if (led_effects_state.transitioning) {
+        const uint8_t* from = led_effects_state.transition_from[index];
+        const uint32_t progress = led_effects_state.transition_progress;
+        out[0] = led_effects_lerp(from[0], out[0], progress);
+        out[1] = led_effects_lerp(from[1], out[1], progress);
+        out[2] = led_effects_lerp(from[2], out[2], progress);
+    }
+}
+
+static void HOT_PATH_FUNC(led_effects_show_frame)(void) {
+    for (uint i = 0; i < LEDS_MAX; i++) {
+        leds_set_output_color(i, led_effects_state.frame[i]);
+    }
+    memcpy(led_effects_state.shown, led_effects_state.frame, sizeof(led_effects_state.shown));
+
+    led_effects_state.rendering = false;
+    led_effects_state.frames_shown++;
+    if (led_effects_state.frame_sliced) {
+        led_effects_state.frames_sliced++;
+    }
+}
+
+// public functions
+void led_effects_reset(void) {
+    const led_effect_t effect = led_effects_state.effect;
+    led_effects_state = (led_effects_state_t){0};
+    led_effects_state.effect = effect;
+
+    // Render the first frame on the next update
+    led_effects_state.frame_start_us = time_us_32() - LED_EFFECTS_FRAME_US;
+}
+
+void HOT_PATH_FUNC(led_effects_update)(void) {
+    const uint32_t tick_start_us = time_us_32();
+
+    if (!led_effects_state.rendering) {
+        if ((tick_start_us - led_effects_state.frame_start_us) < LED_EFFECTS_FRAME_US) return;
+        led_effects_begin_frame(tick_start_us);
+    } else {
+        led_effects_state.frame_sliced = true;
+    }
+
+    // Always render at least one LED, so a frame finishes however small the budget
+    uint32_t spent_us = 0;
+    while (led_effects_state.next_led < LEDS_MAX) {
+        led_effects_render_led(led_effects_state.next_led++);
+
+        spent_us = time_us_32() - tick_start_us;
+        if (spent_us >= LED_EFFECTS_BUDGET_US) break;
+    }
+
+    if (spent_us > led_effects_state.tick_us_max) {
+        led_effects_state.tick_us_max = spent_us;
+    }
+
+    if (led_effects_state.next_led == LEDS_MAX) {
+        led_effects_show_frame();
+    }
+}
+
+void led_effects_set(led_effect_t effect) {
+    if (effect >= LED_EFFECT_COUNT) return;
+    led_effects_state.effect = effect;
+}
+
+void led_effects_next(void) {
+    led_effects_set((led_effects_state.effect + 1) % LED_EFFECT_COUNT);
+}
+
+led_effect_t led_effects_get(void) {
+    return led_effects_state.effect;
+}
+
+void HOT_PATH_FUNC(led_effects_on_key_press)(uint row, uint col) {
+    if (led_effects_state.effect != LED_EFFECT_REACTIVE) return;
+
+    led_effects_ripple_t* ripple = &led_effects_state.ripples[led_effects_state.next_ripple];
+    led_effects_state.next_ripple = (led_effects_state.next_ripple + 1) % LED_EFFECTS_RIPPLE_MAX;
+
+    ripple->active = true;
+    ripple->row = row;
+    ripple->col = col;
+    ripple->start_us = time_us_32();
+    ripple->radius = 0;
+    ripple->strength = 255;
+}
+
+void HOT_PATH_FUNC(led_effects_on_layer_change)(void) {
+    // Fade from whatever is showing now, even if that's partway through another transition
+    memcpy(led_effects_state.transition_from, led_effects_state.shown, sizeof(led_effects_state.transition_from));
+    led_effects_state.transitioning = true;
+    led_effects_state.transition_start_us = time_us_32();
+    led_effects_state.transition_progress = 0;
+}
+
+const led_effects_state_t* led_effects_get_state(void) {
+    return &led_effects_state;
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+#include "keyboard.h"
+
+// The effects engine renders the LEDs' frame from the colors set by the keyboard's hooks (leds_set_color), at its own
+// frame rate. Rendering is time-sliced: each call to led_effects_update() renders LEDs until the budget is used, and
+// picks up where it left off on the next tick. A frame is only handed to the LEDs once it's complete, so a slow
+// frame is shown late rather than torn, and lighting can never take more than the budget from a scan.
+
+// defines
+#ifndef LED_EFFECTS_FRAME_US
+#define LED_EFFECTS_FRAME_US            (20000) // 50 frames per second
+#endif
+
+#ifndef LED_EFFECTS_BUDGET_US
+#define LED_EFFECTS_BUDGET_US           (100)   // Most time spent rendering per tick (at least one LED is always rendered)
+#endif
+
+#ifndef LED_EFFECTS_BREATHE_PERIOD_US
+#define LED_EFFECTS_BREATHE_PERIOD_US   (3000000)
+#endif
+
+#ifndef LED_EFFECTS_BREATHE_MIN
+#define LED_EFFECTS_BREATHE_MIN         (32)    // Breathing dims to this level (of 255), rather than off
+#endif
+
+#ifndef LED_EFFECTS_RIPPLE_MAX
+#define LED_EFFECTS_RIPPLE_MAX          (4)     // Ripples in flight at once. New presses replace the oldest
+#endif
+
+#ifndef LED_EFFECTS_RIPPLE_US
+#define LED_EFFECTS_RIPPLE_US           (600000)
+#endif
+
+#ifndef LED_EFFECTS_RIPPLE_SPEED
+#define LED_EFFECTS_RIPPLE_SPEED        (20)    // Keys per second
+#endif
+
+#ifndef LED_EFFECTS_TRANSITION_US
+#define LED_EFFECTS_TRANSITION_US       (250000) // Crossfade time on a layer change
+#endif
+
+// Positions are in 1/16ths of a key
+#define LED_EFFECTS_POS_SHIFT           (4)
+#define LED_EFFECTS_RIPPLE_WIDTH        (2 << LED_EFFECTS_POS_SHIFT)
+
+// typedefs
+typedef enum led_effect_t {
+    LED_EFFECT_STATIC,              // The hook colors as they are
+    LED_EFFECT_BREATHING,           // The hook colors fading in and out together
+    LED_EFFECT_REACTIVE,            // Key presses send out a ring of white that passes over the LEDs
+    LED_EFFECT_COUNT
+} led_effect_t;
+
+typedef struct led_effects_ripple_t {
+    bool active;
+    uint8_t row;
+    uint8_t col;
+    uint8_t strength;               // Fades to 0 over the ripple's life (per frame)
+    uint32_t start_us;
+    uint32_t radius;                // In 1/16ths of a key (per frame)
+} led_effects_ripple_t;
+
+typedef struct led_effects_state_t {
+    led_effect_t effect;
+
+    // Frame in progress
+    bool rendering;
+    bool frame_sliced;
+    uint next_led;
+    uint32_t frame_start_us;
+    uint8_t breathe_level;          // Per frame
+    uint16_t transition_progress;   // Per frame, 0 to 256
+    uint8_t frame[LEDS_MAX][3];
+
+    // Last frame handed to the LEDs, which layer transitions fade from
+    uint8_t shown[LEDS_MAX][3];
+
+    uint32_t breathe_phase_us;
+    led_effects_ripple_t ripples[LED_EFFECTS_RIPPLE_MAX];
+    uint next_ripple;
+
+    bool transitioning;
+    uint32_t transition_start_us;
+    uint8_t transition_from[LEDS_MAX][3];
+
+    // Statistics
+    uint32_t frames_shown;
+    uint32_t frames_sliced;         // Frames that needed more than one tick to render
+    uint32_t tick_us_max;           // Longest time spent rendering in one tick
+} led_effects_state_t;
+
+// public functions
+void led_effects_reset(void);
+void led_effects_update(void);
+void led_effects_set(led_effect_t effect);
+void led_effects_next(void);
+led_effect_t led_effects_get(void);
+
+// Event inputs
+void led_effects_on_key_press(uint row, uint col);
+void led_effects_on_layer_change(void);
+
+const led_effects_state_t* led_effects_get_state(void);
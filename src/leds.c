@@ -1,61 +1,119 @@
 #include "leds.h"
 #include "color.h"
 #include "ws2812.h"
+#include "led_effects.h"
+#include "hot_path.h"
 
 #include "pico/stdlib.h"
 
+_Static_assert(LEDS_STRIP_COUNT <= WS2812_STRIPS_MAX, "each LED strip needs its own ws2812 strip");
+
 // defines
-#define LED_TO_U32(i)       (((uint32_t) (leds_state.leds_out[i][0]) << 8)  | \
-                             ((uint32_t) (leds_state.leds_out[i][1]) << 16) | \
-                             (uint32_t) (leds_state.leds_out[i][2]))
+#define LED_TO_WORD(i)      WS2812_WORD(leds_state.leds_out[i][0], leds_state.leds_out[i][1], leds_state.leds_out[i][2])
+#define LEDS_STATE_DEFAULT  { .brightness = 64 }
 
 // statics
-static leds_state_t leds_state = {
-    .leds = { 0 },
-    .leds_out = { 0 },
-    .brightness =  64,
-    .mask = ((1 << LEDS_MAX) - 1),
-    .should_transmit = false
-};
+static leds_state_t leds_state = LEDS_STATE_DEFAULT;
 
 static bool debug_led_state = false;
 
+// Gamma and brightness for every input level, rebuilt when the brightness changes
+static uint8_t brightness_lut[256];
+
+// Double-buffered words in chain order. An LED's word is rebuilt the moment it changes, then the changed range is
+// copied to the transmit buffer just before its strip is sent, so neither costs more than what changed.
+static uint32_t words[LEDS_MAX];
+static uint32_t tx_words[LEDS_MAX];
+
+// Strip each chain position belongs to, and the number ws2812 gave each strip
+static uint8_t chain_strip[LEDS_MAX];
+static int strip_numbers[LEDS_STRIP_COUNT];
+
+// externs
+extern const leds_strip_t leds_strips[LEDS_STRIP_COUNT];
+extern const uint8_t leds_key_map[MATRIX_ROWS][MATRIX_COLS];
+
 // private functions
 static bool leds_is_off(uint index) {
-    bool is_actually_off = (leds_state.leds[index][0] == 0) && (leds_state.leds[index][1] == 0) && (leds_state.leds[index][2] == 0);
-    bool is_configured_off = (leds_state.mask & (1 << index)) == 0;
+    bool is_actually_off = (leds_state.frame[index][0] == 0) && (leds_state.frame[index][1] == 0) && (leds_state.frame[index][2] == 0);
+    bool is_configured_off = (leds_state.disabled[index / 32] & (1u << (index % 32))) != 0;
     return is_actually_off || is_configured_off;
 }
 
-static void leds_compute_brightness_adjusted_color(uint index) {
-    if (!leds_is_off(index)) {
-        uint8_t color[3] = {0};
+static void HOT_PATH_FUNC(leds_mark_dirty)(uint chain_index) {
+    const uint strip = chain_strip[chain_index];
+    const uint position = chain_index - leds_strips[strip].first;
+    leds_dirty_t* dirty = &leds_state.dirty[strip];
 
-        color_rgb2hsl(leds_state.leds[index], color);
-        color[2] = leds_state.brightness;
-        color_hsl2rgb(color, leds_state.leds_out[index]);
+    if (dirty->hi == 0) {
+        dirty->lo = position;
+        dirty->hi = position + 1;
+        leds_state.dirty_strips |= (1u << strip);
+    } else {
+        if (position < dirty->lo) dirty->lo = position;
+        if (position >= dirty->hi) dirty->hi = position + 1;
+    }
+}
+
+static void HOT_PATH_FUNC(leds_compute_brightness_adjusted_color)(uint index) {
+    if (!leds_is_off(index)) {
+        color_apply_lut(brightness_lut, leds_state.frame[index], leds_state.leds_out[index]);
     } else {
         leds_state.leds_out[index][0] = 0;
         leds_state.leds_out[index][1] = 0;
         leds_state.leds_out[index][2] = 0;
     }
+
+    const uint chain_index = LEDS_INDEX_REMAP(index);
+    const uint32_t word = LED_TO_WORD(index);
+    if (words[chain_index] != word) {
+        words[chain_index] = word;
+        leds_mark_dirty(chain_index);
+    }
+}
+
+static void leds_compute_all(void) {
+    for (uint i = 0; i < LEDS_MAX; i++) {
+        leds_compute_brightness_adjusted_color(i);
+    }
+}
+
+// Sends the changed part of a strip. The chain is clocked from its start, so everything up to the last change goes,
+// but the LEDs after it keep what they have and don't need sending.
+static bool HOT_PATH_FUNC(leds_send_strip)(uint strip) {
+    const leds_dirty_t dirty = leds_state.dirty[strip];
+    const uint first = leds_strips[strip].first;
+
+    if (!ws2812_ready(strip_numbers[strip])) return false;
+
+    // Positions outside the dirty range already match, from when they were last sent
+    for (uint i = first + dirty.lo; i < first + dirty.hi; i++) {
+        tx_words[i] = words[i];
+    }
+    ws2812_write_frame(strip_numbers[strip], &tx_words[first], dirty.hi);
+
+    leds_state.dirty[strip] = (leds_dirty_t){0};
+    leds_state.dirty_strips &= ~(1u << strip);
+    return true;
+}
+
+static void leds_set_brightness(uint8_t brightness) {
+    leds_state.brightness = brightness;
+    color_build_brightness_lut(brightness, brightness_lut);
+    leds_compute_all();
 }
 
 // public functions
 void leds_set_color(uint led_index, uint8_t r, uint8_t g, uint8_t b) {
     if (led_index >= LEDS_MAX) return;
 
-    // LED 0 on this board is the rightmost led, so twiddle the index around
     bool led_changed = (leds_state.leds[led_index][0] != r || leds_state.leds[led_index][1] != g || leds_state.leds[led_index][2] != b);
 
     if (led_changed) {
-        leds_state.should_transmit = true;
-
+        // Shown from the effects engine's next frame
         leds_state.leds[led_index][0] = r;
         leds_state.leds[led_index][1] = g;
         leds_state.leds[led_index][2] = b;
-
-        leds_compute_brightness_adjusted_color(led_index);
     }
 }
 
@@ -74,17 +132,58 @@ void leds_set_b(uint led_index, uint8_t value) {
     leds_set_color(led_index, leds_state.leds[led_index][0], leds_state.leds[led_index][1], value);
 }
 
-void leds_write(void) {
-    if (leds_state.should_transmit) {
-        for (uint i = 0; i < LEDS_MAX; i++) {
-            ws2812_write(LED_TO_U32(LEDS_INDEX_REMAP(i)));
+void leds_set_key_color(uint row, uint col, uint8_t r, uint8_t g, uint8_t b) {
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
+    leds_set_color(leds_key_map[row][col], r, g, b);
+}
+
+const uint8_t* HOT_PATH_FUNC(leds_get_color)(uint led_index) {
+    return leds_state.leds[led_index];
+}
+
+void HOT_PATH_FUNC(leds_set_output_color)(uint led_index, const uint8_t* rgb) {
+    uint8_t* frame = leds_state.frame[led_index];
+    if (frame[0] == rgb[0] && frame[1] == rgb[1] && frame[2] == rgb[2]) return;
+
+    frame[0] = rgb[0];
+    frame[1] = rgb[1];
+    frame[2] = rgb[2];
+    leds_compute_brightness_adjusted_color(led_index);
+}
+
+// Never waits on the LEDs, and costs nothing when nothing has changed. Strips with changes queue for the DMA, which
+// takes them in turn as it and they become free. Whatever can't go now goes on a later tick.
+void HOT_PATH_FUNC(leds_write)(void) {
+    if (leds_state.dirty_strips == 0) return;
+
+    for (uint n = 0; n < LEDS_STRIP_COUNT; n++) {
+        const uint strip = (leds_state.next_strip + n) % LEDS_STRIP_COUNT;
+        if ((leds_state.dirty_strips & (1u << strip)) == 0) continue;
+
+        if (leds_send_strip(strip)) {
+            leds_state.next_strip = (strip + 1) % LEDS_STRIP_COUNT;
         }
+
+        // There's one DMA channel, so once a strip has been tried, the rest have to wait
+        break;
     }
-    leds_state.should_transmit = false;
 }
 
 void leds_init(void) {
     ws2812_init();
+    for (uint strip = 0; strip < LEDS_STRIP_COUNT; strip++) {
+        strip_numbers[strip] = ws2812_add_strip(leds_strips[strip].pin);
+        if (strip_numbers[strip] < 0) {
+            panic("No ws2812 strip for LED strip %u\n", strip);
+        }
+
+        for (uint i = 0; i < leds_strips[strip].count; i++) {
+            chain_strip[leds_strips[strip].first + i] = strip;
+        }
+    }
+
+    color_build_brightness_lut(leds_state.brightness, brightness_lut);
+    led_effects_reset();
 
 #ifdef LEDS_HAS_DEBUG_LED
     gpio_init(LEDS_DEBUG_LED_PIN);
@@ -94,41 +193,27 @@ void leds_init(void) {
 }
 
 void leds_reset(void) {
-    leds_state = (leds_state_t) {
-        .leds = { 0 },
-        .leds_out = { 0 },
-        .brightness =  64,
-        .mask = ((1 << LEDS_MAX) - 1),
-        .should_transmit = false
-    };
+    leds_state = (leds_state_t) LEDS_STATE_DEFAULT;
+    color_build_brightness_lut(leds_state.brightness, brightness_lut);
+    leds_compute_all();
+    led_effects_reset();
 }
 
 void leds_brightness_up(void) {
     if (leds_state.brightness < (0x100 - LEDS_BRIGHTNESS_DELTA)) {
-        leds_state.brightness += LEDS_BRIGHTNESS_DELTA;
-
-        for (uint i = 0; i < LEDS_MAX; i++) {
-            leds_compute_brightness_adjusted_color(i);
-        }
-
-        leds_write();
+        leds_set_brightness(leds_state.brightness + LEDS_BRIGHTNESS_DELTA);
     }
 }
 
 void leds_brightness_down(void) {
     if (leds_state.brightness > 0) {
-        leds_state.brightness -= LEDS_BRIGHTNESS_DELTA;
-
-        for (uint i = 0; i < LEDS_MAX; i++) {
-            leds_compute_brightness_adjusted_color(i);
-        }
-
-        leds_write();
+        leds_set_brightness(leds_state.brightness - LEDS_BRIGHTNESS_DELTA);
     }
 }
 
 void leds_toggle_led_enabled(uint led_index) {
-    leds_state.mask ^= (1 << led_index);
+    if (led_index >= LEDS_MAX) return;
+    leds_state.disabled[led_index / 32] ^= (1u << (led_index % 32));
     leds_compute_brightness_adjusted_color(led_index);
 }
 
@@ -9,13 +9,39 @@
 #include "pico/types.h"
 #include "keyboard.h"
 
+// defines
+#define LEDS_NO_LED                 (0xff)  // In leds_key_map, for keys without an LED
+#define LEDS_MASK_WORDS             ((LEDS_MAX + 31) / 32)
+
 // typedefs
+// LEDs are addressed by index, as used by the hooks and effects. LEDS_INDEX_REMAP() gives an LED's position in the
+// chains, which run through the strips in order: a strip's first and count are in chain positions.
+typedef struct leds_strip_t {
+    uint8_t pin;
+    uint16_t first;
+    uint16_t count;
+} leds_strip_t;
+
+typedef struct leds_position_t {
+    uint8_t row;
+    uint8_t col;
+} leds_position_t;
+
+// Chain positions [lo, hi) within a strip that have changed since it was last sent. Clean when hi is 0
+typedef struct leds_dirty_t {
+    uint16_t lo;
+    uint16_t hi;
+} leds_dirty_t;
+
 typedef struct leds_state_t {
-    uint8_t leds[LEDS_MAX][3];
-    uint8_t leds_out[LEDS_MAX][3];
+    uint8_t leds[LEDS_MAX][3];          // Colors set by the keyboard's hooks
+    uint8_t frame[LEDS_MAX][3];         // Colors rendered from those by the effects engine (see led_effects.h)
+    uint8_t leds_out[LEDS_MAX][3];      // The frame, after gamma and brightness
     uint8_t brightness;
-    uint8_t mask;
-    bool should_transmit;
+    uint32_t disabled[LEDS_MASK_WORDS]; // Bit per LED turned off by the user
+    leds_dirty_t dirty[LEDS_STRIP_COUNT];
+    uint32_t dirty_strips;              // Bit per strip waiting to be sent
+    uint next_strip;                    // Where the transmit queue picks up, so every strip gets a turn
 } leds_state_t;
 
 // public functions
@@ -23,6 +49,9 @@ void leds_set_color(uint led_index, uint8_t r, uint8_t g, uint8_t b);
 void leds_set_r(uint led_index, uint8_t value);
 void leds_set_g(uint led_index, uint8_t value);
 void leds_set_b(uint led_index, uint8_t value);
+void leds_set_key_color(uint row, uint col, uint8_t r, uint8_t g, uint8_t b);
+const uint8_t* leds_get_color(uint led_index);
+void leds_set_output_color(uint led_index, const uint8_t* rgb);
 
 void leds_write(void);
 void leds_init(void);
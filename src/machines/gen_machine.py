@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+"""
+Compiles a machine description (src/machines/<name>/machine.json) into C.
+
+Outputs, all written to the output directory:
+  machine_config.h   Matrix, LED and USB constants, plus the LAYOUT_<NAME>() macro
+  matrix_scan_gen.h  A scan specialised to the machine's pins: constant GPIO masks and fully unrolled columns
+  machine_keymap.c   The pin tables, the LED strips and position maps, and the default keymap
+
+Usage: gen_machine.py <machine.json> <output dir>
+"""
+
+import json
+import os
+import sys
+from itertools import zip_longest
+
+HEADER = """/**
+ * Generated by gen_machine.py from {source}. Do not edit.
+ */
+"""
+
+# Layout rows mark a matrix position holding a key with "x" and an empty position with "."
+LAYOUT_KEY = "x"
+LAYOUT_EMPTY = "."
+
+# Index of an LED in the key -> LED map, for keys without one (must match leds.h)
+LEDS_NO_LED = 0xFF
+
+
+class MachineError(Exception):
+    pass
+
+
+def load_machine(path: str) -> dict:
+    with open(path, "r") as f:
+        machine = json.load(f)
+
+    matrix = machine["matrix"]
+    rows = len(matrix["row_pins"])
+    cols = len(matrix["col_pins"])
+
+    if cols > 32:
+        raise MachineError(f"{cols} columns won't fit in a 32-bit row bitmap")
+
+    pins = matrix["row_pins"] + matrix["col_pins"]
+    for pin in pins:
+        if not 0 <= pin < 30:
+            raise MachineError(f"GPIO{pin} is not a user GPIO")
+    if len(set(pins)) != len(pins):
+        raise MachineError("A GPIO is used more than once in the matrix")
+
+    layout = machine["layout"]
+    if len(layout) != rows or any(len(row) != cols for row in layout):
+        raise MachineError(f"Layout must be {rows} rows of {cols} positions")
+    if any(c not in (LAYOUT_KEY, LAYOUT_EMPTY) for row in layout for c in row):
+        raise MachineError(f"Layout positions must be '{LAYOUT_KEY}' or '{LAYOUT_EMPTY}'")
+
+    # Matrix positions of each key, in the order keys are listed in the layout macro and keymap
+    machine["positions"] = [
+        (row, col) for row in range(rows) for col in range(cols) if layout[row][col] == LAYOUT_KEY
+    ]
+
+    leds = machine["leds"]
+    led_count = sum(strip["count"] for strip in leds["strips"])
+    if not 0 < led_count < LEDS_NO_LED:
+        raise MachineError(f"{led_count} LEDs, but there must be between 1 and {LEDS_NO_LED - 1}")
+    for strip in leds["strips"]:
+        if not 0 <= strip["pin"] < 30 or strip["pin"] in pins:
+            raise MachineError(f"LED strip GPIO{strip['pin']} is not a free user GPIO")
+
+    # Matrix position each LED sits over. Without any, the LEDs are spread evenly along the middle row
+    if "positions" in leds:
+        positions = [tuple(pos) for pos in leds["positions"]]
+        if len(positions) != led_count:
+            raise MachineError(f"{len(positions)} LED positions for {led_count} LEDs")
+        if any(not (0 <= row < rows and 0 <= col < cols) for row, col in positions):
+            raise MachineError("An LED position is outside the matrix")
+    else:
+        positions = [(rows // 2, ((2 * i + 1) * cols) // (2 * led_count)) for i in range(led_count)]
+    machine["led_positions"] = positions
+    machine["led_count"] = led_count
+
+    for layer, key_rows in machine["keymap"].items():
+        keys = [key for key_row in key_rows for key in key_row]
+        if len(keys) != len(machine["positions"]):
+            raise MachineError(f"{layer} has {len(keys)} keys, but the layout has {len(machine['positions'])}")
+
+    return machine
+
+
+def gen_config(machine: dict, source: str) -> str:
+    matrix = machine["matrix"]
+    usb = machine["usb"]
+    rows = len(matrix["row_pins"])
+    cols = len(matrix["col_pins"])
+    name = machine["name"].upper()
+
+    out = [HEADER.format(source=source), "#pragma once", ""]
+
+    # Layout macro: arguments in layout order, placed at their matrix positions
+    args = {pos: f"k{i}" for i, pos in enumerate(machine["positions"])}
+    out.append("// Layout")
+    out.append("#define XXX  KC_NONE")
+    out.append(f"#define LAYOUT_{name}({', '.join(args.values())}) {{ \\")
+    for row in range(rows):
+        cells = [args.get((row, col), "XXX") for col in range(cols)]
+        cells = "".join(f"{cell + ',':<5}" for cell in cells[:-1]) + cells[-1]
+        sep = "," if row < rows - 1 else ""
+        out.append(f"    {{{cells}}}{sep} \\")
+    out.append("}")
+    out.append("")
+
+    out.append("// Matrix")
+    out.append(f"#define MATRIX_SCAN_INTERVAL_MS     ({matrix['scan_interval_ms']})")
+    out.append(f"#define MATRIX_ROWS                 ({rows})")
+    out.append(f"#define MATRIX_COLS                 ({cols})")
+    out.append(f"#define MATRIX_SETTLE_NS            ({matrix['settle_ns']})")
+    out.append("#define MATRIX_GENERATED_SCAN       // matrix_scan_gen.h is available")
+    out.append("")
+
+    out.append("// LEDs")
+    out.append(f"#define LEDS_MAX                    ({machine['led_count']})")
+    out.append(f"#define LEDS_STRIP_COUNT            ({len(machine['leds']['strips'])})")
+    out.append("")
+
+    out.append("// USB")
+    out.append(f"#define USB_VID                     (0x{int(usb['vid'], 16):04x})")
+    out.append(f"#define USB_PID                     (0x{int(usb['pid'], 16):04x})")
+    if "report_interval" in usb:
+        out.append(f"#define USB_REPORT_INTERVAL         ({usb['report_interval']})")
+    else:
+        # Report as often as the matrix is scanned
+        out.append("#define USB_REPORT_INTERVAL         MATRIX_SCAN_INTERVAL_MS")
+    # Mouse keys are ticked every time the mouse endpoint is polled, independently of the scan
+    out.append(f"#define USB_MOUSE_REPORT_INTERVAL   ({usb.get('mouse_report_interval', 1)})")
+    out.append(f"#define USB_VENDOR_STRING           {json.dumps(usb['vendor'])}")
+    out.append(f"#define USB_PRODUCT_STRING          {json.dumps(usb['product'])}")
+    out.append("")
+
+    return "\n".join(out)
+
+
+def gen_scan(machine: dict, source: str) -> str:
+    matrix = machine["matrix"]
+
+    out = [HEADER.format(source=source), "#pragma once", ""]
+    out.append("// Included by matrix.c only, after matrix_settle_delay() is defined.")
+    out.append("// Every mask and shift is a constant, so each column is a set, a settle, one read of the GPIO inputs,")
+    out.append("// a bit move per row, then a clear and a settle so the rows discharge before the next column.")
+    out.append("static inline void matrix_scan_generated(uint32_t* pressed) {")
+    out.append("    uint32_t pins;")
+    for col, col_pin in enumerate(matrix["col_pins"]):
+        out.append("")
+        out.append(f"    // Column {col} (GPIO{col_pin})")
+        out.append(f"    gpio_set_mask(1u << {col_pin});")
+        out.append("    matrix_settle_delay();")
+        out.append("    pins = gpio_get_all();")
+        for row, row_pin in enumerate(matrix["row_pins"]):
+            out.append(f"    pressed[{row}] |= ((pins >> {row_pin}) & 1u) << {col};")
+        out.append(f"    gpio_clr_mask(1u << {col_pin});")
+        out.append("    matrix_settle_delay();")
+    out.append("}")
+    out.append("")
+
+    return "\n".join(out)
+
+
+def gen_keymap(machine: dict, source: str) -> str:
+    matrix = machine["matrix"]
+    name = machine["name"]
+
+    out = [HEADER.format(source=source)]
+    out.append('#include "keyboard.h"')
+    out.append('#include "leds.h"')
+    out.append(f'#include "{name}.h"')
+    out.append("")
+    out.append("// extern implementations")
+    out.append(f"uint matrix_cols[MATRIX_COLS] = {{ {', '.join(str(p) for p in matrix['col_pins'])} }};")
+    out.append(f"uint matrix_rows[MATRIX_ROWS] = {{ {', '.join(str(p) for p in matrix['row_pins'])} }};")
+    out.append("")
+
+    # LED strips, each a chain on its own pin. LED indices run through the strips in order
+    out.append("const leds_strip_t leds_strips[LEDS_STRIP_COUNT] = {")
+    first = 0
+    for strip in machine["leds"]["strips"]:
+        out.append(f"    {{ .pin = {strip['pin']}, .first = {first}, .count = {strip['count']} }},")
+        first += strip["count"]
+    out.append("};")
+    out.append("")
+
+    out.append("const leds_position_t leds_positions[LEDS_MAX] = {")
+    for i, (row, col) in enumerate(machine["led_positions"]):
+        out.append(f"    [{i}] = {{ .row = {row}, .col = {col} }},")
+    out.append("};")
+    out.append("")
+
+    # The reverse map, for lighting the LED under a key
+    key_map = {}
+    for i, pos in enumerate(machine["led_positions"]):
+        key_map.setdefault(pos, i)
+    out.append("const uint8_t leds_key_map[MATRIX_ROWS][MATRIX_COLS] = {")
+    for row in range(len(matrix["row_pins"])):
+        cells = [f"0x{key_map.get((row, col), LEDS_NO_LED):02x}" for col in range(len(matrix["col_pins"]))]
+        out.append(f"    {{ {', '.join(cells)} }},")
+    out.append("};")
+    out.append("")
+    out.append("const keymap_entry_t keymap[LAYER_MAX][MATRIX_ROWS][MATRIX_COLS] = {")
+
+    layers = list(machine["keymap"].items())
+    for i, (layer, key_rows) in enumerate(layers):
+        # Align each column of keys to its widest entry
+        widths = [max(len(key) for key in column) for column in zip_longest(*key_rows, fillvalue="")]
+        out.append(f"    [{layer}] = LAYOUT_{name.upper()}(")
+        for j, key_row in enumerate(key_rows):
+            last = j == len(key_rows) - 1
+            cells = [f"{key}," if not (last and k == len(key_row) - 1) else key for k, key in enumerate(key_row)]
+            cells = [cell.ljust(widths[k] + 1) for k, cell in enumerate(cells)]
+            out.append(("        " + " ".join(cells)).rstrip())
+        out.append("    )," if i < len(layers) - 1 else "    )")
+        if i < len(layers) - 1:
+            out.append("")
+    out.append("};")
+    out.append("")
+
+    return "\n".join(out)
+
+
+def write_output(path: str, contents: str):
+    with open(path, "w") as f:
+        f.write(contents)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f"Usage: {sys.argv[0]} <machine.json> <output dir>", file=sys.stderr)
+        sys.exit(1)
+
+    source_path, out_dir = sys.argv[1], sys.argv[2]
+    source = os.path.relpath(source_path, os.path.join(os.path.dirname(__file__), "..", ".."))
+
+    try:
+        machine = load_machine(source_path)
+    except (MachineError, KeyError) as e:
+        print(f"{source_path}: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    os.makedirs(out_dir, exist_ok=True)
+    write_output(os.path.join(out_dir, "machine_config.h"), gen_config(machine, source))
+    write_output(os.path.join(out_dir, "matrix_scan_gen.h"), gen_scan(machine, source))
+    write_output(os.path.join(out_dir, "machine_keymap.c"), gen_keymap(machine, source))
+
+
+if __name__ == "__main__":
+    main()
@@ -42,6 +42,9 @@
 #define KBC_COM_LED3_TOGGLE         (0x0005)
 #define KBC_COM_RESET_TO_BL         (0x0006)
 #define KBC_COM_TOGGLE_SNAKE_MODE   (0x0007)
+#define KBC_COM_NEXT_PROFILE        (0x0008)
+#define KBC_COM_FREEZE_RECORDER     (0x0009)
+#define KBC_COM_NEXT_LED_EFFECT     (0x000a)
 
 #define KBC(command)                (ENTRY_TYPE_KBC | command)
 #define KBC_BRIGHTNESS_UP           KBC(KBC_COM_BRIGHTNESS_UP)
@@ -52,6 +55,9 @@
 #define KBC_LED3_TOGGLE             KBC(KBC_COM_LED3_TOGGLE)
 #define KBC_RESET_TO_BL             KBC(KBC_COM_RESET_TO_BL)
 #define KBC_TOGGLE_SNAKE_MODE       KBC(KBC_COM_TOGGLE_SNAKE_MODE)
+#define KBC_NEXT_PROFILE            KBC(KBC_COM_NEXT_PROFILE)
+#define KBC_FREEZE_RECORDER         KBC(KBC_COM_FREEZE_RECORDER)
+#define KBC_NEXT_LED_EFFECT         KBC(KBC_COM_NEXT_LED_EFFECT)
 #define KBC_INDEX_MASK              (0xffff)
 
 #define BL_RST                  KBC_RESET_TO_BL
@@ -61,6 +67,7 @@
 #define TOG_L3                  KBC_LED3_TOGGLE
 #define L_B_UP                  KBC_BRIGHTNESS_UP
 #define L_B_DN                  KBC_BRIGHTNESS_DOWN
+#define L_FX                    KBC_NEXT_LED_EFFECT
 
 #define LED1_R(mods)            ((mods & (LA_BIT | RA_BIT)) ? 255 : 0)
 #define LED1_G(mods)            ((mods & (LS_BIT | RS_BIT)) ? 255 : 0)
@@ -2,27 +2,8 @@
 
 #include "../../keyboard.h"
 
-// Layout
-#define XXX  KC_NONE
-#define LAYOUT_SPLIT2040(k0, k1, k2, k3, k4, k5, k6, k7, k8, k9, k10, k11, k12, k13, k14, k15, k16, k17, k18, k19, k20, k21, k22, k23, k24, k25, k26, k27, k28, k29, k30, k31, k32, k33, k34, k35, k36, k37, k38, k39, k40, k41, k42, k43, k44, k45, k46, k47) { \
-    {k0,  k1,  k2,  k3,  k4,  k5,  k6,  k7,  k8,  k9,  k10, k11}, \
-    {k12, k13, k14, k15, k16, k17, k18, k19, k20, k21, k22, k23}, \
-    {k24, k25, k26, k27, k28, k29, k30, k31, k32, k33, k34, k35}, \
-    {k36, k37, k38, k39, k40, k41, k42, k43, k44, k45, k46, k47} \
-}
-
-// Matrix
-#define MATRIX_SCAN_INTERVAL_MS     (10)
-#define MATRIX_ROWS                 (4)
-#define MATRIX_COLS                 (12)
-#define MATRIX_SETTLE_ITERATIONS    (25)
-
-// USB
-#define USB_VID                     (0x7083)
-#define USB_PID                     (0x0002)
-#define USB_REPORT_INTERVAL         (10)
-#define USB_VENDOR_STRING           "Francis Stokes"
-#define USB_PRODUCT_STRING          "split2040"
+// Layout, matrix and USB constants are generated from machine.json (see gen_machine.py)
+#include "machine_config.h"
 
 // Bootmagic
 #define BOOTMAGIC_COL               (0)
@@ -54,7 +35,6 @@
 #define MACRO_SIZE_MAX              (32)
 
 // LEDs
-#define LEDS_WS2812_PIN             (6)
-#define LEDS_MAX                    (4)
+// LEDS_MAX and the strips are generated from machine.json
 #define LEDS_BRIGHTNESS_DELTA       (16)
 #define LEDS_INDEX_REMAP(index)     (LEDS_MAX - index - 1)
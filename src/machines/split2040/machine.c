@@ -9,6 +9,9 @@
 #include "../../macro.h"
 #include "../../color.h"
 #include "../../leds.h"
+#include "../../led_effects.h"
+#include "../../kb_config.h"
+#include "../../recorder.h"
 
 #include "pico/bootrom.h"
 
@@ -21,38 +24,7 @@ static const uint8_t layer_colors[LAYER_MAX][3] = {
 };
 
 // extern implementations
-uint matrix_cols[MATRIX_COLS] = { 5, 4, 3, 2, 1, 0, 20, 21, 22, 26, 27, 28 };
-uint matrix_rows[MATRIX_ROWS] = { 19, 18, 17, 16 };
-
-const keymap_entry_t keymap[LAYER_MAX][MATRIX_ROWS][MATRIX_COLS] = {
-    [LAYER_QWERTY] = LAYOUT_SPLIT2040(
-        GRV_ESC,   KC_Q,       KC_W,       KC_E,           KC_R,           KC_T,       /* split */     KC_Y,       KC_U,           KC_I,       KC_O,       KC_P,           KC_BSPC,
-        KC_TAB,    LG_T(KC_A), LA_T(KC_S), LS_T(KC_D),     LC_T(KC_F),     KC_G,       /* split */     KC_H,       LC_T(KC_J),     LS_T(KC_K), LA_T(KC_L), LG_T(KC_SCLN),  KC_QUOTE,
-        KC_LSFT,   KC_Z,       KC_X,       KC_C,           KC_V,           KC_B,       /* split */     KC_N,       KC_M,           KC_COMMA,   KC_DOT,     KC_SLASH,       KC_ENTER,
-        KC_LCTL,   KC_HOME,    KC_LALT,    KC_LGUI,        LOWER,          SPC_ENT,    /* split */     KC_SPC,     RAISE,          END_PD,     HOME_PU,    KC_RSFT,        KC_RCTL
-    ),
-
-    [LAYER_LOWER] = LAYOUT_SPLIT2040(
-        KC_F1,    KC_F2,      KC_F3,      KC_F4,           KC_F5,          KC_F6,       /* split */     KC_F7,     KC_F8,          KC_F9,      KC_F10,     KC_F11,         ____,
-        KC_PTSC,  LG_T(KC_1), LA_T(KC_2), LS_T(KC_3),      LC_T(KC_4),     KC_5,        /* split */     KC_6,      LC_T(KC_7),     LS_T(KC_8), LA_T(KC_9), LG_T(KC_0),     KC_MINUS,
-        ____,     C_LEFT,     C_DOWN,     C_UP,            C_RIGHT,        ____,        /* split */     ____,      KC_LEFT,        KC_DOWN,    KC_UP,      KC_RIGHT,       M_DEREF,
-        ____,     ____,       ____,       ____,            ____,           ____,        /* split */     ____,       ____,          ____,       ____,       ____,           ____
-    ),
-
-    [LAYER_RAISE] = LAYOUT_SPLIT2040(
-        ____,      KC_BRKT_L,  KC_BRKT_R,  LS(KC_BRKT_L),  LS(KC_BRKT_R),  ____,       /* split */      ____,       LS(KC_BSLS),   KC_BSLS,    KC_EQ,      LS(KC_EQ),      KC_DEL,
-        ____,      S_1,        S_2,        S_3,            S_4,            S_5,        /* split */      S_6,        S_7,           S_8,        S_9,        S_0,            S_MINUS,
-        ____,      ____,       ____,       ____,           ____,           ____,       /* split */      ____,       KC_LEFT,       KC_DOWN,    KC_UP,      KC_RIGHT,       ____,
-        KC_CAPS,   ____,       ____,       ____,           ____,           ____,       /* split */      ____,       ____,          ____,       ____,       ____,           ____
-    ),
-
-    [LAYER_FN] = LAYOUT_SPLIT2040(
-        BL_RST,    KC_POWER,   ____,       ____,           ____,           ____,       /* split */     ____,       ____,           KC_BGT_DN,  KC_BGT_UP,  ____,           ____,
-        ____,      ____,       ____,       ____,           RUN_BUILD,      ____,       /* split */     ____,       RUN_TESTS,      KC_VOL_DN,  KC_VOL_UP,  KC_MUTE,        ____,
-        ____,      TOG_L0,     TOG_L1,     TOG_L2,         TOG_L3,         ____,       /* split */     ____,       ____,           L_B_DN,     L_B_UP,     ____,           ____,
-        ____,      ____,       ____,       ____,           ____,           ____,       /* split */     ____,       ____,           ____,       ____,       ____,           ____
-    )
-};
+// matrix_cols, matrix_rows and the default keymap are generated from machine.json
 
 combo_t combos[COMBO_MAX] = {
     [0]  = COMBO2(KC_E,         KC_R,           LS(KC_9)),       // (
@@ -101,6 +73,9 @@ bool kbc_on_key_press(uint row, uint col, keymap_entry_t key) {
             case KBC_COM_LED2_TOGGLE:           leds_toggle_led_enabled(2); matrix_suppress_key_until_release(row, col);    return true;
             case KBC_COM_LED3_TOGGLE:           leds_toggle_led_enabled(3); matrix_suppress_key_until_release(row, col);    return true;
             case KBC_COM_RESET_TO_BL:           reset_usb_boot(0, 0);                                                       return true;
+            case KBC_COM_NEXT_PROFILE:          kb_config_next_profile();   matrix_suppress_key_until_release(row, col);    return true;
+            case KBC_COM_FREEZE_RECORDER:       recorder_freeze(RECORDER_FREEZE_KEY); matrix_suppress_key_until_release(row, col); return true;
+            case KBC_COM_NEXT_LED_EFFECT:       led_effects_next();         matrix_suppress_key_until_release(row, col);    return true;
         }
     }
 
@@ -1,6 +1,8 @@
 #include "macro.h"
 #include "keyboard.h"
 #include "matrix.h"
+#include "recorder.h"
+#include "hot_path.h"
 
 // statics
 static volatile macro_t* macros = NULL;
@@ -8,7 +10,7 @@ static const uint8_t ascii_to_hid_kc[128][2] =  { HID_ASCII_TO_KEYCODE };
 static bool any_macro_active = false;
 
 // private functions
-static void macro_start(uint index) {
+static void HOT_PATH_FUNC(macro_start)(uint index) {
     if (index < MACRO_MAX && macros[index].type != macro_type_unused) {
         any_macro_active = true;
         macros[index].active = true;
@@ -24,7 +26,7 @@ static void macro_start(uint index) {
     }
 }
 
-static void macro_check_any_active(void) {
+static void HOT_PATH_FUNC(macro_check_any_active)(void) {
     for (uint macro_index = 0; macro_index < MACRO_MAX; macro_index++) {
         if (macros[macro_index].type == macro_type_unused) break;
         if (macros[macro_index].active) {
@@ -48,7 +50,7 @@ void macro_reset(void) {
     }
 }
 
-bool macro_on_key_press(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(macro_on_key_press)(uint row, uint col, keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) == ENTRY_TYPE_MACRO) {
         macro_start(key & MACRO_INDEX_MASK);
         return true;
@@ -56,15 +58,15 @@ bool macro_on_key_press(uint row, uint col, keymap_entry_t key) {
     return false;
 }
 
-bool macro_on_key_release(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(macro_on_key_release)(uint row, uint col, keymap_entry_t key) {
     return false;
 }
 
-bool macro_on_virtual_key(keymap_entry_t key) {
+bool HOT_PATH_FUNC(macro_on_virtual_key)(keymap_entry_t key) {
     return macro_on_key_press(0xff, 0xff, key);
 }
 
-bool macro_update(void) {
+bool HOT_PATH_FUNC(macro_update)(void) {
     bool cleared_sent_keys = false;
 
     for (uint macro_index = 0; macro_index < MACRO_MAX; macro_index++) {
@@ -94,6 +96,7 @@ bool macro_update(void) {
                     macros[macro_index].send_string.was_release = false;
                 }
 
+                recorder_log(RECORDER_MACRO_STEP, macro_index, 0, key_code | (modifier << 8));
                 keyboard_send_key(key_code | (modifier << 8));
 
                 if (++macros[macro_index].send_string.index >= (macros[macro_index].send_string.length - 1)) {
@@ -113,6 +116,6 @@ bool macro_update(void) {
     return any_macro_active;
 }
 
-bool macro_any_active(void) {
+bool HOT_PATH_FUNC(macro_any_active)(void) {
     return any_macro_active;
 }
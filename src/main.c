@@ -12,27 +12,50 @@
 #include "keyboard.h"
 #include "kb_config.h"
 #include "leds.h"
+#include "led_effects.h"
+#include "mouse.h"
+#include "perf.h"
+#include "scan_timer.h"
+#include "hot_path.h"
 
-static repeating_timer_t update_timer = {0};
-static bool update_time_elapsed = false;
+static void HOT_PATH_FUNC(run_keyboard_update)(void) {
+    const uint32_t tick_start = perf_begin_tick();
 
-static bool update_timer_callback(repeating_timer_t *rt) {
-    update_time_elapsed = true;
-    return true;
-}
+    uint32_t stage_start = perf_begin();
+    kb_config_apply_pending();
+    perf_end(PERF_STAGE_APPLY_PENDING, stage_start);
 
-static void run_keyboard_update(void) {
+    stage_start = perf_begin();
     matrix_scan();
+    perf_end(PERF_STAGE_MATRIX_SCAN, stage_start);
+
+    stage_start = perf_begin();
     usb_update();
+    perf_end(PERF_STAGE_USB_UPDATE, stage_start);
+
+    stage_start = perf_begin();
+    led_effects_update();
     leds_write();
+    perf_end(PERF_STAGE_LEDS, stage_start);
+
+    perf_end(PERF_STAGE_TICK, tick_start);
+}
+
+static void HOT_PATH_FUNC(run_mouse_update)(void) {
+    const uint32_t stage_start = perf_begin();
+    mouse_tick();
+    usb_update_mouse();
+    perf_end(PERF_STAGE_MOUSE_TICK, stage_start);
 }
 
 int main(void) {
+    perf_init();
     leds_init();
     matrix_init();
     keyboard_init(
         usb_get_kb_hid_descriptor_ptr(),
         usb_get_cc_hid_descriptor_ptr(),
+        usb_get_system_hid_descriptor_ptr(),
         usb_get_mouse_hid_descriptor_ptr()
     );
 
@@ -41,13 +64,15 @@ int main(void) {
     usb_wait_for_device_to_configured();
 
     // After we're configured, setup a repeating timer for scanning the key matrix
-    add_repeating_timer_ms(-MATRIX_SCAN_INTERVAL_MS, update_timer_callback, NULL, &update_timer);
+    scan_timer_start();
 
     while (1) {
-        if (update_time_elapsed) {
-            update_time_elapsed = false;
+        if (scan_timer_begin_tick()) {
             run_keyboard_update();
         }
+        if (usb_begin_mouse_frame()) {
+            run_mouse_update();
+        }
         __wfi();
     }
 }
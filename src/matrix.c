@@ -6,10 +6,13 @@
 
 #include "matrix.h"
 #include "keyboard.h"
+#include "perf.h"
+#include "hot_path.h"
 
 #include <string.h>
 
 #include "pico/stdlib.h"
+#include "hardware/clocks.h"
 
 // statics
 static uint32_t prev_pressed_bitmap[MATRIX_ROWS] = {0};
@@ -19,24 +22,45 @@ static uint32_t pressed_this_scan_bitmap[MATRIX_ROWS] = {0};
 static uint32_t released_this_scan_bitmap[MATRIX_ROWS] = {0};
 static uint32_t suppressed_until_release[MATRIX_ROWS] = {0};
 
+// GPIO masks, computed once from the pin tables so a scan works on whole SIO registers
+static uint32_t col_masks[MATRIX_COLS] = {0};
+static uint32_t row_masks[MATRIX_ROWS] = {0};
+
+// MATRIX_SETTLE_NS in CPU cycles
+static uint32_t settle_cycles = 0;
+
 // externs
 extern uint matrix_cols[MATRIX_COLS];
 extern uint matrix_rows[MATRIX_ROWS];
 
 // private functions
 static inline void matrix_settle_delay(void) {
-    for (uint i = 0; i < MATRIX_SETTLE_ITERATIONS; i++) {
-        asm volatile("nop\n");
+    // Counted in cycles on SysTick, which perf_init() leaves free running at the CPU clock, so the settle can be
+    // shorter than the timer's 1us tick. Open coded rather than busy_wait_us_32() so the scan doesn't call out to
+    // flash (see hot_path.h).
+    const uint32_t start = systick_hw->cvr;
+    while (((start - systick_hw->cvr) & PERF_SYSTICK_MASK) < settle_cycles) {
+        tight_loop_contents();
     }
 }
 
+#ifdef MATRIX_GENERATED_SCAN
+// Unrolled scan for this machine's pins, generated from its machine.json
+#include "matrix_scan_gen.h"
+#endif
+
 // public functions
 void matrix_init(void) {
+    // Rounded up, so the settle is never shorter than asked for
+    settle_cycles = (uint32_t)(((uint64_t)clock_get_hz(clk_sys) * MATRIX_SETTLE_NS + 999999999u) / 1000000000u);
+
     // Scan asserts a high on a column and reads back the rows
     for (uint i = 0; i < MATRIX_COLS; i++) {
         gpio_init(matrix_cols[i]);
         gpio_set_dir(matrix_cols[i], GPIO_OUT);
         gpio_put(matrix_cols[i], false);
+
+        col_masks[i] = 1u << matrix_cols[i];
     }
 
     // Rows are pulled down
@@ -44,6 +68,8 @@ void matrix_init(void) {
         gpio_init(matrix_rows[i]);
         gpio_set_dir(matrix_rows[i], GPIO_IN);
         gpio_pull_down(matrix_rows[i]);
+
+        row_masks[i] = 1u << matrix_rows[i];
     }
 }
 
@@ -57,7 +83,7 @@ void matrix_reset(void) {
     memset(suppressed_until_release, 0, sizeof(suppressed_until_release));
 }
 
-void matrix_scan(void) {
+void HOT_PATH_FUNC(matrix_scan)(void) {
     // Copy the last scan to the previous
     memcpy(prev_pressed_bitmap, pressed_bitmap, sizeof(pressed_bitmap));
 
@@ -67,23 +93,29 @@ void matrix_scan(void) {
     memset(pressed_this_scan_bitmap, 0, sizeof(pressed_this_scan_bitmap));
     memset(released_this_scan_bitmap, 0, sizeof(released_this_scan_bitmap));
 
-    // Scan each column in turn, reading back the rows
+    // Scan each column in turn, reading back the rows. Each column settles again after it's deasserted, as the
+    // row lines (only weakly pulled down) have to discharge before the next column is read.
+#ifdef MATRIX_GENERATED_SCAN
+    matrix_scan_generated(pressed_bitmap);
+#else
     for (uint col = 0; col < MATRIX_COLS; col++) {
         // Assert the column
-        gpio_put(matrix_cols[col], true);
+        gpio_set_mask(col_masks[col]);
         matrix_settle_delay();
 
-        // Scan the rows
+        // Sample every row at once
+        const uint32_t pins = gpio_get_all();
         for (uint row = 0; row < MATRIX_ROWS; row++) {
-            if (gpio_get(matrix_rows[row])) {
+            if (pins & row_masks[row]) {
                 pressed_bitmap[row] |= (1 << col);
             }
         }
 
         // Deassert the column
-        gpio_put(matrix_cols[col], false);
+        gpio_clr_mask(col_masks[col]);
         matrix_settle_delay();
     }
+#endif
 
     // Compute the deltas
     for (uint row = 0; row < MATRIX_ROWS; row++) {
@@ -96,7 +128,7 @@ void matrix_scan(void) {
     keyboard_post_scan();
 }
 
-bool matrix_key_pressed(uint32_t row, uint32_t col, bool also_when_handled) {
+bool HOT_PATH_FUNC(matrix_key_pressed)(uint32_t row, uint32_t col, bool also_when_handled) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return false;
 
     // Start with all currently pressed keys
@@ -113,51 +145,51 @@ bool matrix_key_pressed(uint32_t row, uint32_t col, bool also_when_handled) {
     return ((row_data >> col) & 1) == 1;
 }
 
-bool matrix_key_pressed_this_scan(uint32_t row, uint32_t col) {
+bool HOT_PATH_FUNC(matrix_key_pressed_this_scan)(uint32_t row, uint32_t col) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return false;
     return ((pressed_this_scan_bitmap[row] >> col) & 1) == 1;
 }
 
-bool matrix_key_released_this_scan(uint32_t row, uint32_t col) {
+bool HOT_PATH_FUNC(matrix_key_released_this_scan)(uint32_t row, uint32_t col) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return false;
     return ((released_this_scan_bitmap[row] >> col) & 1) == 1;
 }
 
-void matrix_suppress_held_until_release(void) {
+void HOT_PATH_FUNC(matrix_suppress_held_until_release)(void) {
     for (uint row = 0; row < MATRIX_ROWS; row++) {
         suppressed_until_release[row] |= pressed_bitmap[row];
     }
 }
 
-void matrix_suppress_key_until_release(uint32_t row, uint32_t col) {
+void HOT_PATH_FUNC(matrix_suppress_key_until_release)(uint32_t row, uint32_t col) {
     // Only actually supress the key when it is already held
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
     suppressed_until_release[row] |= (pressed_bitmap[row] & (1 << col));
 }
 
-void matrix_mark_key_as_handled(uint32_t row, uint32_t col) {
+void HOT_PATH_FUNC(matrix_mark_key_as_handled)(uint32_t row, uint32_t col) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
     handled_bitmap[row] |= 1 << col;
 }
 
-void matrix_mark_key_as_unhandled(uint32_t row, uint32_t col) {
+void HOT_PATH_FUNC(matrix_mark_key_as_unhandled)(uint32_t row, uint32_t col) {
     if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
     handled_bitmap[row] &= ~(1 << col);
 }
 
-const uint32_t* matrix_get_pressed_bitmap(void) {
+const uint32_t* HOT_PATH_FUNC(matrix_get_pressed_bitmap)(void) {
     return (const uint32_t*)pressed_bitmap;
 }
 
-const uint32_t* matrix_get_handled_bitmap(void) {
+const uint32_t* HOT_PATH_FUNC(matrix_get_handled_bitmap)(void) {
     return (const uint32_t*)handled_bitmap;
 }
 
-const uint32_t* matrix_get_released_this_scan_bitmap(void) {
+const uint32_t* HOT_PATH_FUNC(matrix_get_released_this_scan_bitmap)(void) {
     return (const uint32_t*)released_this_scan_bitmap;
 }
 
-const uint32_t* matrix_get_pressed_this_scan_bitmap(void) {
+const uint32_t* HOT_PATH_FUNC(matrix_get_pressed_this_scan_bitmap)(void) {
     return (const uint32_t*)pressed_this_scan_bitmap;
 }
 
@@ -1,77 +1,218 @@
 #include "mouse.h"
 #include "matrix.h"
+#include "hot_path.h"
+#include "pico/stdlib.h"
 #include <string.h>
 
 // defines
-#define MOUSE_MOVEMENT_DELTA    (4)
-#define MOUSE_WHEEL_DELTA       (4)
+// Pixels per second * microseconds, to 1/256ths of a pixel
+#define MOUSE_SPEED_US_PER_SUBPIXEL (1000000 >> MOUSE_SUBPIXEL_SHIFT)
 
-// typedefs
-typedef struct mouse_states_t {
-    bool left_click;
-    bool middle_click;
-    bool right_click;
-
-    bool move_left;
-    bool move_right;
-    bool move_up;
-    bool move_down;
-} mouse_states_t;
+_Static_assert(MOUSE_WHEEL_SPEED_MAX * MOUSE_WHEEL_RESOLUTION <= UINT32_MAX / MOUSE_TICK_MAX_US, "wheel steps must fit in 32 bits");
 
 // statics
+static const mouse_curve_t mouse_move_curve = {
+    .speed_min = MOUSE_MOVE_SPEED_MIN,
+    .speed_max = MOUSE_MOVE_SPEED_MAX,
+    .delay_ms = MOUSE_MOVE_DELAY_MS,
+    .accel_ms = MOUSE_MOVE_ACCEL_MS,
+    .shape = MOUSE_MOVE_CURVE,
+};
+
+static const mouse_curve_t mouse_wheel_curve = {
+    .speed_min = MOUSE_WHEEL_SPEED_MIN,
+    .speed_max = MOUSE_WHEEL_SPEED_MAX,
+    .delay_ms = MOUSE_WHEEL_DELAY_MS,
+    .accel_ms = MOUSE_WHEEL_ACCEL_MS,
+    .shape = MOUSE_WHEEL_CURVE,
+};
+
 static mouse_report_t* mouse_report = NULL;
-static mouse_states_t mouse_states = {0};
+static mouse_state_t mouse_state = {0};
+
+// private functions
+static uint32_t HOT_PATH_FUNC(mouse_curve_speed)(const mouse_curve_t* curve, uint32_t held_ms) {
+    if (held_ms <= curve->delay_ms) return curve->speed_min;
+    if (held_ms >= (uint32_t)curve->delay_ms + curve->accel_ms) return curve->speed_max;
+
+    // Progress along the curve, 0 to 256
+    uint32_t progress = ((held_ms - curve->delay_ms) << 8) / curve->accel_ms;
+    if (curve->shape == MOUSE_CURVE_QUADRATIC) {
+        progress = (progress * progress) >> 8;
+    }
+    return curve->speed_min + (((curve->speed_max - curve->speed_min) * progress) >> 8);
+}
+
+// Adds a step to an axis, and returns the whole pixels it now holds. Whatever is left over waits for the next tick
+static int32_t HOT_PATH_FUNC(mouse_take_whole)(int32_t* remainder, int32_t step) {
+    *remainder += step;
+    // Division truncates towards zero, so both directions carry the same way
+    const int32_t whole = *remainder / MOUSE_SUBPIXEL_ONE;
+    *remainder -= whole * MOUSE_SUBPIXEL_ONE;
+    return whole;
+}
+
+static void HOT_PATH_FUNC(mouse_motion_tick)(mouse_motion_t* motion, uint32_t now_us, uint32_t elapsed_us, int32_t* out0, int32_t* out1) {
+    const int32_t dir0 = ((motion->held & MOUSE_DIR_0_POS) ? 1 : 0) - ((motion->held & MOUSE_DIR_0_NEG) ? 1 : 0);
+    const int32_t dir1 = ((motion->held & MOUSE_DIR_1_POS) ? 1 : 0) - ((motion->held & MOUSE_DIR_1_NEG) ? 1 : 0);
+
+    if ((dir0 == 0) && (dir1 == 0)) {
+        motion->speed = 0;
+        *out0 = 0;
+        *out1 = 0;
+        return;
+    }
+
+    motion->speed = mouse_curve_speed(motion->curve, (now_us - motion->start_us) / 1000);
+    int32_t step0 = (int32_t)((motion->speed * motion->units[0] * elapsed_us) / MOUSE_SPEED_US_PER_SUBPIXEL);
+    int32_t step1 = (int32_t)((motion->speed * motion->units[1] * elapsed_us) / MOUSE_SPEED_US_PER_SUBPIXEL);
+    if ((dir0 != 0) && (dir1 != 0)) {
+        step0 = (step0 * MOUSE_DIAGONAL_SCALE) >> 8;
+        step1 = (step1 * MOUSE_DIAGONAL_SCALE) >> 8;
+    }
+
+    *out0 = mouse_take_whole(&motion->remainder[0], dir0 * step0);
+    *out1 = mouse_take_whole(&motion->remainder[1], dir1 * step1);
+}
+
+static inline int16_t mouse_add_clamped(int16_t value, int32_t delta) {
+    // Only reachable if the host stops polling while a key is held
+    const int32_t sum = value + delta;
+    if (sum > INT16_MAX) return INT16_MAX;
+    if (sum < -INT16_MAX) return -INT16_MAX;
+    return (int16_t)sum;
+}
+
+static void HOT_PATH_FUNC(mouse_motion_press)(mouse_motion_t* motion, uint8_t dir) {
+    if (motion->held == 0) {
+        motion->start_us = time_us_32();
+    }
+
+    // The first press on an axis moves one whole step straight away, so a tap nudges by exactly one pixel (or detent)
+    const uint axis = (dir & (MOUSE_DIR_0_NEG | MOUSE_DIR_0_POS)) ? 0 : 1;
+    const uint8_t axis_mask = (axis == 0) ? (MOUSE_DIR_0_NEG | MOUSE_DIR_0_POS) : (MOUSE_DIR_1_NEG | MOUSE_DIR_1_POS);
+    if ((motion->held & axis_mask) == 0) {
+        const bool negative = (dir & (MOUSE_DIR_0_NEG | MOUSE_DIR_1_NEG)) != 0;
+        const int32_t one_step = motion->units[axis] * MOUSE_SUBPIXEL_ONE;
+        motion->remainder[axis] = negative ? -one_step : one_step;
+    }
+
+    motion->held |= dir;
+}
+
+static void HOT_PATH_FUNC(mouse_motion_release)(mouse_motion_t* motion, uint8_t dir) {
+    motion->held &= ~dir;
+
+    // A fraction left on an axis that has stopped would show up as a jump the next time it's used
+    if ((motion->held & (MOUSE_DIR_0_NEG | MOUSE_DIR_0_POS)) == 0) motion->remainder[0] = 0;
+    if ((motion->held & (MOUSE_DIR_1_NEG | MOUSE_DIR_1_POS)) == 0) motion->remainder[1] = 0;
+}
+
+// Finds the motion and direction a mouse action drives. Returns false for the buttons
+static bool HOT_PATH_FUNC(mouse_action_motion)(uint action, mouse_motion_t** motion, uint8_t* dir) {
+    switch (action) {
+        case MOUSE_ACTION_MOVE_LEFT:    *motion = &mouse_state.move;    *dir = MOUSE_DIR_0_NEG; return true;
+        case MOUSE_ACTION_MOVE_RIGHT:   *motion = &mouse_state.move;    *dir = MOUSE_DIR_0_POS; return true;
+        case MOUSE_ACTION_MOVE_UP:      *motion = &mouse_state.move;    *dir = MOUSE_DIR_1_NEG; return true;
+        case MOUSE_ACTION_MOVE_DOWN:    *motion = &mouse_state.move;    *dir = MOUSE_DIR_1_POS; return true;
+        case MOUSE_ACTION_WHEEL_DOWN:   *motion = &mouse_state.scroll;  *dir = MOUSE_DIR_0_NEG; return true;
+        case MOUSE_ACTION_WHEEL_UP:     *motion = &mouse_state.scroll;  *dir = MOUSE_DIR_0_POS; return true;
+        case MOUSE_ACTION_PAN_LEFT:     *motion = &mouse_state.scroll;  *dir = MOUSE_DIR_1_NEG; return true;
+        case MOUSE_ACTION_PAN_RIGHT:    *motion = &mouse_state.scroll;  *dir = MOUSE_DIR_1_POS; return true;
+    }
+    return false;
+}
+
+static uint8_t mouse_action_button(uint action) {
+    switch (action) {
+        case MOUSE_ACTION_LEFT_CLICK:   return MOUSE_BUTTON_LEFT;
+        case MOUSE_ACTION_MIDDLE_CLICK: return MOUSE_BUTTON_MIDDLE;
+        case MOUSE_ACTION_RIGHT_CLICK:  return MOUSE_BUTTON_RIGHT;
+    }
+    return 0;
+}
 
 // public functions
 void mouse_init(mouse_report_t* mouse_report_ref) {
     mouse_report = mouse_report_ref;
+    mouse_reset();
 }
 
 void mouse_reset(void) {
-    memset(&mouse_states, 0, sizeof(mouse_states));
+    // The resolution belongs to the host, so it outlives a reset
+    const uint8_t resolution_report = mouse_state.resolution_report;
+
+    memset(&mouse_state, 0, sizeof(mouse_state));
+    mouse_state.move.curve = &mouse_move_curve;
+    mouse_state.move.units[0] = 1;
+    mouse_state.move.units[1] = 1;
+    mouse_state.scroll.curve = &mouse_wheel_curve;
+    mouse_state.last_tick_us = time_us_32();
+    mouse_on_resolution_report(resolution_report);
 }
 
-bool mouse_update(void) {
-    if (mouse_states.left_click)   mouse_report->buttons |= MOUSE_BUTTON_LEFT;
-    if (mouse_states.middle_click) mouse_report->buttons |= MOUSE_BUTTON_MIDDLE;
-    if (mouse_states.right_click)  mouse_report->buttons |= MOUSE_BUTTON_RIGHT;
-    if (mouse_states.move_left)    mouse_report->x = -MOUSE_MOVEMENT_DELTA;
-    if (mouse_states.move_right)   mouse_report->x = MOUSE_MOVEMENT_DELTA;
-    if (mouse_states.move_up)      mouse_report->y = -MOUSE_MOVEMENT_DELTA;
-    if (mouse_states.move_down)    mouse_report->y = MOUSE_MOVEMENT_DELTA;
+// Called once per scan. Only the buttons follow the scan, motion is added by mouse_tick()
+bool HOT_PATH_FUNC(mouse_update)(void) {
+    mouse_report->buttons |= mouse_state.buttons;
     return false;
 }
 
-bool mouse_on_key_release(uint row, uint col, keymap_entry_t key) {
+// Called each time the host polls the mouse endpoint. Adds whatever whole pixels and detents have built up since the
+// last tick to the report, and returns true if there were any
+bool HOT_PATH_FUNC(mouse_tick)(void) {
+    const uint32_t now_us = time_us_32();
+    const uint32_t elapsed_us = MIN(now_us - mouse_state.last_tick_us, MOUSE_TICK_MAX_US);
+    mouse_state.last_tick_us = now_us;
+
+    if ((mouse_state.move.held | mouse_state.scroll.held) == 0) return false;
+
+    int32_t x, y, wheel, pan;
+    mouse_motion_tick(&mouse_state.move, now_us, elapsed_us, &x, &y);
+    mouse_motion_tick(&mouse_state.scroll, now_us, elapsed_us, &wheel, &pan);
+
+    mouse_report->x = mouse_add_clamped(mouse_report->x, x);
+    mouse_report->y = mouse_add_clamped(mouse_report->y, y);
+    mouse_report->wheel = mouse_add_clamped(mouse_report->wheel, wheel);
+    mouse_report->pan = mouse_add_clamped(mouse_report->pan, pan);
+
+    return (x | y | wheel | pan) != 0;
+}
+
+bool HOT_PATH_FUNC(mouse_on_key_release)(uint row, uint col, keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) != ENTRY_TYPE_MOUSE) return false;
 
-    switch (key & MOUSE_ACTION_MASK) {
-        case MOUSE_ACTION_LEFT_CLICK:   mouse_states.left_click = false;    break;
-        case MOUSE_ACTION_MIDDLE_CLICK: mouse_states.middle_click = false;  break;
-        case MOUSE_ACTION_RIGHT_CLICK:  mouse_states.right_click = false;   break;
-        case MOUSE_ACTION_MOVE_LEFT:    mouse_states.move_left = false;     break;
-        case MOUSE_ACTION_MOVE_RIGHT:   mouse_states.move_right = false;    break;
-        case MOUSE_ACTION_MOVE_UP:      mouse_states.move_up = false;       break;
-        case MOUSE_ACTION_MOVE_DOWN:    mouse_states.move_down = false;     break;
-        default: {
-            // Ignore for now
-        }
+    const uint action = key & MOUSE_ACTION_MASK;
+    mouse_motion_t* motion;
+    uint8_t dir;
+    if (mouse_action_motion(action, &motion, &dir)) {
+        mouse_motion_release(motion, dir);
+    } else {
+        mouse_state.buttons &= ~mouse_action_button(action);
     }
+    return true;
 }
 
-bool mouse_on_key_press(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(mouse_on_key_press)(uint row, uint col, keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) != ENTRY_TYPE_MOUSE) return false;
 
-    switch (key & MOUSE_ACTION_MASK) {
-        case MOUSE_ACTION_LEFT_CLICK:   mouse_states.left_click = true;     break;
-        case MOUSE_ACTION_MIDDLE_CLICK: mouse_states.middle_click = true;   break;
-        case MOUSE_ACTION_RIGHT_CLICK:  mouse_states.right_click = true;    break;
-        case MOUSE_ACTION_MOVE_LEFT:    mouse_states.move_left = true;      break;
-        case MOUSE_ACTION_MOVE_RIGHT:   mouse_states.move_right = true;     break;
-        case MOUSE_ACTION_MOVE_UP:      mouse_states.move_up = true;        break;
-        case MOUSE_ACTION_MOVE_DOWN:    mouse_states.move_down = true;      break;
-        default: {
-            // Ignore for now
-        }
+    const uint action = key & MOUSE_ACTION_MASK;
+    mouse_motion_t* motion;
+    uint8_t dir;
+    if (mouse_action_motion(action, &motion, &dir)) {
+        mouse_motion_press(motion, dir);
+    } else {
+        mouse_state.buttons |= mouse_action_button(action);
     }
+    return true;
+}
+
+// Called from the USB interrupt when the host sets the resolution multiplier feature report
+void mouse_on_resolution_report(uint8_t report) {
+    mouse_state.resolution_report = report & (MOUSE_RESOLUTION_WHEEL | MOUSE_RESOLUTION_PAN);
+    mouse_state.scroll.units[0] = (report & MOUSE_RESOLUTION_WHEEL) ? MOUSE_WHEEL_RESOLUTION : 1;
+    mouse_state.scroll.units[1] = (report & MOUSE_RESOLUTION_PAN) ? MOUSE_WHEEL_RESOLUTION : 1;
+}
+
+uint8_t mouse_get_resolution_report(void) {
+    return mouse_state.resolution_report;
 }
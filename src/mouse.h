@@ -9,9 +9,120 @@
 #include "pico/types.h"
 #include "keyboard.h"
 
+// Key events only record which mouse actions are held. The motion is worked out by mouse_tick(), which runs every time
+// the host polls the mouse endpoint (see usb_begin_mouse_frame()) rather than once per scan. Speeds follow an
+// acceleration curve, and the part of a pixel (or wheel detent) that doesn't make it into one report is carried into
+// the next, so slow speeds are smooth instead of being rounded away.
+
+// defines
+// Pointer speeds are in pixels per second
+#ifndef MOUSE_MOVE_SPEED_MIN
+#define MOUSE_MOVE_SPEED_MIN        (200)
+#endif
+
+#ifndef MOUSE_MOVE_SPEED_MAX
+#define MOUSE_MOVE_SPEED_MAX        (1600)
+#endif
+
+#ifndef MOUSE_MOVE_DELAY_MS
+#define MOUSE_MOVE_DELAY_MS         (200)   // Time held at the minimum speed before accelerating
+#endif
+
+#ifndef MOUSE_MOVE_ACCEL_MS
+#define MOUSE_MOVE_ACCEL_MS         (800)   // Time taken to go from the minimum to the maximum speed
+#endif
+
+#ifndef MOUSE_MOVE_CURVE
+#define MOUSE_MOVE_CURVE            MOUSE_CURVE_QUADRATIC
+#endif
+
+// Wheel and pan speeds are in detents per second
+#ifndef MOUSE_WHEEL_SPEED_MIN
+#define MOUSE_WHEEL_SPEED_MIN       (8)
+#endif
+
+#ifndef MOUSE_WHEEL_SPEED_MAX
+#define MOUSE_WHEEL_SPEED_MAX       (40)
+#endif
+
+#ifndef MOUSE_WHEEL_DELAY_MS
+#define MOUSE_WHEEL_DELAY_MS        (300)
+#endif
+
+#ifndef MOUSE_WHEEL_ACCEL_MS
+#define MOUSE_WHEEL_ACCEL_MS        (1000)
+#endif
+
+#ifndef MOUSE_WHEEL_CURVE
+#define MOUSE_WHEEL_CURVE           MOUSE_CURVE_LINEAR
+#endif
+
+// Wheel counts per detent once the host turns on the resolution multiplier (see usb_descriptors.c). At most 127, as
+// it's a one byte item in the report descriptor
+#ifndef MOUSE_WHEEL_RESOLUTION
+#define MOUSE_WHEEL_RESOLUTION      (120)
+#endif
+
+// Resolution multiplier feature report, one bit per wheel in use (the rest of each 2 bit field is always 0)
+#define MOUSE_RESOLUTION_WHEEL      (1 << 0)
+#define MOUSE_RESOLUTION_PAN        (1 << 2)
+
+// Longest time one tick accounts for, so a stall can't throw the pointer across the screen. This also keeps
+// speed * resolution * elapsed time inside 32 bits
+#define MOUSE_TICK_MAX_US           (50000)
+
+// Motion is kept in 1/256ths of a report count
+#define MOUSE_SUBPIXEL_SHIFT        (8)
+#define MOUSE_SUBPIXEL_ONE          (1 << MOUSE_SUBPIXEL_SHIFT)
+
+// Moving on both axes at once scales each by 1/sqrt(2) (in 1/256ths), so diagonals aren't faster
+#define MOUSE_DIAGONAL_SCALE        (181)
+
+// Held directions of a motion (mouse_motion_t.held). Axis 0 is x or the wheel, axis 1 is y or pan
+#define MOUSE_DIR_0_NEG             (1 << 0)
+#define MOUSE_DIR_0_POS             (1 << 1)
+#define MOUSE_DIR_1_NEG             (1 << 2)
+#define MOUSE_DIR_1_POS             (1 << 3)
+
+// typedefs
+typedef enum mouse_curve_shape_t {
+    MOUSE_CURVE_LINEAR,
+    MOUSE_CURVE_QUADRATIC,          // Eases in: slow to leave the minimum, quick to reach the maximum
+} mouse_curve_shape_t;
+
+typedef struct mouse_curve_t {
+    uint16_t speed_min;
+    uint16_t speed_max;
+    uint16_t delay_ms;
+    uint16_t accel_ms;
+    mouse_curve_shape_t shape;
+} mouse_curve_t;
+
+typedef struct mouse_motion_t {
+    const mouse_curve_t* curve;
+    uint8_t held;                   // MOUSE_DIR_*
+    uint32_t start_us;              // When the first direction was pressed
+    uint32_t speed;                 // Speed at the last tick
+    uint16_t units[2];              // Report counts per pixel or detent, per axis
+    int32_t remainder[2];           // Carried to the next tick, in 1/256ths of a count
+} mouse_motion_t;
+
+typedef struct mouse_state_t {
+    uint8_t buttons;                // MOUSE_BUTTON_*
+    mouse_motion_t move;            // x and y
+    mouse_motion_t scroll;          // Wheel and pan
+    uint8_t resolution_report;      // MOUSE_RESOLUTION_*, as last set by the host
+    uint32_t last_tick_us;
+} mouse_state_t;
+
 // public functions
 void mouse_init(mouse_report_t* mouse_report_ref);
 void mouse_reset(void);
 bool mouse_on_key_release(uint row, uint col, keymap_entry_t key);
 bool mouse_on_key_press(uint row, uint col, keymap_entry_t key);
 bool mouse_update(void);
+bool mouse_tick(void);
+
+// Resolution multiplier feature report, set and read by the host
+void mouse_on_resolution_report(uint8_t report);
+uint8_t mouse_get_resolution_report(void);
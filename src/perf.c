@@ -0,0 +1,123 @@
+#include "perf.h"
+#include "keyboard.h"
+#include "trace.h"
+#include "hot_path.h"
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+
+// typedefs
+typedef struct perf_accumulator_t {
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint32_t count;
+    uint64_t total_cycles;
+} perf_accumulator_t;
+
+// statics
+static perf_accumulator_t accumulators[PERF_STAGE_COUNT] = {0};
+static uint32_t tick_budget_cycles = 0;
+static uint32_t overruns = 0;
+static uint64_t xip_accesses_total = 0;
+static uint64_t xip_misses_total = 0;
+static uint32_t xip_misses_max = 0;
+
+// Reset comes from the config interrupt, so it's deferred to the end of a tick rather than racing the main loop
+static volatile bool reset_requested = false;
+
+// private functions
+static void perf_clear(void) {
+    memset(accumulators, 0, sizeof(accumulators));
+    for (uint i = 0; i < PERF_STAGE_COUNT; i++) {
+        accumulators[i].min_cycles = UINT32_MAX;
+    }
+    overruns = 0;
+    xip_accesses_total = 0;
+    xip_misses_total = 0;
+    xip_misses_max = 0;
+}
+
+static inline void perf_record(perf_stage_t stage, uint32_t start, bool traced) {
+    // The counter runs down, and a single stage never comes close to a full wrap (~130ms at 125MHz)
+    const uint32_t cycles = (start - systick_hw->cvr) & PERF_SYSTICK_MASK;
+    perf_accumulator_t* acc = &accumulators[stage];
+
+    acc->min_cycles = MIN(acc->min_cycles, cycles);
+    acc->max_cycles = MAX(acc->max_cycles, cycles);
+    acc->total_cycles += cycles;
+    acc->count++;
+
+    if (traced && trace_option_enabled(TRACE_OPTION_PERF_SPANS)) {
+        trace2(TRACE_PERF_STAGE, stage, cycles);
+    }
+
+    if (stage == PERF_STAGE_TICK) {
+        if (cycles > tick_budget_cycles) {
+            overruns++;
+        }
+
+        // Counters were cleared by perf_begin_tick()
+        const uint32_t xip_accesses = xip_ctrl_hw->ctr_acc;
+        const uint32_t xip_misses = xip_accesses - xip_ctrl_hw->ctr_hit;
+        xip_accesses_total += xip_accesses;
+        xip_misses_total += xip_misses;
+        xip_misses_max = MAX(xip_misses_max, xip_misses);
+
+        if (reset_requested) {
+            reset_requested = false;
+            perf_clear();
+        }
+    }
+}
+
+// public functions
+void perf_init(void) {
+    // Free running from the processor clock, no interrupt
+    systick_hw->csr = 0;
+    systick_hw->rvr = PERF_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+    tick_budget_cycles = (clock_get_hz(clk_sys) / 1000) * MATRIX_SCAN_INTERVAL_MS;
+    perf_clear();
+}
+
+void HOT_PATH_FUNC(perf_end)(perf_stage_t stage, uint32_t start) {
+    perf_record(stage, start, true);
+}
+
+// perf_end() for spans that are counted in the stats but kept out of the trace stream
+void HOT_PATH_FUNC(perf_end_untraced)(perf_stage_t stage, uint32_t start) {
+    perf_record(stage, start, false);
+}
+
+void perf_reset(void) {
+    reset_requested = true;
+}
+
+void perf_get_stats(perf_summary_t* summary, perf_stage_stats_t* stats) {
+    const uint32_t ticks = accumulators[PERF_STAGE_TICK].count;
+
+    *summary = (perf_summary_t) {
+        .stage_count = PERF_STAGE_COUNT,
+        .flags = HOT_PATH_IN_RAM ? PERF_FLAG_RAM_HOT_PATH : 0,
+        .cpu_hz = clock_get_hz(clk_sys),
+        .tick_budget_cycles = tick_budget_cycles,
+        .overruns = overruns,
+        .xip_accesses_avg = ticks ? (uint32_t)(xip_accesses_total / ticks) : 0,
+        .xip_misses_avg = ticks ? (uint32_t)(xip_misses_total / ticks) : 0,
+        .xip_misses_max = xip_misses_max,
+    };
+
+    for (uint i = 0; i < PERF_STAGE_COUNT; i++) {
+        const perf_accumulator_t* acc = &accumulators[i];
+        stats[i] = (perf_stage_stats_t) {
+            .min_cycles = acc->count ? acc->min_cycles : 0,
+            .avg_cycles = acc->count ? (uint32_t)(acc->total_cycles / acc->count) : 0,
+            .max_cycles = acc->max_cycles,
+            .count = acc->count,
+        };
+    }
+}
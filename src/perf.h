@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+
+// defines
+#define PERF_SYSTICK_MASK           (0x00ffffff) // SysTick is a 24-bit down counter running at the CPU clock
+
+#define PERF_FLAG_RAM_HOT_PATH      (0x01) // Built with KB_RAM_HOT_PATH (see hot_path.h)
+
+// typedefs
+// Stages are reported in this order (PERF_STAGE_NAMES in kb_config.py must match)
+typedef enum perf_stage_t {
+    PERF_STAGE_TICK,            // The whole of run_keyboard_update()
+    PERF_STAGE_APPLY_PENDING,
+    PERF_STAGE_MATRIX_SCAN,     // Includes keyboard_post_scan() and the feature updates below
+    PERF_STAGE_KEY_EVENTS,
+    PERF_STAGE_MOUSE,
+    PERF_STAGE_MACRO,
+    PERF_STAGE_COMBO,
+    PERF_STAGE_TAPHOLD,
+    PERF_STAGE_DOUBLE_TAP,
+    PERF_STAGE_USB_UPDATE,
+    PERF_STAGE_LEDS,
+    PERF_STAGE_MOUSE_TICK,      // mouse_tick() and sending its report, which run at the USB poll rate rather than per tick
+    PERF_STAGE_USB_IRQ,         // Interrupt time, which is also included in whatever stage it interrupted
+    PERF_STAGE_COUNT
+} perf_stage_t;
+
+typedef struct perf_stage_stats_t {
+    uint32_t min_cycles;
+    uint32_t avg_cycles;
+    uint32_t max_cycles;
+    uint32_t count;
+} __packed perf_stage_stats_t;
+
+typedef struct perf_summary_t {
+    uint8_t stage_count;
+    uint8_t flags;                  // PERF_FLAG_*
+    uint8_t padding[2];
+    uint32_t cpu_hz;
+    uint32_t tick_budget_cycles;    // MATRIX_SCAN_INTERVAL_MS worth of cycles
+    uint32_t overruns;              // Ticks that took longer than the budget
+
+    // XIP cache accesses and misses per tick, including any interrupts taken during the tick. A hot path that
+    // runs entirely from RAM should see (close to) no misses.
+    uint32_t xip_accesses_avg;
+    uint32_t xip_misses_avg;
+    uint32_t xip_misses_max;
+} __packed perf_summary_t;
+
+// public functions
+void perf_init(void);
+void perf_end(perf_stage_t stage, uint32_t start);
+void perf_end_untraced(perf_stage_t stage, uint32_t start);
+void perf_reset(void);
+void perf_get_stats(perf_summary_t* summary, perf_stage_stats_t* stats);
+
+// Returns a timestamp to pass to perf_end(). Just a register read, so it's cheap enough to leave in the hot path
+static inline uint32_t perf_begin(void) {
+    return systick_hw->cvr;
+}
+
+// perf_begin() for PERF_STAGE_TICK, which also restarts the XIP cache counters (any write clears them)
+static inline uint32_t perf_begin_tick(void) {
+    xip_ctrl_hw->ctr_acc = 0;
+    xip_ctrl_hw->ctr_hit = 0;
+    return perf_begin();
+}
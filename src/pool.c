@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pool.h"
+#include "hot_path.h"
+
+// public functions
+void pool_init(pool_t* pool, uint32_t capacity, bool ordered) {
+    if (capacity > POOL_CAPACITY_MAX) {
+        capacity = POOL_CAPACITY_MAX;
+    }
+
+    pool->occupied = 0;
+    pool->free_slots = (capacity == 32) ? UINT32_MAX : ((1u << capacity) - 1);
+    pool->ordered = ordered;
+    pool->order_count = 0;
+}
+
+int HOT_PATH_FUNC(pool_alloc)(pool_t* pool) {
+    if (pool->free_slots == 0) return POOL_SLOT_NONE;
+
+    const uint32_t slot = __builtin_ctz(pool->free_slots);
+    const uint32_t bit = 1u << slot;
+    pool->free_slots &= ~bit;
+    pool->occupied |= bit;
+
+    if (pool->ordered) {
+        pool->order[pool->order_count++] = slot;
+    }
+
+    return slot;
+}
+
+void HOT_PATH_FUNC(pool_free)(pool_t* pool, uint32_t slot) {
+    const uint32_t bit = 1u << slot;
+    if ((pool->occupied & bit) == 0) return;
+
+    pool->occupied &= ~bit;
+    pool->free_slots |= bit;
+
+    if (pool->ordered) {
+        // The slot was occupied, so it's in the order list. Find it, then close the gap
+        uint i = 0;
+        while (pool->order[i] != slot) {
+            i++;
+        }
+        pool->order_count--;
+        for (; i < pool->order_count; i++) {
+            pool->order[i] = pool->order[i + 1];
+        }
+    }
+}
+
+void pool_free_all(pool_t* pool) {
+    pool->free_slots |= pool->occupied;
+    pool->occupied = 0;
+    pool->order_count = 0;
+}
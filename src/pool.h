@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+
+// A pool of up to 32 slots tracked by a single occupancy bitmask. The pool only hands out slot indices; users keep
+// their data as arrays indexed by slot (structure-of-arrays), so there are no per-entry pointers. Alloc and free are
+// O(1), and iteration visits occupied slots by counting trailing zeros.
+//
+// Ordered pools also remember the order slots were allocated in, for users that need to process entries oldest
+// first. Freeing from an ordered pool shifts the order list down, which is at most a 32 byte move.
+
+// defines
+#define POOL_CAPACITY_MAX           (32)
+#define POOL_SLOT_NONE              (-1)
+
+// Visits every occupied slot, lowest index first. The set of slots is captured at the start, so slots can be freed
+// (but allocations won't be seen) during the loop.
+#define POOL_FOR_EACH(pool, slot) \
+    for (uint32_t slot##_remaining = (pool)->occupied, slot = 0; \
+         (slot##_remaining != 0) && ((slot = __builtin_ctz(slot##_remaining)), true); \
+         slot##_remaining &= slot##_remaining - 1)
+
+// Visits every occupied slot of an ordered pool, oldest allocation first. Slots must not be freed during the loop.
+#define POOL_FOR_EACH_ORDERED(pool, slot) \
+    for (uint32_t slot##_index = 0, slot = 0; \
+         (slot##_index < (pool)->order_count) && ((slot = (pool)->order[slot##_index]), true); \
+         slot##_index++)
+
+// typedefs
+typedef struct pool_t {
+    uint32_t occupied;                  // Bit n set when slot n is in use
+    uint32_t free_slots;                // Bits for the slots not in use
+    bool ordered;
+    uint8_t order_count;
+    uint8_t order[POOL_CAPACITY_MAX];   // Ordered pools only: occupied slots, oldest first
+} pool_t;
+
+// public functions
+void pool_init(pool_t* pool, uint32_t capacity, bool ordered);
+int pool_alloc(pool_t* pool);
+void pool_free(pool_t* pool, uint32_t slot);
+void pool_free_all(pool_t* pool);
+
+static inline bool pool_is_empty(const pool_t* pool) {
+    return pool->occupied == 0;
+}
+
+static inline uint32_t pool_count(const pool_t* pool) {
+    return __builtin_popcount(pool->occupied);
+}
@@ -0,0 +1,48 @@
+#include "recorder.h"
+
+#include "pico/stdlib.h"
+
+_Static_assert((RECORDER_EVENTS & RECORDER_EVENTS_MASK) == 0, "RECORDER_EVENTS must be a power of 2");
+
+// statics
+recorder_state_t recorder_state = {0};
+
+// public functions
+// Called from the main loop (a freeze key) and the USB interrupt (the host), so both run with interrupts off
+void recorder_freeze(recorder_freeze_reason_t reason) {
+    const uint32_t interrupt_state = save_and_disable_interrupts();
+
+    if (!recorder_state.frozen) {
+        // Mark the point of the freeze, so it can be lined up with whatever the user was doing
+        recorder_log(RECORDER_FROZEN, reason, 0, 0);
+        recorder_state.frozen = true;
+    }
+
+    restore_interrupts(interrupt_state);
+}
+
+// Starts a fresh recording
+void recorder_resume(void) {
+    const uint32_t interrupt_state = save_and_disable_interrupts();
+    recorder_state.head = 0;
+    recorder_state.frozen = false;
+    restore_interrupts(interrupt_state);
+}
+
+uint16_t recorder_get_event_count(void) {
+    return MIN(recorder_state.head, RECORDER_EVENTS);
+}
+
+// Copies events out, oldest first. start is relative to the oldest event still held.
+uint16_t recorder_read(recorder_event_t* dst, uint16_t start, uint16_t count) {
+    const uint16_t available = recorder_get_event_count();
+    if (start >= available) return 0;
+
+    count = MIN(count, available - start);
+    const uint32_t oldest = recorder_state.head - available;
+    for (uint16_t i = 0; i < count; i++) {
+        dst[i] = recorder_state.events[(oldest + start + i) & RECORDER_EVENTS_MASK];
+    }
+
+    return count;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+// defines
+#ifndef RECORDER_EVENTS
+#define RECORDER_EVENTS             (2048) // Must be a power of 2
+#endif
+#define RECORDER_EVENTS_MASK        (RECORDER_EVENTS - 1)
+
+// typedefs
+// Event types are reported as-is to the host (RECORDER_EVENT_NAMES in kb_config.py must match)
+typedef enum recorder_event_type_t {
+    RECORDER_KEY_PRESS,             // arg8 = row, arg16 = col, arg32 = resolved key
+    RECORDER_KEY_RELEASE,           // arg8 = row, arg16 = col, arg32 = resolved key
+    RECORDER_TAPHOLD_TAP,           // arg8 = row, arg16 = col, arg32 = key
+    RECORDER_TAPHOLD_HOLD,          // arg8 = row, arg16 = col, arg32 = key
+    RECORDER_DOUBLE_TAP_SINGLE,     // arg8 = row, arg16 = col, arg32 = key
+    RECORDER_DOUBLE_TAP_DOUBLE,     // arg8 = row, arg16 = col, arg32 = key
+    RECORDER_COMBO_FIRED,           // arg8 = combo index, arg32 = key out
+    RECORDER_COMBO_CANCELLED,       // arg8 = combo index
+    RECORDER_MACRO_STEP,            // arg8 = macro index, arg32 = key sent
+    RECORDER_REPORT_KEYBOARD,       // arg8 = modifiers, arg16 = keys 4-5, arg32 = keys 0-3
+    RECORDER_REPORT_CONSUMER,       // arg8 = report ID, arg16 = first usage (or system controls), arg32 = second | (third << 16)
+    RECORDER_REPORT_MOUSE,          // arg8 = buttons, arg16 = wheel, arg32 = x | (y << 16) (pan isn't recorded)
+    RECORDER_FROZEN,                // arg8 = recorder_freeze_reason_t
+} recorder_event_type_t;
+
+typedef enum recorder_freeze_reason_t {
+    RECORDER_FREEZE_HOST,
+    RECORDER_FREEZE_KEY,
+} recorder_freeze_reason_t;
+
+typedef struct recorder_event_t {
+    uint32_t timestamp_us;
+    uint8_t type;
+    uint8_t arg8;
+    uint16_t arg16;
+    uint32_t arg32;
+} recorder_event_t;
+
+typedef struct recorder_state_t {
+    recorder_event_t events[RECORDER_EVENTS];
+    uint32_t head;                  // Free running, the oldest events are overwritten
+    volatile bool frozen;
+} recorder_state_t;
+
+// Only exposed so that recording can be inlined
+extern recorder_state_t recorder_state;
+
+// public functions
+void recorder_freeze(recorder_freeze_reason_t reason);
+void recorder_resume(void);
+uint16_t recorder_get_event_count(void);
+uint16_t recorder_read(recorder_event_t* dst, uint16_t start, uint16_t count);
+
+// Recording happens from the main loop, but the host freezes and clears the recording from the USB interrupt, so
+// the slot is taken and filled with interrupts off: a timestamp read and four stores
+static inline void recorder_log(recorder_event_type_t type, uint8_t arg8, uint16_t arg16, uint32_t arg32) {
+    const uint32_t interrupt_state = save_and_disable_interrupts();
+
+    if (!recorder_state.frozen) {
+        recorder_event_t* event = &recorder_state.events[recorder_state.head++ & RECORDER_EVENTS_MASK];
+        event->timestamp_us = time_us_32();
+        event->type = type;
+        event->arg8 = arg8;
+        event->arg16 = arg16;
+        event->arg32 = arg32;
+    }
+
+    restore_interrupts(interrupt_state);
+}
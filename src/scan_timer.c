@@ -0,0 +1,111 @@
+#include "scan_timer.h"
+#include "keyboard.h"
+#include "hot_path.h"
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+// defines
+#define SCAN_TIMER_PERIOD_US        (MATRIX_SCAN_INTERVAL_MS * 1000)
+
+// statics
+static repeating_timer_t scan_timer = {0};
+
+// Written by the timer callback
+static volatile bool tick_pending = false;
+static volatile uint32_t tick_time_us = 0;
+static uint32_t last_callback_us = 0;
+static uint64_t jitter_abs_total_us = 0;
+static uint32_t jitter_samples = 0;
+
+// Written by the main loop
+static uint32_t last_tick_time_us = 0;
+static uint32_t elapsed_remainder_us = 0;
+static uint16_t elapsed_ms = 0;
+
+static scan_timing_stats_t stats = {0};
+
+// Reset comes from the config interrupt, so it's applied when the main loop next takes a tick
+static volatile bool reset_requested = false;
+
+// private functions
+static void scan_timer_clear_stats(void) {
+    stats = (scan_timing_stats_t) {
+        .jitter_min_us = INT32_MAX,
+        .jitter_max_us = INT32_MIN,
+    };
+    jitter_abs_total_us = 0;
+    jitter_samples = 0;
+}
+
+static bool HOT_PATH_FUNC(scan_timer_callback)(repeating_timer_t *rt) {
+    const uint32_t now = time_us_32();
+
+    const int32_t jitter_us = (int32_t)(now - last_callback_us) - SCAN_TIMER_PERIOD_US;
+    stats.jitter_min_us = MIN(stats.jitter_min_us, jitter_us);
+    stats.jitter_max_us = MAX(stats.jitter_max_us, jitter_us);
+    jitter_abs_total_us += (jitter_us < 0) ? -jitter_us : jitter_us;
+    jitter_samples++;
+    last_callback_us = now;
+
+    // The main loop hasn't got to the last tick yet, so this one merges with it
+    if (tick_pending) {
+        stats.missed_ticks++;
+    }
+
+    tick_time_us = now;
+    tick_pending = true;
+    return true;
+}
+
+// public functions
+void scan_timer_start(void) {
+    scan_timer_clear_stats();
+
+    last_callback_us = time_us_32();
+    last_tick_time_us = last_callback_us;
+    add_repeating_timer_ms(-MATRIX_SCAN_INTERVAL_MS, scan_timer_callback, NULL, &scan_timer);
+}
+
+// Returns true if a tick is due, and works out how much real time it covers (see scan_timer_get_elapsed_ms)
+bool HOT_PATH_FUNC(scan_timer_begin_tick)(void) {
+    if (!tick_pending) return false;
+
+    uint32_t interrupt_state = save_and_disable_interrupts();
+    const uint32_t this_tick_us = tick_time_us;
+    tick_pending = false;
+    if (reset_requested) {
+        reset_requested = false;
+        scan_timer_clear_stats();
+    }
+    restore_interrupts(interrupt_state);
+
+    stats.ticks++;
+    stats.latency_max_us = MAX(stats.latency_max_us, time_us_32() - this_tick_us);
+
+    // Carry the sub-millisecond remainder so that the engines' timers don't drift
+    const uint32_t elapsed_us = (this_tick_us - last_tick_time_us) + elapsed_remainder_us;
+    last_tick_time_us = this_tick_us;
+    elapsed_remainder_us = elapsed_us % 1000;
+    elapsed_ms = MIN(elapsed_us / 1000, SCAN_TIMER_ELAPSED_MAX_MS);
+
+    return true;
+}
+
+// Real time since the previous tick, which is MATRIX_SCAN_INTERVAL_MS unless ticks were delayed or merged
+uint16_t HOT_PATH_FUNC(scan_timer_get_elapsed_ms)(void) {
+    return elapsed_ms;
+}
+
+void scan_timer_get_stats(scan_timing_stats_t* dst) {
+    *dst = stats;
+    dst->jitter_avg_us = jitter_samples ? (uint32_t)(jitter_abs_total_us / jitter_samples) : 0;
+    if (jitter_samples == 0) {
+        dst->jitter_min_us = 0;
+        dst->jitter_max_us = 0;
+    }
+}
+
+void scan_timer_reset_stats(void) {
+    reset_requested = true;
+}
@@ -0,0 +1,30 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+
+// defines
+// Upper bound on the elapsed time handed to the feature engines, so a long stall can't overflow their 16-bit timers
+#define SCAN_TIMER_ELAPSED_MAX_MS   (1000)
+
+// typedefs
+typedef struct scan_timing_stats_t {
+    uint32_t ticks;                 // Ticks consumed by the main loop
+    uint32_t missed_ticks;          // Timer periods that elapsed while the previous tick was still pending
+    int32_t jitter_min_us;          // Timer period minus the nominal period, as measured in the timer callback
+    int32_t jitter_max_us;
+    uint32_t jitter_avg_us;         // Mean absolute jitter
+    uint32_t latency_max_us;        // Longest delay between the timer firing and the update starting
+} __packed scan_timing_stats_t;
+
+// public functions
+void scan_timer_start(void);
+bool scan_timer_begin_tick(void);
+uint16_t scan_timer_get_elapsed_ms(void);
+void scan_timer_get_stats(scan_timing_stats_t* stats);
+void scan_timer_reset_stats(void);
@@ -1,5 +1,7 @@
 #include "taphold.h"
 #include "matrix.h"
+#include "recorder.h"
+#include "hot_path.h"
 
 // defines
 #define MAX_NUM_HOLD_TIME_OFFSETS   (10)
@@ -12,6 +14,7 @@ typedef struct taphold_hold_time_offset_t {
 
 // statics
 static taphold_state_t tapholds = {0};
+static uint16_t hold_delay_ms = TAP_HOLD_DELAY_MS;
 static const taphold_hold_time_offset_t time_offsets[MAX_NUM_HOLD_TIME_OFFSETS] = {
     [0] = { KC_D,     -50},
     [1] = { KC_K,     -50},
@@ -26,7 +29,7 @@ static const taphold_hold_time_offset_t time_offsets[MAX_NUM_HOLD_TIME_OFFSETS]
 };
 
 // private functions
-static int16_t taphold_get_time_offset_for_key(keymap_entry_t key) {
+static int16_t HOT_PATH_FUNC(taphold_get_time_offset_for_key)(keymap_entry_t key) {
     for (uint i = 0; i < MAX_NUM_HOLD_TIME_OFFSETS; i++) {
         if (time_offsets[i].key == key) {
             return time_offsets[i].time_offset;
@@ -37,98 +40,76 @@ static int16_t taphold_get_time_offset_for_key(keymap_entry_t key) {
 
 // public functions
 void taphold_init(void) {
-    lla_init(
-        &tapholds.allocator,
-        tapholds.data_array,
-        tapholds.node_array,
-        TAP_HOLD_MAX,
-        sizeof(taphold_data_t)
-    );
+    pool_init(&tapholds.pool, TAP_HOLD_MAX, true);
 }
 
 void taphold_reset(void) {
-    lla_free_all(&tapholds.allocator);
+    pool_free_all(&tapholds.pool);
 }
 
-bool taphold_update(void) {
-    ll_node_t* current_node = tapholds.allocator.active_head;
-    taphold_data_t* current_taphold = NULL;
-    keymap_entry_t key = KC_NONE;
-    uint16_t key_time_offset = 0;
-    uint16_t computed_hold_time = TAP_HOLD_DELAY_MS;
+void taphold_set_delay(uint16_t delay_ms) {
+    hold_delay_ms = delay_ms;
+}
+
+bool HOT_PATH_FUNC(taphold_update)(uint16_t elapsed_ms) {
     bool there_are_active_undetermined_tapholds = false;
 
-    while (current_node != NULL) {
-        current_taphold = (taphold_data_t*)current_node->data;
-        key = keyboard_resolve_key(current_taphold->row, current_taphold->col);
-        key_time_offset = taphold_get_time_offset_for_key(key);
-        computed_hold_time = TAP_HOLD_DELAY_MS + key_time_offset;
+    POOL_FOR_EACH_ORDERED(&tapholds.pool, slot) {
+        const uint16_t hold_time = tapholds.hold_time[slot];
 
         // Update the timer
-        current_taphold->hold_counter += MATRIX_SCAN_INTERVAL_MS;
-        if (current_taphold->hold_counter > computed_hold_time) {
-            current_taphold->hold_counter = computed_hold_time;
+        const bool was_held = tapholds.hold_counter[slot] == hold_time;
+        tapholds.hold_counter[slot] += elapsed_ms;
+        if (tapholds.hold_counter[slot] > hold_time) {
+            const keymap_entry_t key = tapholds.key[slot];
+            if (!was_held) {
+                recorder_log(RECORDER_TAPHOLD_HOLD, tapholds.row[slot], tapholds.col[slot], key);
+            }
+            tapholds.hold_counter[slot] = hold_time;
             keyboard_send_key(ENTRY_ARG8(key) | (ENTRY_ARG4(key) << 8));
         } else {
             there_are_active_undetermined_tapholds = true;
         }
-
-        // On to the next
-        current_node = current_node->next;
     }
 
     return there_are_active_undetermined_tapholds;
 }
 
-bool taphold_on_key_release(uint row, uint col, keymap_entry_t key) {
-    ll_node_t* current_node = tapholds.allocator.active_head;
-    taphold_data_t* current_taphold = NULL;
-    keymap_entry_t tap_key = KC_NONE;
-    uint16_t key_time_offset = 0;
-    uint16_t computed_hold_time = TAP_HOLD_DELAY_MS;
+bool HOT_PATH_FUNC(taphold_on_key_release)(uint row, uint col, keymap_entry_t key) {
     bool key_handled = false;
 
-    while (current_node != NULL) {
-        current_taphold = (taphold_data_t*)current_node->data;
-        tap_key = keyboard_resolve_key(current_taphold->row, current_taphold->col);
+    POOL_FOR_EACH(&tapholds.pool, slot) {
+        // Was the tap key released? Matched by position, since the key may resolve differently now
+        if ((row != tapholds.row[slot]) || (col != tapholds.col[slot])) continue;
 
-        // Was the tap key released?
-        if ((tap_key == key) && (row == current_taphold->row) && (col == current_taphold->col)) {
-            key_handled = true;
-            key_time_offset = taphold_get_time_offset_for_key(tap_key);
-            computed_hold_time = TAP_HOLD_DELAY_MS + key_time_offset;
+        key_handled = true;
 
-            // Is it still within the tapping period?
-            if (current_taphold->hold_counter < computed_hold_time) {
-                // It was, send the key data
-                keyboard_send_key(tap_key & 0xfff);
-            }
-
-            // Either way, the key is released, so we can free this node
-            ll_node_t* next_current = current_node->next;
-            lla_free(&tapholds.allocator, current_node);
-            current_node = next_current;
-            continue;
+        // Is it still within the tapping period?
+        if (tapholds.hold_counter[slot] < tapholds.hold_time[slot]) {
+            // It was, send the key data
+            const keymap_entry_t tap_key = tapholds.key[slot];
+            recorder_log(RECORDER_TAPHOLD_TAP, row, col, tap_key);
+            keyboard_send_key(tap_key & 0xfff);
         }
 
-        // On to the next
-        current_node = current_node->next;
+        // Either way, the key is released, so we can free this slot
+        pool_free(&tapholds.pool, slot);
     }
 
     return key_handled;
 }
 
-bool taphold_on_key_press(uint row, uint col, keymap_entry_t key) {
+bool HOT_PATH_FUNC(taphold_on_key_press)(uint row, uint col, keymap_entry_t key) {
     if ((key & ENTRY_TYPE_MASK) == ENTRY_TYPE_TAPHOLD) {
-        // Create a new taphold node from the pool
-        ll_node_t* taphold_node = lla_alloc_tail(&tapholds.allocator);
-        if (taphold_node != NULL) {
+        // Take a slot from the pool
+        const int slot = pool_alloc(&tapholds.pool);
+        if (slot != POOL_SLOT_NONE) {
             // Initialise the data
-            taphold_data_t* taphold = (taphold_data_t*)taphold_node->data;
-            taphold->hold_counter = 0;
-            taphold->layer = keyboard_get_current_layer();
-            taphold->col = col;
-            taphold->row = row;
+            tapholds.hold_counter[slot] = 0;
+            tapholds.hold_time[slot] = hold_delay_ms + taphold_get_time_offset_for_key(key);
+            tapholds.key[slot] = key;
+            tapholds.col[slot] = col;
+            tapholds.row[slot] = row;
         }
         matrix_mark_key_as_handled(row, col);
         return true;
@@ -136,18 +117,11 @@ bool taphold_on_key_press(uint row, uint col, keymap_entry_t key) {
     return false;
 }
 
-bool tapholds_any_active(void) {
-    ll_node_t* current_node = tapholds.allocator.active_head;
-    taphold_data_t* current_taphold = NULL;
-    keymap_entry_t tap_key = KC_NONE;
-
-    while (current_node != NULL) {
-        current_taphold = (taphold_data_t*)current_node->data;
-        tap_key = keyboard_resolve_key(current_taphold->row, current_taphold->col);
-        if (current_taphold->hold_counter < (TAP_HOLD_DELAY_MS + taphold_get_time_offset_for_key(tap_key))) {
+bool HOT_PATH_FUNC(tapholds_any_active)(void) {
+    POOL_FOR_EACH(&tapholds.pool, slot) {
+        if (tapholds.hold_counter[slot] < tapholds.hold_time[slot]) {
             return true;
         }
-        current_node = current_node->next;
     }
 
     return false;
@@ -7,27 +7,26 @@
 #pragma once
 
 #include "pico/types.h"
-#include "ll_alloc.h"
+#include "pool.h"
 #include "keyboard.h"
 
 // typedefs
-typedef struct taphold_data_t {
-    uint8_t row;
-    uint8_t col;
-    uint8_t layer;
-    uint16_t hold_counter;
-} taphold_data_t;
-
+// Active tapholds, one pool slot each. Ordered, so held keys are sent in the order they were pressed.
+// The entry and hold time are captured at press, so a layer change mid-hold can't change what the key does.
 typedef struct taphold_state_t {
-    taphold_data_t data_array[TAP_HOLD_MAX];
-    ll_node_t node_array[TAP_HOLD_MAX];
-    ll_allocator_t allocator;
+    pool_t pool;
+    uint8_t row[TAP_HOLD_MAX];
+    uint8_t col[TAP_HOLD_MAX];
+    keymap_entry_t key[TAP_HOLD_MAX];
+    uint16_t hold_time[TAP_HOLD_MAX];           // Delay plus the key's offset, in ms
+    uint16_t hold_counter[TAP_HOLD_MAX];
 } taphold_state_t;
 
 // public functions
 void taphold_init(void);
 void taphold_reset(void);
+void taphold_set_delay(uint16_t delay_ms);
 bool taphold_on_key_release(uint row, uint col, keymap_entry_t key);
 bool taphold_on_key_press(uint row, uint col, keymap_entry_t key);
-bool taphold_update(void);
+bool taphold_update(uint16_t elapsed_ms);
 bool tapholds_any_active(void);
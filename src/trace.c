@@ -0,0 +1,107 @@
+#include "trace.h"
+#include "hot_path.h"
+
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+
+#include <string.h>
+
+// defines
+#define TRACE_RING_MASK             (TRACE_RING_WORDS - 1)
+#define TRACE_FORMAT_STRING(id, format) format "\0"
+
+_Static_assert((TRACE_RING_WORDS & TRACE_RING_MASK) == 0, "TRACE_RING_WORDS must be a power of 2");
+_Static_assert((sizeof(trace_stream_header_t) % sizeof(uint32_t)) == 0, "stream packet words must stay word aligned");
+
+// typedefs
+typedef struct trace_ring_t {
+    uint32_t words[TRACE_RING_WORDS];
+    uint32_t head;      // Free running word counters, masked on access
+    uint32_t tail;
+    uint32_t dropped;   // Records that didn't fit. Unread data is never overwritten
+} trace_ring_t;
+
+// statics
+static trace_ring_t trace_ring = {0};
+volatile uint32_t trace_options = 0;
+
+static uint16_t stream_sequence = 0;
+static uint32_t stream_reported_dropped = 0;
+
+// All format strings, NUL separated and in id order, for the host to fetch
+static const char trace_formats[] = TRACE_FORMATS(TRACE_FORMAT_STRING);
+
+// public functions
+void HOT_PATH_FUNC(trace_record)(trace_id_t id, uint32_t argc, const uint32_t* args) {
+    const uint32_t words = TRACE_HEADER_WORDS + argc;
+
+    // Records can come from the main loop and from interrupts, so the reservation and the write happen together
+    uint32_t interrupt_state = save_and_disable_interrupts();
+
+    const uint32_t head = trace_ring.head;
+    if (TRACE_RING_WORDS - (head - trace_ring.tail) < words) {
+        trace_ring.dropped++;
+    } else {
+        trace_ring.words[head & TRACE_RING_MASK] = TRACE_RECORD_MARKER | (argc << TRACE_RECORD_ARGC_SHIFT) | id;
+        trace_ring.words[(head + 1) & TRACE_RING_MASK] = time_us_32();
+        for (uint32_t i = 0; i < argc; i++) {
+            trace_ring.words[(head + TRACE_HEADER_WORDS + i) & TRACE_RING_MASK] = args[i];
+        }
+        trace_ring.head = head + words;
+    }
+
+    restore_interrupts(interrupt_state);
+}
+
+// Copies out up to max_words of the oldest unread words. Records may be split across reads.
+uint16_t HOT_PATH_FUNC(trace_read)(uint32_t* dst, uint16_t max_words) {
+    uint32_t interrupt_state = save_and_disable_interrupts();
+
+    const uint32_t tail = trace_ring.tail;
+    const uint32_t available = trace_ring.head - tail;
+    const uint16_t words = MIN(available, max_words);
+
+    for (uint16_t i = 0; i < words; i++) {
+        dst[i] = trace_ring.words[(tail + i) & TRACE_RING_MASK];
+    }
+    trace_ring.tail = tail + words;
+
+    restore_interrupts(interrupt_state);
+    return words;
+}
+
+uint32_t HOT_PATH_FUNC(trace_get_dropped)(void) {
+    return trace_ring.dropped;
+}
+
+// Builds the next streaming packet into packet (TRACE_STREAM_PACKET_SIZE bytes, word aligned). The USB layer passes
+// its endpoint buffer, so the words go straight from the ring to the wire. Returns the packet length, or 0 when there
+// is nothing new to send, in which case the endpoint should be left idle.
+uint16_t HOT_PATH_FUNC(trace_stream_fill)(uint8_t* packet) {
+    const uint16_t word_count = trace_read((uint32_t*)(packet + sizeof(trace_stream_header_t)), TRACE_STREAM_WORDS_MAX);
+    const uint32_t dropped = trace_get_dropped();
+
+    if (word_count == 0 && dropped == stream_reported_dropped) {
+        return 0;
+    }
+
+    trace_stream_header_t header = {
+        .sequence = stream_sequence++,
+        .word_count = word_count,
+        .flags = (dropped != stream_reported_dropped) ? TRACE_STREAM_FLAG_OVERFLOW : 0,
+        .dropped = dropped,
+    };
+    stream_reported_dropped = dropped;
+
+    memcpy(packet, &header, sizeof(header));
+    return sizeof(header) + (word_count * sizeof(uint32_t));
+}
+
+void trace_set_options(uint32_t options) {
+    trace_options = options;
+}
+
+const char* trace_get_formats(uint16_t* length) {
+    *length = sizeof(trace_formats);
+    return trace_formats;
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+#include "trace_formats.h"
+
+// defines
+#define TRACE_RING_WORDS            (1024) // Must be a power of 2
+#define TRACE_HEADER_WORDS          (2)
+#define TRACE_ARGS_MAX              (4)
+
+// Record header word: bits 0-15 event id, bits 16-23 argument count, bits 24-31 marker (to resync a stream)
+#define TRACE_RECORD_MARKER         (0xa5000000)
+#define TRACE_RECORD_MARKER_MASK    (0xff000000)
+#define TRACE_RECORD_ARGC_SHIFT     (16)
+
+// Streaming endpoint packets: a trace_stream_header_t followed by word_count trace words
+#define TRACE_STREAM_PACKET_SIZE    (64)
+#define TRACE_STREAM_WORDS_MAX      ((TRACE_STREAM_PACKET_SIZE - sizeof(trace_stream_header_t)) / sizeof(uint32_t))
+#define TRACE_STREAM_FLAG_OVERFLOW  (0x01) // Records were dropped since the previous packet
+
+// High rate trace points that are off unless the host asks for them (SET_TRACE_OPTIONS)
+#define TRACE_OPTION_PERF_SPANS     (0x01) // A TRACE_PERF_STAGE record as every perf stage ends
+#define TRACE_OPTION_USB_BUFFERS    (0x02) // A TRACE_USB_BUFFERS record for every buffer status interrupt
+
+// typedefs
+#define TRACE_ENUM_ENTRY(id, format) id,
+typedef enum trace_id_t {
+    TRACE_FORMATS(TRACE_ENUM_ENTRY)
+    TRACE_ID_COUNT
+} trace_id_t;
+#undef TRACE_ENUM_ENTRY
+
+typedef struct trace_stream_header_t {
+    uint16_t sequence;              // Incremented for every packet, so the host can spot lost packets
+    uint8_t word_count;
+    uint8_t flags;                  // TRACE_STREAM_FLAG_*
+    uint32_t dropped;               // Total records dropped since boot
+} __packed trace_stream_header_t;
+
+// public functions
+void trace_record(trace_id_t id, uint32_t argc, const uint32_t* args);
+uint16_t trace_read(uint32_t* dst, uint16_t max_words);
+uint32_t trace_get_dropped(void);
+const char* trace_get_formats(uint16_t* length);
+uint16_t trace_stream_fill(uint8_t* packet);
+void trace_set_options(uint32_t options);
+
+// Only exposed so that option checks can be inlined
+extern volatile uint32_t trace_options;
+
+static inline bool trace_option_enabled(uint32_t option) {
+    return (trace_options & option) != 0;
+}
+
+// A record is the header word, a time_us_32() timestamp, then the raw arguments
+static inline void trace0(trace_id_t id) {
+    trace_record(id, 0, NULL);
+}
+
+static inline void trace1(trace_id_t id, uint32_t a0) {
+    const uint32_t args[] = { a0 };
+    trace_record(id, 1, args);
+}
+
+static inline void trace2(trace_id_t id, uint32_t a0, uint32_t a1) {
+    const uint32_t args[] = { a0, a1 };
+    trace_record(id, 2, args);
+}
+
+static inline void trace3(trace_id_t id, uint32_t a0, uint32_t a1, uint32_t a2) {
+    const uint32_t args[] = { a0, a1, a2 };
+    trace_record(id, 3, args);
+}
+
+static inline void trace4(trace_id_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    const uint32_t args[] = { a0, a1, a2, a3 };
+    trace_record(id, 4, args);
+}
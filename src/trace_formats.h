@@ -0,0 +1,19 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+// Every trace event and its host-side format string. Arguments are raw 32-bit words, so formats should only use
+// integer conversions (%u, %d, %x, %08x, %c). New events go at the end, so existing IDs don't change.
+#define TRACE_FORMATS(X)                                                                        \
+    X(TRACE_COMBO_FIRED,                "combo %u fired -> 0x%08x")                             \
+    X(TRACE_KB_CONFIG_CRC_MISMATCH,     "kb_config: dropped request 0x%02x with bad CRC")       \
+    X(TRACE_KB_CONFIG_SAVE_TOO_LARGE,   "kb_config: config too large to save")                  \
+    X(TRACE_KB_CONFIG_PROFILE_ACTIVATED,"kb_config: profile %u active (from flash: %u)")       \
+    X(TRACE_KEY_PRESS,                  "key press %u,%u -> 0x%08x")                            \
+    X(TRACE_KEY_RELEASE,                "key release %u,%u -> 0x%08x")                          \
+    X(TRACE_PERF_STAGE,                 "stage %u took %u cycles")                              \
+    X(TRACE_USB_BUFFERS,                "usb buffers complete 0x%08x")
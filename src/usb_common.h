@@ -144,16 +144,37 @@ struct usb_hid_descriptor
   uint16_t wReportLength;   /**< the total size of the Report descriptor. */
 } __attribute__((packed));
 
+// The consumer and system reports share the consumer control interface, told apart by their report IDs
+#define USB_REPORT_ID_CONSUMER      (1)
+#define USB_REPORT_ID_SYSTEM        (2)
+
+// Consumer keys that can be held at once
+#define CONSUMER_USAGES_MAX         (4)
+
+typedef struct consumer_report_t {
+    uint8_t report_id;
+    uint16_t usages[CONSUMER_USAGES_MAX];   // Unused slots are 0
+} __packed consumer_report_t;
+
+typedef struct system_report_t {
+    uint8_t report_id;
+    uint8_t controls;   // One bit per usage, from HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN to HID_USAGE_DESKTOP_SYSTEM_WAKE_UP
+} __packed system_report_t;
+
 typedef struct mouse_report_t {
     uint8_t buttons;
-    int8_t x;
-    int8_t y;
-    int8_t wheel;
+    int16_t x;
+    int16_t y;
+    int16_t wheel;      // Wheel and pan are in 1/MOUSE_WHEEL_RESOLUTION detents when the host has set the multiplier
+    int16_t pan;
 } __packed mouse_report_t;
 
 void usb_device_init(void);
 uint8_t* usb_get_kb_hid_descriptor_ptr(void);
-uint16_t* usb_get_cc_hid_descriptor_ptr(void);
+consumer_report_t* usb_get_cc_hid_descriptor_ptr(void);
+system_report_t* usb_get_system_hid_descriptor_ptr(void);
 mouse_report_t* usb_get_mouse_hid_descriptor_ptr(void);
 void usb_wait_for_device_to_configured(void);
 void usb_update(void);
+bool usb_begin_mouse_frame(void);
+void usb_update_mouse(void);
@@ -2,6 +2,7 @@
 #include "hid.h"
 
 #include "keyboard.h"
+#include "mouse.h"
 
 // static const structures
 static const uint8_t hid_boot_keyboard_report_descriptor[] = {
@@ -53,16 +54,36 @@ static const uint8_t hid_consumer_control_report_descriptor[] = {
     HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER),
     HID_USAGE(HID_USAGE_CONSUMER_CONTROL),
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(USB_REPORT_ID_CONSUMER)
 
-    // 16 bits for consumer control
-    HID_USAGE_MIN(1),
-    HID_USAGE_MAX_N(672, 2),
-    HID_LOGICAL_MIN(1),
-    HID_LOGICAL_MAX_N(672, 2),
-    HID_REPORT_COUNT(1),
-    HID_REPORT_SIZE(16),
-    HID_INPUT(HID_DATA | HID_ARRAY | HID_ABSOLUTE),
+        // An array of 16 bit usages, one per held key
+        HID_USAGE_MIN(1),
+        HID_USAGE_MAX_N(672, 2),
+        HID_LOGICAL_MIN(1),
+        HID_LOGICAL_MAX_N(672, 2),
+        HID_REPORT_COUNT(CONSUMER_USAGES_MAX),
+        HID_REPORT_SIZE(16),
+        HID_INPUT(HID_DATA | HID_ARRAY | HID_ABSOLUTE),
+    HID_COLLECTION_END,
+
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_SYSTEM_CONTROL),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(USB_REPORT_ID_SYSTEM)
+
+        // Power down, sleep and wake up, one bit each
+        HID_USAGE_MIN(HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN),
+        HID_USAGE_MAX(HID_USAGE_DESKTOP_SYSTEM_WAKE_UP),
+        HID_LOGICAL_MIN(0),
+        HID_LOGICAL_MAX(1),
+        HID_REPORT_COUNT(3),
+        HID_REPORT_SIZE(1),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
 
+        // 5 bit reserved
+        HID_REPORT_COUNT(1),
+        HID_REPORT_SIZE(5),
+        HID_INPUT(HID_CONSTANT),
     HID_COLLECTION_END
 };
 
@@ -86,18 +107,56 @@ static const uint8_t hid_mouse_report_descriptor[] = {
         HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
             HID_USAGE(HID_USAGE_DESKTOP_X),
             HID_USAGE(HID_USAGE_DESKTOP_Y),
-            HID_LOGICAL_MIN(-127),
-            HID_LOGICAL_MAX(127),
+            HID_LOGICAL_MIN_N(-32767, 2),
+            HID_LOGICAL_MAX_N(32767, 2),
             HID_REPORT_COUNT(2),
-            HID_REPORT_SIZE(8),
+            HID_REPORT_SIZE(16),
             HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE),
 
-            HID_USAGE(HID_USAGE_DESKTOP_WHEEL),
-            HID_LOGICAL_MIN(-127),
-            HID_LOGICAL_MAX(127),
+        // Each wheel shares a logical collection with its resolution multiplier (a 2 bit feature). A host that sets
+        // the multiplier to 1 gets MOUSE_WHEEL_RESOLUTION counts per detent, otherwise wheel counts are whole detents
+        HID_COLLECTION(HID_COLLECTION_LOGICAL),
+            HID_USAGE(HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(1),
+            HID_PHYSICAL_MIN(1),
+            HID_PHYSICAL_MAX(MOUSE_WHEEL_RESOLUTION),
             HID_REPORT_COUNT(1),
-            HID_REPORT_SIZE(8),
+            HID_REPORT_SIZE(2),
+            HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+
+            HID_USAGE(HID_USAGE_DESKTOP_WHEEL),
+            HID_PHYSICAL_MIN(0),
+            HID_PHYSICAL_MAX(0),
+            HID_LOGICAL_MIN_N(-32767, 2),
+            HID_LOGICAL_MAX_N(32767, 2),
+            HID_REPORT_SIZE(16),
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE),
+        HID_COLLECTION_END,
+
+        // Horizontal scroll
+        HID_COLLECTION(HID_COLLECTION_LOGICAL),
+            HID_USAGE(HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(1),
+            HID_PHYSICAL_MIN(1),
+            HID_PHYSICAL_MAX(MOUSE_WHEEL_RESOLUTION),
+            HID_REPORT_SIZE(2),
+            HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+
+            HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER),
+            HID_USAGE_N(HID_USAGE_CONSUMER_AC_PAN, 2),
+            HID_PHYSICAL_MIN(0),
+            HID_PHYSICAL_MAX(0),
+            HID_LOGICAL_MIN_N(-32767, 2),
+            HID_LOGICAL_MAX_N(32767, 2),
+            HID_REPORT_SIZE(16),
             HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE),
+        HID_COLLECTION_END,
+
+        // Pad the feature report out to a byte
+        HID_REPORT_SIZE(4),
+        HID_FEATURE(HID_CONSTANT),
 
         HID_COLLECTION_END,
     HID_COLLECTION_END
@@ -181,7 +240,7 @@ const struct usb_interface_descriptor kb_config_interface_descriptor = {
     .bDescriptorType    = USB_DT_INTERFACE,
     .bInterfaceNumber   = 3,
     .bAlternateSetting  = 0,
-    .bNumEndpoints      = 2,
+    .bNumEndpoints      = 3,
     .bInterfaceClass    = 0xff,  // Vendor specific
     .bInterfaceSubClass = 0x00,
     .bInterfaceProtocol = 0x00,
@@ -202,7 +261,7 @@ const struct usb_endpoint_descriptor ep2_in = {
     .bDescriptorType  = USB_DT_ENDPOINT,
     .bEndpointAddress = EP2_IN_ADDR, // EP number 2, IN from host (tx from device)
     .bmAttributes     = USB_TRANSFER_TYPE_INTERRUPT,
-    .wMaxPacketSize   = 8,
+    .wMaxPacketSize   = sizeof(consumer_report_t),  // The larger of the two reports
     .bInterval        = USB_REPORT_INTERVAL
 };
 
@@ -211,8 +270,8 @@ const struct usb_endpoint_descriptor ep3_in = {
     .bDescriptorType  = USB_DT_ENDPOINT,
     .bEndpointAddress = EP3_IN_ADDR, // EP number 3, IN from host (tx from device)
     .bmAttributes     = USB_TRANSFER_TYPE_INTERRUPT,
-    .wMaxPacketSize   = 8,
-    .bInterval        = USB_REPORT_INTERVAL
+    .wMaxPacketSize   = sizeof(mouse_report_t),
+    .bInterval        = USB_MOUSE_REPORT_INTERVAL
 };
 
 const struct usb_endpoint_descriptor ep4_in = {
@@ -233,6 +292,15 @@ const struct usb_endpoint_descriptor ep4_out = {
     .bInterval        = 1
 };
 
+const struct usb_endpoint_descriptor ep5_in = {
+    .bLength          = sizeof(struct usb_endpoint_descriptor),
+    .bDescriptorType  = USB_DT_ENDPOINT,
+    .bEndpointAddress = EP5_IN_ADDR,
+    .bmAttributes     = USB_TRANSFER_TYPE_BULK,
+    .wMaxPacketSize   = 64,
+    .bInterval        = 0
+};
+
 const struct usb_hid_descriptor kb_hid_descriptor = {
     .bLength = sizeof(struct usb_hid_descriptor),
     .bDescriptorType = HID_DESC_TYPE_HID,
@@ -279,6 +347,7 @@ const struct usb_configuration_descriptor config_descriptor = {
                         sizeof(ep3_in) +
                         sizeof(ep4_in) +
                         sizeof(ep4_out) +
+                        sizeof(ep5_in) +
                         0),
     .bNumInterfaces  = 4,
     .bConfigurationValue = 1, // Configuration 1
@@ -391,6 +460,10 @@ const struct usb_endpoint_descriptor* usb_get_ep4_out_descriptor(void) {
     return &ep4_out;
 }
 
+const struct usb_endpoint_descriptor* usb_get_ep5_in_descriptor(void) {
+    return &ep5_in;
+}
+
 const struct usb_interface_descriptor* usb_get_kb_config_interface_descriptor(void) {
     return &kb_config_interface_descriptor;
 }
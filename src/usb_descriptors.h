@@ -18,6 +18,7 @@
 #define EP3_IN_ADDR     (USB_DIR_IN  | 3)   // Mouse
 #define EP4_IN_ADDR     (USB_DIR_IN  | 4)   // Bulk Data
 #define EP4_OUT_ADDR    (USB_DIR_OUT | 4)   // Bulk Data
+#define EP5_IN_ADDR     (USB_DIR_IN  | 5)   // Trace Stream
 
 #define KB_INTERFACE    (0)
 #define CC_INTERFACE    (1)
@@ -52,6 +53,7 @@ const struct usb_hid_descriptor* usb_get_mouse_hid_descriptor(void);
 
 const struct usb_endpoint_descriptor* usb_get_ep4_in_descriptor(void);
 const struct usb_endpoint_descriptor* usb_get_ep4_out_descriptor(void);
+const struct usb_endpoint_descriptor* usb_get_ep5_in_descriptor(void);
 const struct usb_interface_descriptor* usb_get_kb_config_interface_descriptor(void);
 
 #endif
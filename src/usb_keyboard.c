@@ -20,8 +20,15 @@
 #include "usb_descriptors.h"
 #include "matrix.h"
 #include "keyboard.h"
+#include "mouse.h"
 #include "kb_config.h"
 #include "leds.h"
+#include "trace.h"
+#include "perf.h"
+#include "recorder.h"
+#include "hot_path.h"
+#include "usb_transfer.h"
+#include "hardware/sync.h"
 
 #define usb_hw_set ((usb_hw_t *)hw_set_alias_untyped(usb_hw))
 #define usb_hw_clear ((usb_hw_t *)hw_clear_alias_untyped(usb_hw))
@@ -30,6 +37,11 @@
 #define GET_EP_CTRL_REG(ep_num, inout)      (&usb_dpram->ep_ctrl[ep_num - 1].inout)
 #define GET_BUF_CTRL_REG(ep_num, inout)     (&usb_dpram->ep_buf_ctrl[ep_num].inout)
 
+// Double buffered endpoints have their second buffer straight after the first, and its buffer control in the top half
+// of the register
+#define DPRAM_BUFFER_SIZE                   (64)
+#define BUF_CTRL_HALF_SHIFT(buffer)         ((buffer) * 16)
+
 // Typedefs
 typedef enum ep_transfer_state_t {
     ep_transfer_state_idle,
@@ -65,8 +77,15 @@ typedef struct kb_config_ep_state_t {
     endpoint_t in;
     endpoint_t out;
 
-    void (*on_rx_complete)(void);
-    void (*on_tx_complete)(void);
+    // Both endpoints are double buffered, see usb_transfer.h
+    usb_transfer_t tx;
+    usb_transfer_t rx;
+    const usb_transfer_segment_t* tx_segments;
+    uint8_t tx_segment_count;
+    bool taking_rx;
+
+    kb_config_rx_complete_cb_t on_rx_complete;
+    kb_config_transfer_complete_cb_t on_tx_complete;
 } kb_config_ep_state_t;
 
 // Function prototypes for our device specific endpoint handlers defined later on
@@ -74,10 +93,12 @@ static void ep0_in_handler(void);
 static void ep0_out_handler(void);
 static void ep4_in_handler(void);
 static void ep4_out_handler(void);
+static void ep5_in_handler(void);
 
 // Function prototypes for transmitting and receiving on the keyboard configuration endpoint
-static void usb_tx_kb_config(uint8_t* buffer, uint16_t len);
-static void usb_rx_kb_config(uint8_t* buffer, uint16_t len);
+static void usb_tx_kb_config(const usb_transfer_segment_t* segments, uint8_t count);
+static void usb_rx_kb_config(void);
+static void usb_kb_config_arm_out(void);
 
 // Global device address
 static volatile bool configured_by_host = false;
@@ -146,34 +167,57 @@ static kb_config_ep_state_t kb_config = {
     .in = {
         .buffer_control = GET_BUF_CTRL_REG(4, in),
         .endpoint_control = GET_EP_CTRL_REG(4, in),
-        .data_buffer = GET_DPRAM_BUFFER(3),
+        .data_buffer = GET_DPRAM_BUFFER(3),     // and 4
         .descriptor = NULL,
         .next_pid = 0
     },
     .out = {
         .buffer_control = GET_BUF_CTRL_REG(4, out),
         .endpoint_control = GET_EP_CTRL_REG(4, out),
-        .data_buffer = GET_DPRAM_BUFFER(4),
+        .data_buffer = GET_DPRAM_BUFFER(5),     // and 6
         .descriptor = NULL,
         .next_pid = 0
     },
 
+    .tx_segments = NULL,
+    .tx_segment_count = 0,
+    .taking_rx = false,
     .on_rx_complete = NULL,
     .on_tx_complete = NULL,
 };
 
+static endpoint_t ep_trace_in = {
+    .buffer_control = GET_BUF_CTRL_REG(5, in),
+    .endpoint_control = GET_EP_CTRL_REG(5, in),
+    .data_buffer = GET_DPRAM_BUFFER(7),
+    .descriptor = NULL,
+    .next_pid = 0
+};
+
+// Trace stream packets are only queued when there is something to send, otherwise the endpoint NAKs
+static volatile bool trace_stream_busy = false;
+
 static uint8_t multi_packet_buffer[1024] = {0};
 
 // HID keyboard report
 static uint8_t keyboard_hid_report[8] = {0};
 static uint8_t next_keyboard_hid_report[8] = {0};
 
-static uint16_t consumer_control_report = 0;
-static uint16_t next_consumer_control_report = 0;
+static consumer_report_t consumer_report = { .report_id = USB_REPORT_ID_CONSUMER };
+static consumer_report_t next_consumer_report = { .report_id = USB_REPORT_ID_CONSUMER };
+static system_report_t system_report = { .report_id = USB_REPORT_ID_SYSTEM };
+static system_report_t next_system_report = { .report_id = USB_REPORT_ID_SYSTEM };
+
+// Set while the host hasn't taken the last consumer or system report, as they share an endpoint
+static volatile bool cc_report_busy = false;
 
 static mouse_report_t mouse_report = {0};
 static mouse_report_t next_mouse_report = {0};
 
+// The mouse report is sent from the main loop at the mouse endpoint's poll rate, counted in USB frames (SOFs)
+static volatile uint32_t mouse_frames = 0;
+static volatile bool mouse_report_busy = false;
+
 // Private functions
 static uint8_t usb_prepare_string_descriptor(const unsigned char *str) {
     // 2 for bLength + bDescriptorType + strlen * 2 because string is unicode. i.e. other byte will be 0
@@ -203,6 +247,7 @@ static void usb_setup_endpoints(void) {
     ep_mouse_in.descriptor = usb_get_ep3_in_descriptor();
     kb_config.in.descriptor = usb_get_ep4_in_descriptor();
     kb_config.out.descriptor = usb_get_ep4_out_descriptor();
+    ep_trace_in.descriptor = usb_get_ep5_in_descriptor();
 
     // Get callback pointers for the keyboard config endpoints
     kb_config_bulk_ptrs_t* config_ptrs = kb_config_get_bulk_ptrs();
@@ -238,9 +283,10 @@ static void usb_setup_endpoints(void) {
 
     *ep_mouse_in.endpoint_control = reg;
 
-    // Set up the keyboard configuration endpoints
+    // Set up the keyboard configuration endpoints. These are double buffered, so the next packet is always armed
     dpram_offset = (uint32_t)kb_config.in.data_buffer ^ (uint32_t)usb_dpram;
     reg = EP_CTRL_ENABLE_BITS
+                   | EP_CTRL_DOUBLE_BUFFERED_BITS
                    | EP_CTRL_INTERRUPT_PER_BUFFER
                    | (kb_config.in.descriptor->bmAttributes << EP_CTRL_BUFFER_TYPE_LSB)
                    | dpram_offset;
@@ -249,24 +295,38 @@ static void usb_setup_endpoints(void) {
 
     dpram_offset = (uint32_t)kb_config.out.data_buffer ^ (uint32_t)usb_dpram;
     reg = EP_CTRL_ENABLE_BITS
+                   | EP_CTRL_DOUBLE_BUFFERED_BITS
                    | EP_CTRL_INTERRUPT_PER_BUFFER
                    | (kb_config.out.descriptor->bmAttributes << EP_CTRL_BUFFER_TYPE_LSB)
                    | dpram_offset;
 
     *kb_config.out.endpoint_control = reg;
+
+    usb_transfer_init(&kb_config.tx, true, kb_config.in.descriptor->wMaxPacketSize);
+    usb_transfer_init(&kb_config.rx, false, kb_config.out.descriptor->wMaxPacketSize);
+    usb_kb_config_arm_out();
+
+    // Set up the trace stream endpoint
+    dpram_offset = (uint32_t)ep_trace_in.data_buffer ^ (uint32_t)usb_dpram;
+    reg = EP_CTRL_ENABLE_BITS
+                   | EP_CTRL_INTERRUPT_PER_BUFFER
+                   | (ep_trace_in.descriptor->bmAttributes << EP_CTRL_BUFFER_TYPE_LSB)
+                   | dpram_offset;
+
+    *ep_trace_in.endpoint_control = reg;
 }
 
 static inline bool ep_is_tx(endpoint_t* ep) {
     return ep->descriptor->bEndpointAddress & USB_DIR_IN;
 }
 
-static uint32_t usb_ep_get_next_pid(endpoint_t* ep) {
+static uint32_t HOT_PATH_FUNC(usb_ep_get_next_pid)(endpoint_t* ep) {
     uint32_t pid_bit = ep->next_pid ? USB_BUF_CTRL_DATA1_PID : USB_BUF_CTRL_DATA0_PID;
     ep->next_pid ^= 1u;
     return pid_bit;
 }
 
-static void usb_write_data(endpoint_t* ep) {
+static void HOT_PATH_FUNC(usb_write_data)(endpoint_t* ep) {
     // Actual data during data stage
     // Assume data descriptor has been set up for the endpoint
     // Handle multi-packet logic here
@@ -302,7 +362,7 @@ static void usb_write_data(endpoint_t* ep) {
     *ep->buffer_control = buf_ctrl_val;
 }
 
-static void usb_read_data(endpoint_t* ep) {
+static void HOT_PATH_FUNC(usb_read_data)(endpoint_t* ep) {
     // Actual data during data stage
     // Assume data descriptor has been set up for the endpoint
     assert(!ep_is_tx(ep));
@@ -330,22 +390,78 @@ static void usb_receive_zlp(void) {
     *ep0.out.buffer_control = usb_ep_get_next_pid(&ep0.out) | USB_BUF_CTRL_AVAIL;
 }
 
-static void usb_rx_kb_config(uint8_t* buffer, uint16_t len) {
-    kb_config.out.data = (ep_data_state_t) {
-        .current_buffer = buffer,
-        .bytes_total = len,
-        .bytes_transferred = 0
-    };
-    usb_read_data(&kb_config.out);
+static inline uint8_t* usb_ep_buffer(endpoint_t* ep, uint8_t buffer) {
+    return ep->data_buffer + (buffer * DPRAM_BUFFER_SIZE);
 }
 
-static void usb_tx_kb_config(uint8_t* buffer, uint16_t len) {
-    kb_config.in.data = (ep_data_state_t) {
-        .current_buffer = buffer,
-        .bytes_total = len,
-        .bytes_transferred = 0
-    };
-    usb_write_data(&kb_config.in);
+static inline uint16_t usb_ep_buffer_control(endpoint_t* ep, uint8_t buffer) {
+    return (uint16_t)(*ep->buffer_control >> BUF_CTRL_HALF_SHIFT(buffer));
+}
+
+// Only the one buffer's half of the register is written, as the controller may own the other
+static inline void usb_ep_arm_buffer(endpoint_t* ep, uint8_t buffer, uint16_t buf_ctrl_val) {
+    ((volatile uint16_t*)ep->buffer_control)[buffer] = buf_ctrl_val;
+}
+
+// Arms as many packets of the kb_config response as there are free IN buffers
+static void HOT_PATH_FUNC(usb_kb_config_arm_in)(void) {
+    usb_transfer_packet_t packet;
+    while (usb_transfer_arm(&kb_config.tx, &packet)) {
+        uint16_t buf_ctrl_val = (packet.pid ? USB_BUF_CTRL_DATA1_PID : USB_BUF_CTRL_DATA0_PID)
+                                | USB_BUF_CTRL_AVAIL
+                                | USB_BUF_CTRL_FULL
+                                | packet.length;
+
+        // If this is the last packet, and it's short, mark it explicitly as the last
+        if (((packet.offset + packet.length) == kb_config.tx.length) && (packet.length < kb_config.tx.max_packet_size)) {
+            buf_ctrl_val |= USB_BUF_CTRL_LAST;
+        }
+
+        usb_transfer_gather(usb_ep_buffer(&kb_config.in, packet.buffer), kb_config.tx_segments, kb_config.tx_segment_count, packet.offset, packet.length);
+        usb_ep_arm_buffer(&kb_config.in, packet.buffer, buf_ctrl_val);
+    }
+}
+
+// OUT buffers are armed whenever they're free, so the host can send the next packet while the last is handled
+static void HOT_PATH_FUNC(usb_kb_config_arm_out)(void) {
+    usb_transfer_packet_t packet;
+    while (usb_transfer_arm(&kb_config.rx, &packet)) {
+        const uint16_t buf_ctrl_val = (packet.pid ? USB_BUF_CTRL_DATA1_PID : USB_BUF_CTRL_DATA0_PID)
+                                      | USB_BUF_CTRL_AVAIL
+                                      | packet.length;
+        usb_ep_arm_buffer(&kb_config.out, packet.buffer, buf_ctrl_val);
+    }
+}
+
+// Hands received packets to kb_config in order. kb_config parses each one where it sits in DPRAM, so its buffer is
+// only armed again once the callback returns. The callback usually asks for the next packet straight away, so this
+// loops rather than recursing, and a packet that arrived in the meantime goes straight in
+static void HOT_PATH_FUNC(usb_kb_config_take_rx)(void) {
+    if (kb_config.taking_rx) return;
+    kb_config.taking_rx = true;
+
+    usb_transfer_packet_t packet;
+    while (usb_transfer_take(&kb_config.rx, &packet)) {
+        if (kb_config.on_rx_complete != NULL) {
+            kb_config.on_rx_complete(usb_ep_buffer(&kb_config.out, packet.buffer), packet.length);
+        }
+        usb_kb_config_arm_out();
+    }
+
+    kb_config.taking_rx = false;
+}
+
+static void HOT_PATH_FUNC(usb_rx_kb_config)(void) {
+    usb_transfer_begin(&kb_config.rx, kb_config.rx.max_packet_size);
+    usb_kb_config_take_rx();
+}
+
+// The segments are read as each packet is armed, so they have to stay put until the transfer completes
+static void HOT_PATH_FUNC(usb_tx_kb_config)(const usb_transfer_segment_t* segments, uint8_t count) {
+    kb_config.tx_segments = segments;
+    kb_config.tx_segment_count = count;
+    usb_transfer_begin(&kb_config.tx, usb_transfer_segments_length(segments, count));
+    usb_kb_config_arm_in();
 }
 
 static void usb_handle_device_descriptor(volatile struct usb_setup_packet *pkt) {
@@ -422,6 +538,10 @@ static void usb_handle_config_descriptor(volatile struct usb_setup_packet *pkt)
         memcpy((void *)buf, kb_config.out.descriptor, sizeof(struct usb_endpoint_descriptor));
         buf += sizeof(struct usb_endpoint_descriptor);
         len += sizeof(struct usb_endpoint_descriptor);
+
+        memcpy((void *)buf, ep_trace_in.descriptor, sizeof(struct usb_endpoint_descriptor));
+        buf += sizeof(struct usb_endpoint_descriptor);
+        len += sizeof(struct usb_endpoint_descriptor);
     }
 
     // Send data
@@ -487,6 +607,21 @@ static void usb_handle_hid_report_descriptor(volatile struct usb_setup_packet *p
     usb_write_data(&ep0.in);
 }
 
+// The only report the host can ask for is the mouse's resolution multiplier feature
+static void usb_handle_get_report(volatile struct usb_setup_packet *pkt) {
+    static uint8_t resolution_report = 0;
+
+    if (((pkt->wIndex & 0xff) != MOUSE_INTERFACE) || ((pkt->wValue >> 8) != HID_REPORT_TYPE_FEATURE)) return;
+
+    resolution_report = mouse_get_resolution_report();
+    ep0.in.data = (ep_data_state_t) {
+        .bytes_total = 1,
+        .bytes_transferred = 0,
+        .current_buffer = &resolution_report
+    };
+    usb_write_data(&ep0.in);
+}
+
 static void usb_handle_get_protocol(volatile struct usb_setup_packet *pkt) {
     static const uint8_t boot_protocol = 0u;
     ep0.in.data = (ep_data_state_t) {
@@ -502,7 +637,20 @@ static void usb_reset_endpoint_state(void) {
     ep0.out.next_pid = 0;
     ep_kb_in.next_pid = 0;
     ep_cc_in.next_pid = 0;
+    cc_report_busy = false;
     ep_mouse_in.next_pid = 0;
+    ep_trace_in.next_pid = 0;
+    trace_stream_busy = false;
+    mouse_report_busy = false;
+
+    // Cancel anything armed on the kb_config endpoints and point the controller back at buffer 0. Transfers in
+    // progress carry on from where they were, in fresh buffers
+    *kb_config.in.buffer_control = USB_BUF_CTRL_SEL;
+    *kb_config.out.buffer_control = USB_BUF_CTRL_SEL;
+    usb_transfer_reset(&kb_config.tx);
+    usb_transfer_reset(&kb_config.rx);
+    usb_kb_config_arm_in();
+    usb_kb_config_arm_out();
 
     ep0.in.transfer = ep_transfer_state_idle;
     ep0.out.transfer = ep_transfer_state_idle;
@@ -568,6 +716,7 @@ static void usb_handle_setup_packet(void) {
     if (in_req) {
         if (class_req) {
             switch (pkt->bRequest) {
+                case HID_REQ_CONTROL_GET_REPORT:    usb_handle_get_report(pkt);             break;
                 case HID_REQ_CONTROL_GET_PROTOCOL:  usb_handle_get_protocol(pkt);           break;
             }
         } else {
@@ -604,9 +753,16 @@ static void usb_handle_setup_packet(void) {
     }
 }
 
-static void usb_handle_buff_status() {
+// Returns the completed buffers other than the trace stream's own
+static uint32_t HOT_PATH_FUNC(usb_handle_buff_status)() {
     uint32_t buffers = usb_hw->buf_status;
 
+    // Every EP5 completion is a trace packet going out, so tracing them would keep the stream busy with itself
+    const uint32_t other_buffers = buffers & ~USB_BUFF_CPU_SHOULD_HANDLE_EP5_IN_BITS;
+    if (other_buffers && trace_option_enabled(TRACE_OPTION_USB_BUFFERS)) {
+        trace1(TRACE_USB_BUFFERS, other_buffers);
+    }
+
     if (buffers & USB_BUFF_CPU_SHOULD_HANDLE_EP0_IN_BITS) {
         usb_hw_clear->buf_status = USB_BUFF_CPU_SHOULD_HANDLE_EP0_IN_BITS;
         ep0_in_handler();
@@ -623,10 +779,12 @@ static void usb_handle_buff_status() {
 
     if (buffers & USB_BUFF_CPU_SHOULD_HANDLE_EP2_IN_BITS) {
         usb_hw_clear->buf_status = USB_BUFF_CPU_SHOULD_HANDLE_EP2_IN_BITS;
+        cc_report_busy = false;
     }
 
     if (buffers & USB_BUFF_CPU_SHOULD_HANDLE_EP3_IN_BITS) {
         usb_hw_clear->buf_status = USB_BUFF_CPU_SHOULD_HANDLE_EP3_IN_BITS;
+        mouse_report_busy = false;
     }
 
     if (buffers & USB_BUFF_CPU_SHOULD_HANDLE_EP4_IN_BITS) {
@@ -638,6 +796,38 @@ static void usb_handle_buff_status() {
         usb_hw_clear->buf_status = USB_BUFF_CPU_SHOULD_HANDLE_EP4_OUT_BITS;
         ep4_out_handler();
     }
+
+    if (buffers & USB_BUFF_CPU_SHOULD_HANDLE_EP5_IN_BITS) {
+        usb_hw_clear->buf_status = USB_BUFF_CPU_SHOULD_HANDLE_EP5_IN_BITS;
+        ep5_in_handler();
+    }
+
+    return other_buffers;
+}
+
+static void HOT_PATH_FUNC(usb_send_cc_report)(uint8_t* report, uint16_t length) {
+    cc_report_busy = true;
+    ep_cc_in.data = (ep_data_state_t) {
+        .bytes_total = length,
+        .bytes_transferred = 0,
+        .current_buffer = report
+    };
+    usb_write_data(&ep_cc_in);
+}
+
+// Queue the next trace packet, or mark the stream idle if the ring has nothing new. Called with interrupts disabled
+// (either from the USB interrupt or by usb_update()), so the busy flag can't be raced.
+static void HOT_PATH_FUNC(usb_trace_stream_next)(void) {
+    // The endpoint's buffer is free while the stream isn't busy, so the packet is built straight into it
+    uint16_t length = trace_stream_fill(ep_trace_in.data_buffer);
+    if (length == 0) {
+        trace_stream_busy = false;
+        return;
+    }
+
+    trace_stream_busy = true;
+    ep_trace_in.transfer = ep_transfer_state_data;
+    *ep_trace_in.buffer_control = usb_ep_get_next_pid(&ep_trace_in) | USB_BUF_CTRL_AVAIL | USB_BUF_CTRL_FULL | length;
 }
 
 
@@ -645,10 +835,12 @@ static void usb_handle_buff_status() {
 extern "C" {
 #endif
 
-void isr_usbctrl(void) {
+void HOT_PATH_FUNC(isr_usbctrl)(void) {
     // USB interrupt handler
+    const uint32_t perf_start = perf_begin();
     uint32_t status = usb_hw->ints;
     uint32_t handled = 0;
+    uint32_t other_buffers = 0;
 
     // Setup packet received
     if (status & USB_INTS_SETUP_REQ_BITS) {
@@ -660,7 +852,14 @@ void isr_usbctrl(void) {
     // Buffer status, one or more buffers have completed
     if (status & USB_INTS_BUFF_STATUS_BITS) {
         handled |= USB_INTS_BUFF_STATUS_BITS;
-        usb_handle_buff_status();
+        other_buffers = usb_handle_buff_status();
+    }
+
+    // Start of frame, once per millisecond. Reading the frame number clears the interrupt
+    if (status & USB_INTS_DEV_SOF_BITS) {
+        handled |= USB_INTS_DEV_SOF_BITS;
+        (void)usb_hw->sof_rd;
+        mouse_frames++;
     }
 
     // Bus is reset
@@ -673,6 +872,15 @@ void isr_usbctrl(void) {
     if (status ^ handled) {
         panic("Unhandled IRQ 0x%x\n", (uint) (status ^ handled));
     }
+
+    // SOFs (1kHz) and trace packet completions alone would flood the trace, and the trace's own traffic would
+    // produce more of them, so only interrupts that did something else are traced
+    const bool traced = (status & ~(USB_INTS_DEV_SOF_BITS | USB_INTS_BUFF_STATUS_BITS)) || other_buffers;
+    if (traced) {
+        perf_end(PERF_STAGE_USB_IRQ, perf_start);
+    } else {
+        perf_end_untraced(PERF_STAGE_USB_IRQ, perf_start);
+    }
 }
 
 #ifdef __cplusplus
@@ -727,7 +935,10 @@ static void ep0_out_handler(void) {
     // [OUT] We were in the data stage, and a buffer is complete (rx)
     if (ep0.out.transfer == ep_transfer_state_data) {
         if (ep0.setup_packet.bRequest == HID_REQ_CONTROL_SET_REPORT) {
-            keyboard_on_led_status_report(ep0.out.data_buffer[0]);
+            switch (ep0.setup_packet.wIndex & 0xff) {
+                case KB_INTERFACE:      keyboard_on_led_status_report(ep0.out.data_buffer[0]);  break;
+                case MOUSE_INTERFACE:   mouse_on_resolution_report(ep0.out.data_buffer[0]);     break;
+            }
         }
 
         // Send a ZLP to the host in acknowledgement for the status stage
@@ -747,51 +958,39 @@ static void ep0_out_handler(void) {
     }
 }
 
-void ep4_in_handler(void) {
-    if (kb_config.in.transfer == ep_transfer_state_data) {
-        uint16_t bytes_remaining = kb_config.in.data.bytes_total - kb_config.in.data.bytes_transferred;
-
-        // We don't accumulate the transferred count until the buffer completes, so do that now
-        kb_config.in.data.bytes_transferred += MIN(bytes_remaining, kb_config.in.descriptor->wMaxPacketSize);
-        bytes_remaining = kb_config.in.data.bytes_total - kb_config.in.data.bytes_transferred;
+// Both buffers can finish before the interrupt is handled, so every armed buffer the controller has given back
+// (AVAIL cleared) is accounted for, oldest first
+void HOT_PATH_FUNC(ep4_in_handler)(void) {
+    bool complete = false;
+    while ((kb_config.tx.armed > 0) &&
+           !(usb_ep_buffer_control(&kb_config.in, usb_transfer_next_done(&kb_config.tx)) & USB_BUF_CTRL_AVAIL)) {
+        complete |= usb_transfer_in_done(&kb_config.tx);
+    }
 
-        // Is there more data to send?
-        if (bytes_remaining > 0) {
-            // Queue the next data buffer
-            usb_write_data(&kb_config.in);
-        } else {
-            // Transfer finished, alert sender
-            if (kb_config.on_tx_complete != NULL) {
-                kb_config.on_tx_complete();
-            }
+    if (complete) {
+        // Transfer finished, alert sender
+        if (kb_config.on_tx_complete != NULL) {
+            kb_config.on_tx_complete();
         }
+    } else {
+        // Refill the buffers the host has emptied
+        usb_kb_config_arm_in();
     }
 }
 
-void ep4_out_handler(void) {
-    if (kb_config.out.transfer == ep_transfer_state_data) {
-        uint16_t bytes_remaining = kb_config.out.data.bytes_total - kb_config.out.data.bytes_transferred;
-        uint16_t bytes_in_this_transfer = MIN(bytes_remaining, kb_config.out.descriptor->wMaxPacketSize);
-        uint8_t* buffer_ptr = kb_config.out.data.current_buffer + kb_config.out.data.bytes_transferred;
-
-        // Copy the received data into the user-provided buffer
-        memcpy(buffer_ptr, kb_config.out.data_buffer, bytes_in_this_transfer);
+void HOT_PATH_FUNC(ep4_out_handler)(void) {
+    while (kb_config.rx.armed > 0) {
+        const uint16_t buf_ctrl_val = usb_ep_buffer_control(&kb_config.out, usb_transfer_next_done(&kb_config.rx));
+        if (buf_ctrl_val & USB_BUF_CTRL_AVAIL) break;
+        usb_transfer_out_done(&kb_config.rx, buf_ctrl_val & USB_BUF_CTRL_LEN_MASK);
+    }
 
-        // We don't accumulate the transferred count until the buffer completes, so do that now
-        kb_config.out.data.bytes_transferred += bytes_in_this_transfer;
-        bytes_remaining = kb_config.out.data.bytes_total - bytes_in_this_transfer;
+    usb_kb_config_take_rx();
+}
 
-        // Is there more data to send?
-        if (bytes_remaining > 0) {
-            // Queue the next data buffer
-            usb_read_data(&kb_config.out);
-        } else {
-            // Transfer finished, alert sender
-            if (kb_config.on_rx_complete != NULL) {
-                kb_config.on_rx_complete();
-            }
-        }
-    }
+// The host has taken the last trace packet, so keep the stream going while there is data
+void HOT_PATH_FUNC(ep5_in_handler)(void) {
+    usb_trace_stream_next();
 }
 
 // public functions
@@ -818,10 +1017,11 @@ void usb_device_init(void) {
     usb_hw->sie_ctrl = USB_SIE_CTRL_EP0_INT_1BUF_BITS; // <2>
 
     // Enable interrupts for when a buffer is done, when the bus is reset,
-    // and when a setup packet is received
+    // when a setup packet is received, and at the start of every frame (for the mouse)
     usb_hw->inte = USB_INTS_BUFF_STATUS_BITS |
                    USB_INTS_BUS_RESET_BITS |
-                   USB_INTS_SETUP_REQ_BITS;
+                   USB_INTS_SETUP_REQ_BITS |
+                   USB_INTS_DEV_SOF_BITS;
 
     // Set up endpoint control registers described by device configuration
     usb_setup_endpoints();
@@ -834,8 +1034,12 @@ uint8_t* usb_get_kb_hid_descriptor_ptr(void) {
     return next_keyboard_hid_report;
 }
 
-uint16_t* usb_get_cc_hid_descriptor_ptr(void) {
-    return &next_consumer_control_report;
+consumer_report_t* usb_get_cc_hid_descriptor_ptr(void) {
+    return &next_consumer_report;
+}
+
+system_report_t* usb_get_system_hid_descriptor_ptr(void) {
+    return &next_system_report;
 }
 
 mouse_report_t* usb_get_mouse_hid_descriptor_ptr(void) {
@@ -849,7 +1053,7 @@ void usb_wait_for_device_to_configured(void) {
     }
 }
 
-void usb_update(void) {
+void HOT_PATH_FUNC(usb_update)(void) {
     // Only prepare a new interrupt response when something has changed (the hardware will nack the interrupt IN if no data is already in the buffer)
     if (memcmp(next_keyboard_hid_report, keyboard_hid_report, 8) != 0) {
         ep_kb_in.data = (ep_data_state_t) {
@@ -859,27 +1063,68 @@ void usb_update(void) {
         };
         usb_write_data(&ep_kb_in);
         memcpy(keyboard_hid_report, next_keyboard_hid_report, 8);
-    }
 
-    if (next_consumer_control_report != consumer_control_report) {
-        ep_cc_in.data = (ep_data_state_t) {
-            .bytes_total = 2,
-            .bytes_transferred = 0,
-            .current_buffer = (uint8_t*)&next_consumer_control_report
-        };
-        usb_write_data(&ep_cc_in);
-        consumer_control_report = next_consumer_control_report;
+        uint32_t keys_0_3;
+        memcpy(&keys_0_3, &keyboard_hid_report[2], sizeof(keys_0_3));
+        recorder_log(RECORDER_REPORT_KEYBOARD, keyboard_hid_report[0], keyboard_hid_report[6] | (keyboard_hid_report[7] << 8), keys_0_3);
     }
 
-    if ((next_mouse_report.buttons != mouse_report.buttons) || (next_mouse_report.x != 0) || (next_mouse_report.y != 0)) {
-        mouse_report = next_mouse_report;
+    // The consumer and system reports share an endpoint, so only one can go at a time. One that has to wait is still
+    // different from what was last sent, so it goes on a later update rather than being lost
+    if (!cc_report_busy) {
+        if (memcmp(&next_consumer_report, &consumer_report, sizeof(consumer_report)) != 0) {
+            consumer_report = next_consumer_report;
+            usb_send_cc_report((uint8_t*)&consumer_report, sizeof(consumer_report));
+            recorder_log(RECORDER_REPORT_CONSUMER, USB_REPORT_ID_CONSUMER, consumer_report.usages[0], consumer_report.usages[1] | ((uint32_t)consumer_report.usages[2] << 16));
+        } else if (memcmp(&next_system_report, &system_report, sizeof(system_report)) != 0) {
+            system_report = next_system_report;
+            usb_send_cc_report((uint8_t*)&system_report, sizeof(system_report));
+            recorder_log(RECORDER_REPORT_CONSUMER, USB_REPORT_ID_SYSTEM, system_report.controls, 0);
+        }
+    }
 
-        ep_mouse_in.transfer = ep_transfer_state_data;
-        ep_mouse_in.data = (ep_data_state_t) {
-            .bytes_total = sizeof(mouse_report),
-            .bytes_transferred = 0,
-            .current_buffer = (uint8_t*)&mouse_report
-        };
-        usb_write_data(&ep_mouse_in);
+    // Restart the trace stream if it went idle and new records have arrived since
+    if (!trace_stream_busy) {
+        uint32_t interrupt_state = save_and_disable_interrupts();
+        if (!trace_stream_busy) {
+            usb_trace_stream_next();
+        }
+        restore_interrupts(interrupt_state);
     }
 }
+
+// Returns true once every USB_MOUSE_REPORT_INTERVAL frames, which is how often the host polls the mouse endpoint
+bool HOT_PATH_FUNC(usb_begin_mouse_frame)(void) {
+    if (mouse_frames < USB_MOUSE_REPORT_INTERVAL) return false;
+
+    uint32_t interrupt_state = save_and_disable_interrupts();
+    mouse_frames = 0;
+    restore_interrupts(interrupt_state);
+    return true;
+}
+
+// Sends the mouse report if the buttons have changed or there's motion to send. If the host hasn't taken the last
+// report yet, motion keeps building up in the next one
+void HOT_PATH_FUNC(usb_update_mouse)(void) {
+    if (mouse_report_busy) return;
+
+    const bool moved = (next_mouse_report.x != 0) || (next_mouse_report.y != 0) ||
+                       (next_mouse_report.wheel != 0) || (next_mouse_report.pan != 0);
+    if (!moved && (next_mouse_report.buttons == mouse_report.buttons)) return;
+
+    mouse_report = next_mouse_report;
+    next_mouse_report.x = 0;
+    next_mouse_report.y = 0;
+    next_mouse_report.wheel = 0;
+    next_mouse_report.pan = 0;
+
+    mouse_report_busy = true;
+    ep_mouse_in.transfer = ep_transfer_state_data;
+    ep_mouse_in.data = (ep_data_state_t) {
+        .bytes_total = sizeof(mouse_report),
+        .bytes_transferred = 0,
+        .current_buffer = (uint8_t*)&mouse_report
+    };
+    usb_write_data(&ep_mouse_in);
+    recorder_log(RECORDER_REPORT_MOUSE, mouse_report.buttons, (uint16_t)mouse_report.wheel, (uint16_t)mouse_report.x | ((uint32_t)(uint16_t)mouse_report.y << 16));
+}
@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "usb_transfer.h"
+#include "hot_path.h"
+#include "pico/stdlib.h"
+#include <string.h>
+
+// private functions
+// The buffers are used strictly in turn, so the oldest armed buffer is as many places behind the next one to arm as
+// there are buffers armed, and the oldest full buffer is behind that again
+static inline uint8_t usb_transfer_oldest_armed(const usb_transfer_t* transfer) {
+    return (transfer->next_arm - transfer->armed) & (USB_TRANSFER_BUFFERS - 1);
+}
+
+static inline uint8_t usb_transfer_oldest_full(const usb_transfer_t* transfer) {
+    return (transfer->next_arm - transfer->armed - transfer->full) & (USB_TRANSFER_BUFFERS - 1);
+}
+
+// public functions
+void usb_transfer_init(usb_transfer_t* transfer, bool is_in, uint16_t max_packet_size) {
+    *transfer = (usb_transfer_t) {
+        .is_in = is_in,
+        .max_packet_size = max_packet_size,
+    };
+}
+
+// After a bus reset the controller starts again from buffer 0 and DATA0. Anything that was armed is lost, but a
+// transfer in progress carries on: IN picks up from the last packet the host took
+void usb_transfer_reset(usb_transfer_t* transfer) {
+    transfer->next_arm = 0;
+    transfer->armed = 0;
+    transfer->full = 0;
+    transfer->next_pid = 0;
+    transfer->armed_bytes = transfer->done_bytes;
+}
+
+// IN transfers must have at least one byte, as there's no zero length packet
+void HOT_PATH_FUNC(usb_transfer_begin)(usb_transfer_t* transfer, uint16_t length) {
+    transfer->active = true;
+    transfer->length = length;
+    transfer->armed_bytes = 0;
+    transfer->done_bytes = 0;
+}
+
+// Returns false when there's no free buffer, or (IN) nothing left of the transfer to arm
+bool HOT_PATH_FUNC(usb_transfer_arm)(usb_transfer_t* transfer, usb_transfer_packet_t* packet) {
+    if ((transfer->armed + transfer->full) == USB_TRANSFER_BUFFERS) return false;
+
+    uint16_t length = transfer->max_packet_size;
+    if (transfer->is_in) {
+        if (!transfer->active || (transfer->armed_bytes == transfer->length)) return false;
+        length = MIN(transfer->length - transfer->armed_bytes, transfer->max_packet_size);
+    }
+
+    *packet = (usb_transfer_packet_t) {
+        .buffer = transfer->next_arm,
+        .pid = transfer->next_pid,
+        .offset = transfer->armed_bytes,
+        .length = length
+    };
+
+    transfer->packet_length[transfer->next_arm] = length;
+    transfer->next_arm = (transfer->next_arm + 1) & (USB_TRANSFER_BUFFERS - 1);
+    transfer->next_pid ^= 1u;
+    transfer->armed++;
+    if (transfer->is_in) {
+        transfer->armed_bytes += length;
+    }
+    return true;
+}
+
+// The buffer the controller will finish next. Only meaningful while a buffer is armed
+uint8_t HOT_PATH_FUNC(usb_transfer_next_done)(const usb_transfer_t* transfer) {
+    return usb_transfer_oldest_armed(transfer);
+}
+
+// The host has taken the oldest armed IN packet. Returns true if that was the end of the transfer
+bool HOT_PATH_FUNC(usb_transfer_in_done)(usb_transfer_t* transfer) {
+    if (transfer->armed == 0) return false;
+
+    transfer->done_bytes += transfer->packet_length[usb_transfer_oldest_armed(transfer)];
+    transfer->armed--;
+
+    if (transfer->active && (transfer->done_bytes == transfer->length)) {
+        transfer->active = false;
+        return true;
+    }
+    return false;
+}
+
+// The oldest armed OUT buffer has received a packet
+void HOT_PATH_FUNC(usb_transfer_out_done)(usb_transfer_t* transfer, uint16_t received) {
+    if (transfer->armed == 0) return;
+
+    transfer->packet_length[usb_transfer_oldest_armed(transfer)] = received;
+    transfer->armed--;
+    transfer->full++;
+}
+
+// Hands the oldest received packet to the transfer. The caller reads packet->length bytes out of the buffer (for
+// offset packet->offset of the transfer) before arming it again, and the transfer is complete once active goes false.
+// Anything past the end of the transfer is dropped
+bool HOT_PATH_FUNC(usb_transfer_take)(usb_transfer_t* transfer, usb_transfer_packet_t* packet) {
+    if (!transfer->active || (transfer->full == 0)) return false;
+
+    const uint8_t buffer = usb_transfer_oldest_full(transfer);
+    const uint16_t received = transfer->packet_length[buffer];
+
+    *packet = (usb_transfer_packet_t) {
+        .buffer = buffer,
+        .pid = 0,
+        .offset = transfer->done_bytes,
+        .length = MIN(received, transfer->length - transfer->done_bytes)
+    };
+
+    transfer->full--;
+    transfer->done_bytes += packet->length;
+    if ((received < transfer->max_packet_size) || (transfer->done_bytes == transfer->length)) {
+        transfer->active = false;
+    }
+    return true;
+}
+
+uint16_t HOT_PATH_FUNC(usb_transfer_segments_length)(const usb_transfer_segment_t* segments, uint8_t count) {
+    uint16_t length = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        length += segments[i].length;
+    }
+    return length;
+}
+
+// Copies length bytes, starting offset bytes into the segments, to dst
+void HOT_PATH_FUNC(usb_transfer_gather)(uint8_t* dst, const usb_transfer_segment_t* segments, uint8_t count, uint16_t offset, uint16_t length) {
+    for (uint8_t i = 0; (i < count) && (length > 0); i++) {
+        if (offset >= segments[i].length) {
+            offset -= segments[i].length;
+            continue;
+        }
+
+        const uint16_t bytes = MIN(segments[i].length - offset, length);
+        memcpy(dst, segments[i].data + offset, bytes);
+        dst += bytes;
+        length -= bytes;
+        offset = 0;
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2025 Francis Stokes
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "pico/types.h"
+
+// Bookkeeping for a double buffered bulk endpoint. The controller uses the endpoint's two DPRAM buffers in turn, so
+// while one packet is on the bus the next is already waiting in the other. Packets are armed, finished and (for OUT)
+// taken in the same order, which makes the two buffers a ring. This only does the counting: the driver
+// (usb_keyboard.c) copies the data and writes the buffer control registers.
+//
+// IN:  usb_transfer_begin(), then arm packets until usb_transfer_arm() returns false. Each time the controller
+//      finishes a buffer, call usb_transfer_in_done() and arm again. The transfer is complete when in_done returns true.
+// OUT: buffers are armed whenever they're free, whether or not a transfer has begun, so the host can always send the
+//      next packet. usb_transfer_out_done() records what arrived, and usb_transfer_take() hands received packets to
+//      the transfer in order, freeing their buffers to be armed again. A short packet ends the transfer early.
+//
+// IN data can be given as a list of segments, which are read end to end as if they were one buffer. Senders describe
+// their headers and payloads where they already are, and usb_transfer_gather() copies each packet's share straight
+// into the endpoint buffer, so the data is only copied once.
+
+// defines
+#define USB_TRANSFER_BUFFERS        (2)
+
+// typedefs
+typedef struct usb_transfer_segment_t {
+    const uint8_t* data;
+    uint16_t length;
+} usb_transfer_segment_t;
+
+typedef struct usb_transfer_packet_t {
+    uint8_t buffer;                 // Which of the endpoint's buffers, 0 or 1
+    uint8_t pid;                    // Data toggle, 0 (DATA0) or 1 (DATA1)
+    uint16_t offset;                // Into the transfer's data
+    uint16_t length;
+} usb_transfer_packet_t;
+
+typedef struct usb_transfer_t {
+    bool is_in;
+    uint16_t max_packet_size;
+
+    // The transfer in progress
+    bool active;
+    uint16_t length;
+    uint16_t armed_bytes;           // IN: handed to the controller
+    uint16_t done_bytes;            // IN: taken by the host. OUT: taken into the transfer
+
+    // The buffers carry on from one transfer to the next
+    uint8_t next_arm;               // Buffer the next packet is armed in
+    uint8_t armed;                  // Buffers the controller owns
+    uint8_t full;                   // OUT: buffers holding a packet that hasn't been taken yet
+    uint8_t next_pid;
+    uint16_t packet_length[USB_TRANSFER_BUFFERS];
+} usb_transfer_t;
+
+// public functions
+void usb_transfer_init(usb_transfer_t* transfer, bool is_in, uint16_t max_packet_size);
+void usb_transfer_reset(usb_transfer_t* transfer);
+void usb_transfer_begin(usb_transfer_t* transfer, uint16_t length);
+bool usb_transfer_arm(usb_transfer_t* transfer, usb_transfer_packet_t* packet);
+uint8_t usb_transfer_next_done(const usb_transfer_t* transfer);
+bool usb_transfer_in_done(usb_transfer_t* transfer);
+void usb_transfer_out_done(usb_transfer_t* transfer, uint16_t received);
+bool usb_transfer_take(usb_transfer_t* transfer, usb_transfer_packet_t* packet);
+uint16_t usb_transfer_segments_length(const usb_transfer_segment_t* segments, uint8_t count);
+void usb_transfer_gather(uint8_t* dst, const usb_transfer_segment_t* segments, uint8_t count, uint16_t offset, uint16_t length);
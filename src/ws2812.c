@@ -9,24 +9,77 @@
 
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
 #include "hardware/clocks.h"
 
 #include "ws2812.pio.h"
 #include "ws2812.h"
 
-#include "keyboard.h"
+#include "hot_path.h"
+
+// defines
+#define WS2812_FREQ_HZ              (800000)
+#define WS2812_US_PER_LED           (30)    // 24 bits at 800kHz
+#define WS2812_LATCH_US             (80)    // Line held low for at least this long latches a frame (>50us, plus margin for clones)
+
+// typedefs
+typedef struct ws2812_strip_t {
+    PIO pio;
+    uint sm;
+    dma_channel_config dma_config;
+    uint64_t frame_done_us;         // Time at which the previous frame has been fully shifted out and latched. 64 bit,
+                                    // so a strip left idle for a long time can't look like it's still latching
+} ws2812_strip_t;
 
 // statics
-static PIO pio;
-static uint sm;
-static uint offset;
+static ws2812_strip_t strips[WS2812_STRIPS_MAX];
+static uint strip_count = 0;
+static uint program_offset;
+static uint dma_chan;
 
 // public functions
 void ws2812_init(void) {
-    pio_claim_free_sm_and_add_program_for_gpio_range(&ws2812_program, &pio, &sm, &offset, LEDS_WS2812_PIN, 1, true);
-    ws2812_program_init(pio, sm, offset, LEDS_WS2812_PIN, 800000);
+    // One channel copies a frame of words into a state machine's TX FIFO, paced by its DREQ. The strips take turns
+    dma_chan = dma_claim_unused_channel(true);
+    strip_count = 0;
 }
 
-void ws2812_write(uint32_t rgb32) {
-    pio_sm_put_blocking(pio, sm, rgb32 << 8);
+int ws2812_add_strip(uint pin) {
+    if (strip_count == WS2812_STRIPS_MAX) return -1;
+    ws2812_strip_t* strip = &strips[strip_count];
+
+    // The first strip loads the program. The others run it on more state machines in the same PIO
+    if (strip_count == 0) {
+        pio_claim_free_sm_and_add_program_for_gpio_range(&ws2812_program, &strip->pio, &strip->sm, &program_offset, pin, 1, true);
+    } else {
+        strip->pio = strips[0].pio;
+        strip->sm = pio_claim_unused_sm(strip->pio, true);
+    }
+    ws2812_program_init(strip->pio, strip->sm, program_offset, pin, WS2812_FREQ_HZ);
+
+    strip->dma_config = dma_channel_get_default_config(dma_chan);
+    channel_config_set_transfer_data_size(&strip->dma_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&strip->dma_config, true);
+    channel_config_set_write_increment(&strip->dma_config, false);
+    channel_config_set_dreq(&strip->dma_config, pio_get_dreq(strip->pio, strip->sm, true));
+    strip->frame_done_us = time_us_64();
+
+    return strip_count++;
+}
+
+bool HOT_PATH_FUNC(ws2812_ready)(uint strip) {
+    if (dma_channel_is_busy(dma_chan)) return false;
+    return time_us_64() >= strips[strip].frame_done_us;
+}
+
+bool HOT_PATH_FUNC(ws2812_write_frame)(uint strip, const uint32_t* words, uint count) {
+    if (!ws2812_ready(strip)) return false;
+    ws2812_strip_t* s = &strips[strip];
+
+    // The DMA finishes as soon as the last words are in the FIFO, ahead of the wire. The state machine never stalls
+    // mid-frame, so the frame is out count LED times from now, and nothing may be sent until it has latched.
+    s->frame_done_us = time_us_64() + (count * WS2812_US_PER_LED) + WS2812_LATCH_US;
+
+    dma_channel_configure(dma_chan, &s->dma_config, &s->pio->txf[s->sm], words, count, true);
+    return true;
 }
@@ -8,6 +8,23 @@
 
 #include "pico/types.h"
 
+// Frames are sent by DMA into a PIO state machine per strip, so writing one costs the CPU a few register writes
+// rather than ~30us per LED. Each word is one LED as GRB in the top 24 bits (the state machine shifts out bits 31..8).
+// There's one DMA channel, so one strip is sent at a time.
+#define WS2812_WORD(r, g, b)        (((uint32_t)(g) << 24) | ((uint32_t)(r) << 16) | ((uint32_t)(b) << 8))
+
+// State machines in one PIO
+#define WS2812_STRIPS_MAX           (4)
+
 // public functions
 void ws2812_init(void);
-void ws2812_write(uint32_t rgb32);
+
+// Claims a state machine driving the pin. Returns the strip's number, or -1 if there are none left
+int ws2812_add_strip(uint pin);
+
+// True when the DMA is free, and the strip's previous frame has been sent and latched
+bool ws2812_ready(uint strip);
+
+// Starts sending count words from the buffer to the strip and returns immediately. The buffer must not change until
+// the frame is sent (ws2812_ready()). Returns false, without sending, if the strip or the DMA is still busy.
+bool ws2812_write_frame(uint strip, const uint32_t* words, uint count);
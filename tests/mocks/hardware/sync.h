@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ * Adapted for unit testing
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tests are single threaded, so there's nothing to mask
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
+
+#ifdef __cplusplus
+}
+#endif
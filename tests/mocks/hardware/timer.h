@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ * Adapted for unit testing
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Provided by mock_timer.c
+uint32_t time_us_32(void);
+extern uint32_t mock_time_us;
+extern uint32_t mock_time_step_us;
+
+#ifdef __cplusplus
+}
+#endif
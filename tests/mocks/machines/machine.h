@@ -3,12 +3,13 @@
 #define MATRIX_SCAN_INTERVAL_MS     (5)
 #define MATRIX_ROWS                 (4)
 #define MATRIX_COLS                 (12)
-#define MATRIX_SETTLE_ITERATIONS    (50)
+#define MATRIX_SETTLE_NS            (2000)
 
 // USB
 #define USB_VID                     (0xdead)
 #define USB_PID                     (0xbeef)
 #define USB_REPORT_INTERVAL         MATRIX_SCAN_INTERVAL_MS
+#define USB_MOUSE_REPORT_INTERVAL   (1)
 #define USB_VENDOR_STRING           "Keyboard Firmware Tests"
 #define USB_PRODUCT_STRING          "Test Keyboard"
 
@@ -43,8 +44,8 @@
 #define MACRO_SIZE_MAX              (32)
 
 // LEDs
-#define LEDS_WS2812_PIN             (28)
-#define LEDS_MAX                    (2)
+#define LEDS_MAX                    (8)
+#define LEDS_STRIP_COUNT            (2)
 #define LEDS_BRIGHTNESS_DELTA       (16)
 #define LEDS_INDEX_REMAP(index)     (LEDS_MAX - index - 1)
 #define LEDS_HAS_DEBUG_LED          (1)
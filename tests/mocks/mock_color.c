@@ -0,0 +1 @@
+#include "color.c"
@@ -0,0 +1,14 @@
+#include "mock_doubletap.h"
+
+// Only the keyboard and matrix are mocked, so the tests drive the real double tap engine
+#include "doubletap.c"
+
+// API
+DoubletapInternals_t* mock_doubletap_get_internals(void) {
+    static DoubletapInternals_t Internals = {
+        .double_taps = &double_taps,
+        .double_tap_delay_ms = &double_tap_delay_ms,
+    };
+
+    return &Internals;
+}
@@ -0,0 +1,27 @@
+#ifndef MOCK_DOUBLETAP_H
+#define MOCK_DOUBLETAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#include "machines/machine.h"
+#include "doubletap.h"
+
+typedef struct DoubletapInternals_t {
+    double_tap_state_t* double_taps;
+    uint16_t* double_tap_delay_ms;
+} DoubletapInternals_t;
+
+// Mock API
+DoubletapInternals_t* mock_doubletap_get_internals(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOCK_DOUBLETAP_H
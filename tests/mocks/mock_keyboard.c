@@ -39,10 +39,11 @@
 // #undef keyboard_on_scan_complete
 
 // Mocks
-static void mock_keyboard_init(uint8_t* keyboard_hid_report, uint16_t* cc_hid_report, mouse_report_t* mouse_hid_report) {
+static void mock_keyboard_init(uint8_t* keyboard_hid_report, consumer_report_t* consumer_report, system_report_t* system_report, mouse_report_t* mouse_hid_report) {
     mock_c()->actualCall("keyboard_init")
     ->withPointerParameters("keyboard_hid_report", (void*)keyboard_hid_report)
-    ->withPointerParameters("cc_hid_report", (void*)cc_hid_report)
+    ->withPointerParameters("consumer_report", (void*)consumer_report)
+    ->withPointerParameters("system_report", (void*)system_report)
     ->withPointerParameters("mouse_hid_report", (void*)mouse_hid_report);
 }
 static void mock_keyboard_reset(void) {
@@ -174,8 +175,8 @@ StKeyboard_t* mock_keyboard_get_fn_ptr_struct(void) {
 }
 
 // Originally named functions that can be diverted to function pointers
-void keyboard_init(uint8_t* keyboard_hid_report, uint16_t* cc_hid_report, mouse_report_t* mouse_hid_report) {
-    return ActiveStruct.keyboard_init(keyboard_hid_report, cc_hid_report, mouse_hid_report);
+void keyboard_init(uint8_t* keyboard_hid_report, consumer_report_t* consumer_report, system_report_t* system_report, mouse_report_t* mouse_hid_report) {
+    return ActiveStruct.keyboard_init(keyboard_hid_report, consumer_report, system_report, mouse_hid_report);
 }
 void keyboard_reset(void) {
     return ActiveStruct.keyboard_reset();
@@ -13,7 +13,7 @@ extern "C" {
 #include "keyboard.h"
 
 typedef struct StKeyboard_t {
-    void (*keyboard_init)(uint8_t* keyboard_hid_report, uint16_t* cc_hid_report, mouse_report_t* mouse_hid_report);
+    void (*keyboard_init)(uint8_t* keyboard_hid_report, consumer_report_t* consumer_report, system_report_t* system_report, mouse_report_t* mouse_hid_report);
     void (*keyboard_reset)(void);
     bool (*keyboard_send_key)(keymap_entry_t key);
     void (*keyboard_send_modifiers)(uint8_t modifiers);
@@ -0,0 +1,44 @@
+#include "mock_led_effects.h"
+
+// The engine is used as it is. The LEDs it renders from and into are fakes
+#include "led_effects.c"
+
+// The first two LEDs sit in the middle row, 6 keys apart. The rest are out of the way on the top row
+const leds_position_t leds_positions[LEDS_MAX] = {
+    [0] = { .row = 2, .col = 3 },
+    [1] = { .row = 2, .col = 9 },
+    [2] = { .row = 0, .col = 0 },
+    [3] = { .row = 0, .col = 1 },
+    [4] = { .row = 0, .col = 2 },
+    [5] = { .row = 0, .col = 10 },
+    [6] = { .row = 0, .col = 11 },
+    [7] = { .row = 3, .col = 11 },
+};
+
+static uint8_t colors[LEDS_MAX][3];
+static uint8_t output[LEDS_MAX][3];
+static uint32_t output_writes = 0;
+
+// Fakes
+const uint8_t* leds_get_color(uint led_index) {
+    return colors[led_index];
+}
+
+void leds_set_output_color(uint led_index, const uint8_t* rgb) {
+    output[led_index][0] = rgb[0];
+    output[led_index][1] = rgb[1];
+    output[led_index][2] = rgb[2];
+    output_writes++;
+}
+
+// API
+LedEffectsInternals_t* mock_led_effects_get_internals(void) {
+    static LedEffectsInternals_t Internals = {
+        .state = &led_effects_state,
+        .colors = colors,
+        .output = output,
+        .output_writes = &output_writes,
+    };
+
+    return &Internals;
+}
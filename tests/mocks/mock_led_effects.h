@@ -0,0 +1,30 @@
+#ifndef MOCK_LED_EFFECTS_H
+#define MOCK_LED_EFFECTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#include "machines/machine.h"
+#include "led_effects.h"
+#include "hardware/timer.h"
+
+typedef struct LedEffectsInternals_t {
+    led_effects_state_t* state;
+    uint8_t (*colors)[3];           // What the hooks have set, as returned by leds_get_color()
+    uint8_t (*output)[3];           // What the engine last gave to leds_set_output_color()
+    uint32_t* output_writes;
+} LedEffectsInternals_t;
+
+// Mock API
+LedEffectsInternals_t* mock_led_effects_get_internals(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOCK_LED_EFFECTS_H
@@ -0,0 +1,78 @@
+#include "mock_leds.h"
+#include "CppUTestExt/MockSupport_c.h"
+
+#include <string.h>
+
+// The effects engine has fakes of these (mock_led_effects.c), so leds.c's are renamed
+#define leds_get_color          prod_leds_get_color
+#define leds_set_output_color   prod_leds_set_output_color
+
+#include "leds.c"
+
+#undef leds_get_color
+#undef leds_set_output_color
+
+// Two strips: chain positions 0-4 on the first, 5-7 on the second
+const leds_strip_t leds_strips[LEDS_STRIP_COUNT] = {
+    { .pin = 28, .first = 0, .count = 5 },
+    { .pin = 29, .first = 5, .count = 3 },
+};
+
+// Only one key has an LED
+const uint8_t leds_key_map[MATRIX_ROWS][MATRIX_COLS] = {
+    [0] = { LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED },
+    [1] = { LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, 3,           LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED },
+    [2] = { LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED },
+    [3] = { LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED, LEDS_NO_LED },
+};
+
+static bool ready = true;
+static MockLedsSend_t sends[MOCK_LEDS_SENDS_MAX];
+static uint send_count = 0;
+static uint strips_added = 0;
+
+// Fakes
+void gpio_init(uint gpio) {}
+void gpio_set_dir(uint gpio, bool out) {}
+void gpio_put(uint gpio, bool value) {}
+
+void panic(const char* fmt, ...) {
+    mock_c()->actualCall("panic");
+}
+
+void ws2812_init(void) {
+    strips_added = 0;
+}
+
+int ws2812_add_strip(uint pin) {
+    return strips_added++;
+}
+
+bool ws2812_ready(uint strip) {
+    return ready;
+}
+
+bool ws2812_write_frame(uint strip, const uint32_t* words, uint count) {
+    if (!ready) return false;
+
+    if (send_count < MOCK_LEDS_SENDS_MAX) {
+        sends[send_count].strip = strip;
+        sends[send_count].count = count;
+        memcpy(sends[send_count].words, words, count * sizeof(uint32_t));
+    }
+    send_count++;
+    return true;
+}
+
+// API
+LedsInternals_t* mock_leds_get_internals(void) {
+    static LedsInternals_t Internals = {
+        .state = &leds_state,
+        .words = words,
+        .ws2812_ready = &ready,
+        .sends = sends,
+        .send_count = &send_count,
+    };
+
+    return &Internals;
+}
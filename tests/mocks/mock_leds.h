@@ -0,0 +1,42 @@
+#ifndef MOCK_LEDS_H
+#define MOCK_LEDS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#include "machines/machine.h"
+#include "leds.h"
+
+#define MOCK_LEDS_SENDS_MAX     (8)
+
+typedef struct MockLedsSend_t {
+    uint strip;
+    uint count;
+    uint32_t words[LEDS_MAX];
+} MockLedsSend_t;
+
+typedef struct LedsInternals_t {
+    leds_state_t* state;
+    uint32_t* words;
+    bool* ws2812_ready;             // What the fake ws2812_ready() returns
+    MockLedsSend_t* sends;          // Frames given to ws2812_write_frame(), in order
+    uint* send_count;
+} LedsInternals_t;
+
+// leds.c's own versions. led_effects links against the fakes in mock_led_effects.c
+const uint8_t* prod_leds_get_color(uint led_index);
+void prod_leds_set_output_color(uint led_index, const uint8_t* rgb);
+
+// Mock API
+LedsInternals_t* mock_leds_get_internals(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOCK_LEDS_H
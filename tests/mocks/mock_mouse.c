@@ -0,0 +1,16 @@
+#include "mock_mouse.h"
+
+// The engine reads the fake clock from mock_timer.c and writes into the report below
+#include "mouse.c"
+
+static mouse_report_t report = {0};
+
+// API
+MouseInternals_t* mock_mouse_get_internals(void) {
+    static MouseInternals_t Internals = {
+        .state = &mouse_state,
+        .report = &report,
+    };
+
+    return &Internals;
+}
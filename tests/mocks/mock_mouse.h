@@ -0,0 +1,28 @@
+#ifndef MOCK_MOUSE_H
+#define MOCK_MOUSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#include "machines/machine.h"
+#include "mouse.h"
+#include "hardware/timer.h"
+
+typedef struct MouseInternals_t {
+    mouse_state_t* state;
+    mouse_report_t* report;         // The report the engine writes into, as handed to mouse_init()
+} MouseInternals_t;
+
+// Mock API
+MouseInternals_t* mock_mouse_get_internals(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOCK_MOUSE_H
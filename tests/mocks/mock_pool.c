@@ -0,0 +1 @@
+#include "pool.c"
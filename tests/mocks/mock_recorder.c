@@ -0,0 +1,4 @@
+#include "recorder.h"
+
+// The recorder is left running in tests, it just needs somewhere to write
+recorder_state_t recorder_state = {0};
@@ -0,0 +1,14 @@
+#include "mock_taphold.h"
+
+// Only the keyboard and matrix are mocked, so the tests drive the real tap-hold engine
+#include "taphold.c"
+
+// API
+TapholdInternals_t* mock_taphold_get_internals(void) {
+    static TapholdInternals_t Internals = {
+        .tapholds = &tapholds,
+        .hold_delay_ms = &hold_delay_ms,
+    };
+
+    return &Internals;
+}
@@ -0,0 +1,27 @@
+#ifndef MOCK_TAPHOLD_H
+#define MOCK_TAPHOLD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#include "machines/machine.h"
+#include "taphold.h"
+
+typedef struct TapholdInternals_t {
+    taphold_state_t* tapholds;
+    uint16_t* hold_delay_ms;
+} TapholdInternals_t;
+
+// Mock API
+TapholdInternals_t* mock_taphold_get_internals(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOCK_TAPHOLD_H
@@ -0,0 +1,11 @@
+#include "hardware/timer.h"
+
+// A fake clock: tests set the time, and can have it move on by a fixed step every time it's read
+uint32_t mock_time_us = 0;
+uint32_t mock_time_step_us = 0;
+
+uint32_t time_us_32(void) {
+    const uint32_t now = mock_time_us;
+    mock_time_us += mock_time_step_us;
+    return now;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ * Adapted for unit testing
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/types.h"
+#include "hardware/timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPIO_OUT    (1)
+#define GPIO_IN     (0)
+
+#ifndef MIN
+#define MIN(a, b)   ((b) > (a) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+#endif
+
+// Provided by mock_leds.c
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void panic(const char* fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
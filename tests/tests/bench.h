@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+// Host benchmarks live in TEST_GROUPs named *_benchmark. The default test run skips them, and `make bench` runs
+// only them (see the Makefile)
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Prints the average time of one iteration since start. The checksum is printed so the work can't be optimised away
+static inline void bench_report(const char* name, bench_clock::time_point start, uint32_t iterations, const char* iteration, uint32_t checksum) {
+    const double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / iterations;
+    printf("\n%-24s %10.1f ns per %s (checksum %u)", name, ns, iteration, checksum);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
-#include "pico/stdlib.h"
+#include "pico/types.h"
+
+// The linked list allocator the pool replaced. It's no longer in the firmware, and is only kept as the baseline for the
+// pool benchmarks in test_pool.cpp
 
 // typedefs
 typedef struct ll_node_t {
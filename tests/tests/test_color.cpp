@@ -0,0 +1,132 @@
+#include "CppUTest/TestHarness.h"
+#include "bench.h"
+
+extern "C" {
+#include "color.h"
+}
+
+#define BENCH_LEDS          (256)
+#define BENCH_ITERATIONS    (10000)
+
+TEST_GROUP(color) {
+    uint8_t lut[256];
+
+    void setup() {
+    }
+};
+
+TEST(color, color_build_brightness_lut_keeps_black_off)
+{
+    // Production call
+    color_build_brightness_lut(255, lut);
+
+    // Checks
+    LONGS_EQUAL(0, lut[0]);
+    LONGS_EQUAL(255, lut[255]);
+}
+
+TEST(color, color_build_brightness_lut_is_monotonic)
+{
+    // Production call
+    color_build_brightness_lut(128, lut);
+
+    // Checks
+    for (uint i = 1; i < 256; i++) {
+        CHECK(lut[i] >= lut[i - 1]);
+    }
+}
+
+TEST(color, color_build_brightness_lut_scales_by_brightness)
+{
+    // Production call
+    color_build_brightness_lut(63, lut);
+
+    // Checks
+    LONGS_EQUAL(63, lut[255]);
+}
+
+TEST(color, color_build_brightness_lut_zero_brightness_is_off)
+{
+    // Production call
+    color_build_brightness_lut(0, lut);
+
+    // Checks
+    for (uint i = 0; i < 256; i++) {
+        LONGS_EQUAL(0, lut[i]);
+    }
+}
+
+TEST(color, color_apply_lut_maps_each_channel)
+{
+    // Setup
+    const uint8_t rgb[3] = { 255, 128, 0 };
+    uint8_t out[3] = { 0 };
+    color_build_brightness_lut(255, lut);
+
+    // Production call
+    color_apply_lut(lut, rgb, out);
+
+    // Checks
+    LONGS_EQUAL(255, out[0]);
+    LONGS_EQUAL(lut[128], out[1]);
+    LONGS_EQUAL(0, out[2]);
+    CHECK(out[1] < 128);
+}
+
+// Host benchmarks of computing output colors for a frame of LEDs, the old way (through HSL, replacing the lightness)
+// against the brightness table
+TEST_GROUP(color_benchmark) {
+    uint8_t leds[BENCH_LEDS][3];
+    uint8_t leds_out[BENCH_LEDS][3];
+
+    void setup() {
+        for (uint i = 0; i < BENCH_LEDS; i++) {
+            leds[i][0] = (uint8_t)(i * 7);
+            leds[i][1] = (uint8_t)(i * 13);
+            leds[i][2] = (uint8_t)(255 - i);
+        }
+    }
+
+    uint32_t checksum() {
+        uint32_t sum = 0;
+        for (uint i = 0; i < BENCH_LEDS; i++) {
+            sum += leds_out[i][0] + leds_out[i][1] + leds_out[i][2];
+        }
+        return sum;
+    }
+
+    void report(const char* name, bench_clock::time_point start) {
+        char iteration[32];
+        snprintf(iteration, sizeof(iteration), "frame of %u LEDs", BENCH_LEDS);
+        bench_report(name, start, BENCH_ITERATIONS, iteration, checksum());
+    }
+};
+
+TEST(color_benchmark, hsl_round_trip)
+{
+    const auto start = bench_clock::now();
+    for (uint32_t n = 0; n < BENCH_ITERATIONS; n++) {
+        for (uint i = 0; i < BENCH_LEDS; i++) {
+            uint8_t hsl[3];
+            color_rgb2hsl(leds[i], hsl);
+            hsl[2] = (uint8_t)n;
+            color_hsl2rgb(hsl, leds_out[i]);
+        }
+    }
+    report("hsl round trip", start);
+}
+
+TEST(color_benchmark, brightness_lut)
+{
+    uint8_t lut[256];
+
+    const auto start = bench_clock::now();
+    for (uint32_t n = 0; n < BENCH_ITERATIONS; n++) {
+        // Worst case: the brightness changes every frame, so the table is rebuilt too
+        color_build_brightness_lut((uint8_t)n, lut);
+        for (uint i = 0; i < BENCH_LEDS; i++) {
+            color_apply_lut(lut, leds[i], leds_out[i]);
+        }
+    }
+    report("brightness lut", start);
+}
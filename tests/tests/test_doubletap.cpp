@@ -0,0 +1,150 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "mock_doubletap.h"
+#include "mock_keyboard.h"
+
+#define DT_A        DT(KC_A, KC_B, LS_BIT)
+#define DT_A_DOUBLE ((LS_BIT << KEY_MODS_SHIFT) | KC_B)
+
+TEST_GROUP(doubletap) {
+
+    DoubletapInternals_t* internals = mock_doubletap_get_internals();
+
+    void setup() {
+        double_tap_init();
+        *internals->double_tap_delay_ms = DOUBLE_TAP_DELAY_MS;
+
+        mock().strictOrder();
+    }
+
+    void teardown() {
+        // Any call to keyboard_resolve_key() would be unexpected: the engine works from what it captured at press
+        mock().checkExpectations();
+        mock().clear();
+    }
+
+    void tap(uint row, uint col, keymap_entry_t key) {
+        double_tap_on_key_press(row, col, key);
+        double_tap_on_key_release(row, col, key);
+    }
+};
+
+TEST(doubletap, double_tap_on_key_press_captures_key_and_position)
+{
+    // Expectations
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 1).withParameter("col", 2);
+
+    // Production call
+    bool handled = double_tap_on_key_press(1, 2, DT_A);
+
+    // Checks
+    CHECK(handled);
+    LONGS_EQUAL(1, pool_count(&internals->double_taps->pool));
+    LONGS_EQUAL(DT_A, internals->double_taps->key[0]);
+    LONGS_EQUAL(1, internals->double_taps->row[0]);
+    LONGS_EQUAL(2, internals->double_taps->col[0]);
+    LONGS_EQUAL(dt_state_wait_first_release, internals->double_taps->state[0]);
+}
+
+TEST(doubletap, double_tap_on_key_press_ignores_other_keys)
+{
+    // Production call
+    bool handled = double_tap_on_key_press(0, 0, KC_A);
+
+    // Checks
+    CHECK_FALSE(handled);
+    CHECK(pool_is_empty(&internals->double_taps->pool));
+}
+
+TEST(doubletap, double_tap_single_tap_is_sent_once_at_the_deadline)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    tap(0, 0, DT_A);
+
+    // Expectations
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_A);
+
+    // Production call
+    CHECK(double_tap_update(DOUBLE_TAP_DELAY_MS - 1));  // Still waiting for a second tap
+    CHECK_FALSE(double_tap_update(1));                  // The deadline, resolved as a single tap
+    CHECK_FALSE(double_tap_update(5));                  // Sent once only, as the key was already released
+
+    // Checks
+    CHECK(pool_is_empty(&internals->double_taps->pool));
+}
+
+TEST(doubletap, double_tap_second_tap_before_the_deadline_sends_the_double_key)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    tap(0, 0, DT_A);
+    double_tap_update(DOUBLE_TAP_DELAY_MS - 1);
+
+    // Expectations
+    mock().expectNCalls(2, "keyboard_send_key").withParameter("key", DT_A_DOUBLE);
+
+    // Production call
+    bool handled = double_tap_on_key_press(0, 0, DT_A);
+    CHECK(double_tap_update(0));                        // Sent every scan while held
+    CHECK_FALSE(double_tap_update(5));
+    double_tap_on_key_release(0, 0, DT_A);
+
+    // Checks
+    CHECK(handled);
+    CHECK(pool_is_empty(&internals->double_taps->pool));
+}
+
+TEST(doubletap, double_tap_held_past_the_deadline_sends_the_single_key_until_released)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    double_tap_on_key_press(0, 0, DT_A);
+
+    // Expectations
+    mock().expectNCalls(2, "keyboard_send_key").withParameter("key", KC_A);
+
+    // Production call
+    CHECK_FALSE(double_tap_update(DOUBLE_TAP_DELAY_MS));
+    CHECK_FALSE(double_tap_update(5));
+    bool handled = double_tap_on_key_release(0, 0, DT_A);
+
+    // Checks
+    CHECK_FALSE(handled);
+    CHECK(pool_is_empty(&internals->double_taps->pool));
+}
+
+TEST(doubletap, double_tap_layer_change_mid_hold_still_releases_the_key)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 2).withParameter("col", 3);
+    double_tap_on_key_press(2, 3, DT_A);
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_A);
+    double_tap_update(DOUBLE_TAP_DELAY_MS);
+
+    // Production call: the position now resolves to a different entry, as it would after a layer change
+    double_tap_on_key_release(2, 3, KC_Q);
+
+    // Checks: nothing more is sent once the key is up
+    CHECK(pool_is_empty(&internals->double_taps->pool));
+    CHECK_FALSE(double_tap_update(5));
+}
+
+TEST(doubletap, double_tap_layer_change_between_taps_keeps_the_first_tap)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 2).withParameter("col", 3);
+    double_tap_on_key_press(2, 3, DT_A);
+
+    // Expectations
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_A);
+
+    // Production call
+    bool handled = double_tap_on_key_release(2, 3, KC_Q);
+    double_tap_update(DOUBLE_TAP_DELAY_MS);
+
+    // Checks
+    CHECK(handled);
+    CHECK(pool_is_empty(&internals->double_taps->pool));
+}
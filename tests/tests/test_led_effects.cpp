@@ -0,0 +1,219 @@
+#include "CppUTest/TestHarness.h"
+
+#include <string.h>
+
+#include "mock_led_effects.h"
+
+// The LEDs the tests look at sit over (row 2, col 3) and (row 2, col 9) (see mock_led_effects.c)
+#define LED0_ROW    (2)
+#define LED0_COL    (3)
+
+TEST_GROUP(led_effects) {
+
+    LedEffectsInternals_t* internals = mock_led_effects_get_internals();
+
+    void setup() {
+        mock_time_us = 0;
+        mock_time_step_us = 0;
+
+        memset(internals->colors, 0, LEDS_MAX * 3);
+        memset(internals->output, 0, LEDS_MAX * 3);
+        *internals->output_writes = 0;
+
+        led_effects_set(LED_EFFECT_STATIC);
+        led_effects_reset();
+    }
+
+    void set_color(uint index, uint8_t r, uint8_t g, uint8_t b) {
+        internals->colors[index][0] = r;
+        internals->colors[index][1] = g;
+        internals->colors[index][2] = b;
+    }
+
+    // Runs ticks until the frame in progress has been shown
+    void show_frame() {
+        const uint32_t frames = internals->state->frames_shown;
+        for (uint i = 0; (i < LEDS_MAX) && (internals->state->frames_shown == frames); i++) {
+            led_effects_update();
+        }
+    }
+
+    void next_frame() {
+        mock_time_us += LED_EFFECTS_FRAME_US;
+        show_frame();
+    }
+};
+
+TEST(led_effects, led_effects_update_static_shows_hook_colors)
+{
+    // Setup
+    set_color(0, 10, 20, 30);
+    set_color(1, 40, 50, 60);
+
+    // Production call
+    led_effects_update();
+
+    // Checks
+    LONGS_EQUAL(1, internals->state->frames_shown);
+    LONGS_EQUAL(10, internals->output[0][0]);
+    LONGS_EQUAL(20, internals->output[0][1]);
+    LONGS_EQUAL(30, internals->output[0][2]);
+    LONGS_EQUAL(40, internals->output[1][0]);
+    LONGS_EQUAL(50, internals->output[1][1]);
+    LONGS_EQUAL(60, internals->output[1][2]);
+}
+
+TEST(led_effects, led_effects_update_waits_for_the_next_frame)
+{
+    // Setup
+    led_effects_update();
+    const uint32_t writes = *internals->output_writes;
+
+    // Production call
+    mock_time_us += LED_EFFECTS_FRAME_US - 1;
+    led_effects_update();
+
+    // Checks
+    LONGS_EQUAL(1, internals->state->frames_shown);
+    LONGS_EQUAL(writes, *internals->output_writes);
+
+    // Production call
+    mock_time_us += 1;
+    led_effects_update();
+
+    // Checks
+    LONGS_EQUAL(2, internals->state->frames_shown);
+}
+
+TEST(led_effects, led_effects_update_slices_frame_when_over_budget)
+{
+    // Setup: every LED takes the whole budget to render
+    set_color(0, 10, 20, 30);
+    set_color(1, 40, 50, 60);
+    mock_time_step_us = LED_EFFECTS_BUDGET_US;
+
+    // Production call
+    led_effects_update();
+
+    // Checks: one LED rendered, and nothing shown until the frame is complete
+    CHECK(internals->state->rendering);
+    LONGS_EQUAL(1, internals->state->next_led);
+    LONGS_EQUAL(0, internals->state->frames_shown);
+    LONGS_EQUAL(0, *internals->output_writes);
+
+    // Production call: a tick for each of the remaining LEDs
+    for (uint i = 1; i < LEDS_MAX; i++) {
+        led_effects_update();
+    }
+
+    // Checks
+    CHECK_FALSE(internals->state->rendering);
+    LONGS_EQUAL(1, internals->state->frames_shown);
+    LONGS_EQUAL(1, internals->state->frames_sliced);
+    LONGS_EQUAL(40, internals->output[1][0]);
+    LONGS_EQUAL(LED_EFFECTS_BUDGET_US, internals->state->tick_us_max);
+}
+
+TEST(led_effects, led_effects_breathing_follows_the_wave)
+{
+    // Setup
+    set_color(0, 200, 200, 200);
+    led_effects_set(LED_EFFECT_BREATHING);
+
+    // Production call: the first frame is one frame into the wave, near the bottom
+    show_frame();
+
+    // Checks
+    const uint32_t low = internals->state->breathe_level;
+    CHECK(low < LED_EFFECTS_BREATHE_MIN + 8);
+    LONGS_EQUAL((200 * low) >> 8, internals->output[0][0]);
+
+    // Production call: half a period on is the top of the wave
+    mock_time_us += (LED_EFFECTS_BREATHE_PERIOD_US / 2) - LED_EFFECTS_FRAME_US;
+    show_frame();
+
+    // Checks
+    LONGS_EQUAL(255, internals->state->breathe_level);
+    LONGS_EQUAL((200 * 255) >> 8, internals->output[0][0]);
+}
+
+TEST(led_effects, led_effects_on_key_press_ignored_unless_reactive)
+{
+    // Production call
+    led_effects_on_key_press(LED0_ROW, LED0_COL);
+
+    // Checks
+    CHECK_FALSE(internals->state->ripples[0].active);
+}
+
+TEST(led_effects, led_effects_reactive_ripple_starts_at_the_key)
+{
+    // Setup
+    set_color(0, 0, 0, 100);
+    set_color(1, 0, 0, 100);
+    led_effects_set(LED_EFFECT_REACTIVE);
+    show_frame();
+
+    // Production call
+    led_effects_on_key_press(LED0_ROW, LED0_COL);
+    next_frame();
+
+    // Checks: the LED over the key flashes, the far one hasn't been reached
+    CHECK(internals->output[0][0] > 150);
+    LONGS_EQUAL(0, internals->output[1][0]);
+    LONGS_EQUAL(100, internals->output[1][2]);
+}
+
+TEST(led_effects, led_effects_reactive_ripple_travels_and_fades)
+{
+    // Setup
+    set_color(0, 0, 0, 100);
+    set_color(1, 0, 0, 100);
+    led_effects_set(LED_EFFECT_REACTIVE);
+    show_frame();
+    led_effects_on_key_press(LED0_ROW, LED0_COL);
+
+    // Production call: the ring reaches the LED 6 keys away
+    mock_time_us += (6 * 1000000) / LED_EFFECTS_RIPPLE_SPEED;
+    show_frame();
+
+    // Checks: the ring has moved off the first LED, and is weaker when it arrives at the second
+    LONGS_EQUAL(0, internals->output[0][0]);
+    CHECK(internals->output[1][0] > 0);
+    CHECK(internals->output[1][0] < 200);
+
+    // Production call
+    mock_time_us += LED_EFFECTS_RIPPLE_US;
+    show_frame();
+
+    // Checks
+    CHECK_FALSE(internals->state->ripples[0].active);
+    LONGS_EQUAL(0, internals->output[1][0]);
+}
+
+TEST(led_effects, led_effects_on_layer_change_crossfades)
+{
+    // Setup
+    set_color(0, 0, 0, 0);
+    show_frame();
+    led_effects_on_layer_change();
+    set_color(0, 200, 100, 0);
+
+    // Production call: halfway through the transition
+    mock_time_us += LED_EFFECTS_TRANSITION_US / 2;
+    show_frame();
+
+    // Checks
+    CHECK(internals->state->transitioning);
+    LONGS_EQUAL(100, internals->output[0][0]);
+    LONGS_EQUAL(50, internals->output[0][1]);
+
+    // Production call
+    mock_time_us += LED_EFFECTS_TRANSITION_US / 2;
+    show_frame();
+
+    // Checks
+    CHECK_FALSE(internals->state->transitioning);
+    LONGS_EQUAL(200, internals->output[0][0]);
+    LONGS_EQUAL(100, internals->output[0][1]);
+}
@@ -0,0 +1,173 @@
+#include "CppUTest/TestHarness.h"
+
+#include "mock_leds.h"
+
+// The test machine's LEDS_INDEX_REMAP() reverses the LEDs, so LED 7 is chain position 0 (first on strip 0) and LED 0
+// is chain position 7 (last on strip 1)
+#define STRIP0_FIRST_LED    (7)
+#define STRIP0_FOURTH_LED   (4)
+#define STRIP1_FIRST_LED    (2)
+
+static const uint8_t RED[3] = { 255, 0, 0 };
+static const uint8_t BLUE[3] = { 0, 0, 255 };
+
+TEST_GROUP(leds) {
+
+    LedsInternals_t* internals = mock_leds_get_internals();
+
+    void setup() {
+        *internals->ws2812_ready = true;
+        leds_init();
+        leds_reset();
+
+        // Start from a clean frame, with nothing sent
+        for (uint i = 0; i < LEDS_STRIP_COUNT; i++) {
+            leds_write();
+        }
+        *internals->send_count = 0;
+    }
+};
+
+TEST(leds, leds_write_sends_nothing_when_nothing_changed)
+{
+    // Production call
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(0, *internals->send_count);
+}
+
+TEST(leds, leds_set_output_color_same_color_does_not_dirty)
+{
+    // Setup
+    prod_leds_set_output_color(STRIP0_FOURTH_LED, RED);
+    leds_write();
+    *internals->send_count = 0;
+
+    // Production call
+    prod_leds_set_output_color(STRIP0_FOURTH_LED, RED);
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(0, internals->state->dirty_strips);
+    LONGS_EQUAL(0, *internals->send_count);
+}
+
+TEST(leds, leds_set_output_color_dirties_only_its_position)
+{
+    // Production call
+    prod_leds_set_output_color(STRIP0_FOURTH_LED, RED);
+
+    // Checks
+    LONGS_EQUAL(0x1, internals->state->dirty_strips);
+    LONGS_EQUAL(3, internals->state->dirty[0].lo);
+    LONGS_EQUAL(4, internals->state->dirty[0].hi);
+    CHECK(internals->words[3] != 0);
+}
+
+TEST(leds, leds_write_sends_strip_up_to_last_change)
+{
+    // Setup
+    prod_leds_set_output_color(STRIP0_FOURTH_LED, RED);
+
+    // Production call
+    leds_write();
+
+    // Checks: the chain is sent from its start, but stops after the changed LED
+    LONGS_EQUAL(1, *internals->send_count);
+    LONGS_EQUAL(0, internals->sends[0].strip);
+    LONGS_EQUAL(4, internals->sends[0].count);
+    LONGS_EQUAL(0, internals->sends[0].words[0]);
+    LONGS_EQUAL(internals->words[3], internals->sends[0].words[3]);
+    LONGS_EQUAL(0, internals->state->dirty_strips);
+}
+
+TEST(leds, leds_write_range_covers_every_change)
+{
+    // Setup
+    prod_leds_set_output_color(STRIP0_FOURTH_LED, RED);
+    prod_leds_set_output_color(STRIP0_FIRST_LED, BLUE);
+
+    // Production call
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(4, internals->sends[0].count);
+    LONGS_EQUAL(internals->words[0], internals->sends[0].words[0]);
+    LONGS_EQUAL(internals->words[3], internals->sends[0].words[3]);
+    CHECK(internals->sends[0].words[0] != internals->sends[0].words[3]);
+}
+
+TEST(leds, leds_write_keeps_strip_queued_while_busy)
+{
+    // Setup
+    prod_leds_set_output_color(STRIP1_FIRST_LED, RED);
+    *internals->ws2812_ready = false;
+
+    // Production call
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(0, *internals->send_count);
+    LONGS_EQUAL(0x2, internals->state->dirty_strips);
+
+    // Production call
+    *internals->ws2812_ready = true;
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(1, *internals->send_count);
+    LONGS_EQUAL(1, internals->sends[0].strip);
+    LONGS_EQUAL(1, internals->sends[0].count);
+}
+
+TEST(leds, leds_write_takes_strips_in_turn)
+{
+    // Setup
+    prod_leds_set_output_color(STRIP0_FIRST_LED, RED);
+    prod_leds_set_output_color(STRIP1_FIRST_LED, RED);
+
+    // Production call: one strip per write, as there's one DMA channel
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(1, *internals->send_count);
+    LONGS_EQUAL(0, internals->sends[0].strip);
+
+    // Production call: strip 0 changes again, but strip 1 has been waiting
+    prod_leds_set_output_color(STRIP0_FIRST_LED, BLUE);
+    leds_write();
+    leds_write();
+
+    // Checks
+    LONGS_EQUAL(3, *internals->send_count);
+    LONGS_EQUAL(1, internals->sends[1].strip);
+    LONGS_EQUAL(0, internals->sends[2].strip);
+}
+
+TEST(leds, leds_toggle_led_enabled_turns_led_off)
+{
+    // Setup
+    prod_leds_set_output_color(STRIP0_FOURTH_LED, RED);
+    leds_write();
+
+    // Production call
+    leds_toggle_led_enabled(STRIP0_FOURTH_LED);
+
+    // Checks
+    LONGS_EQUAL(0, internals->words[3]);
+    LONGS_EQUAL(0x1, internals->state->dirty_strips);
+}
+
+TEST(leds, leds_set_key_color_uses_key_map)
+{
+    // Production call
+    leds_set_key_color(1, 4, 1, 2, 3);
+    leds_set_key_color(0, 0, 4, 5, 6);
+
+    // Checks
+    const uint8_t* color = prod_leds_get_color(3);
+    LONGS_EQUAL(1, color[0]);
+    LONGS_EQUAL(2, color[1]);
+    LONGS_EQUAL(3, color[2]);
+}
@@ -0,0 +1,243 @@
+#include "CppUTest/TestHarness.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mock_mouse.h"
+
+#define TICK_US     (1000)
+
+typedef struct motion_total_t {
+    int32_t x;
+    int32_t y;
+    int32_t wheel;
+    int32_t pan;
+} motion_total_t;
+
+TEST_GROUP(mouse) {
+
+    MouseInternals_t* internals = mock_mouse_get_internals();
+
+    void setup() {
+        mock_time_us = 0;
+        mock_time_step_us = 0;
+
+        memset(internals->report, 0, sizeof(mouse_report_t));
+        mouse_on_resolution_report(0);
+        mouse_init(internals->report);
+    }
+
+    // Ticks once per USB frame for the given time, taking the motion out of the report as usb_update_mouse() would
+    motion_total_t run_ms(uint ms) {
+        motion_total_t total = {0};
+        for (uint i = 0; i < ms; i++) {
+            mock_time_us += TICK_US;
+            mouse_tick();
+
+            total.x += internals->report->x;
+            total.y += internals->report->y;
+            total.wheel += internals->report->wheel;
+            total.pan += internals->report->pan;
+            internals->report->x = 0;
+            internals->report->y = 0;
+            internals->report->wheel = 0;
+            internals->report->pan = 0;
+        }
+        return total;
+    }
+};
+
+TEST(mouse, mouse_on_key_press_ignores_other_entries)
+{
+    // Production call
+    const bool handled = mouse_on_key_press(0, 0, KC_A);
+
+    // Checks
+    CHECK_FALSE(handled);
+    LONGS_EQUAL(0, internals->state->move.held);
+}
+
+TEST(mouse, mouse_update_sets_held_buttons)
+{
+    // Setup
+    CHECK(mouse_on_key_press(0, 0, MOUSE_LC));
+    CHECK(mouse_on_key_press(0, 1, MOUSE_RC));
+
+    // Production call
+    mouse_update();
+
+    // Checks
+    LONGS_EQUAL(MOUSE_BUTTON_LEFT | MOUSE_BUTTON_RIGHT, internals->report->buttons);
+
+    // Production call
+    internals->report->buttons = 0;
+    CHECK(mouse_on_key_release(0, 0, MOUSE_LC));
+    mouse_update();
+
+    // Checks
+    LONGS_EQUAL(MOUSE_BUTTON_RIGHT, internals->report->buttons);
+}
+
+TEST(mouse, mouse_tick_does_nothing_when_idle)
+{
+    // Production call
+    mock_time_us += TICK_US;
+    const bool moved = mouse_tick();
+
+    // Checks
+    CHECK_FALSE(moved);
+    LONGS_EQUAL(0, internals->report->x);
+}
+
+TEST(mouse, mouse_tap_moves_one_pixel)
+{
+    // Setup
+    mouse_on_key_press(0, 0, MOUSE_L);
+
+    // Production call
+    const motion_total_t total = run_ms(1);
+    mouse_on_key_release(0, 0, MOUSE_L);
+
+    // Checks
+    LONGS_EQUAL(-1, total.x);
+    LONGS_EQUAL(0, total.y);
+    LONGS_EQUAL(0, internals->state->move.remainder[0]);
+}
+
+TEST(mouse, mouse_tick_carries_sub_pixel_motion)
+{
+    // Setup: at the minimum speed a tick is only a fraction of a pixel
+    mouse_on_key_press(0, 0, MOUSE_R);
+    run_ms(1);
+
+    // Production call
+    const motion_total_t total = run_ms(100);
+
+    // Checks: no motion lost to rounding, other than what's still waiting in the remainder
+    const int32_t expected = (MOUSE_MOVE_SPEED_MIN * 100) / 1000;
+    CHECK(abs(total.x - expected) <= 1);
+    CHECK(internals->state->move.remainder[0] > 0);
+    CHECK(internals->state->move.remainder[0] < MOUSE_SUBPIXEL_ONE);
+}
+
+TEST(mouse, mouse_speed_follows_the_curve)
+{
+    // Setup
+    mouse_on_key_press(0, 0, MOUSE_D);
+
+    // Production call
+    run_ms(MOUSE_MOVE_DELAY_MS);
+
+    // Checks
+    LONGS_EQUAL(MOUSE_MOVE_SPEED_MIN, internals->state->move.speed);
+
+    // Production call: halfway along a quadratic curve is a quarter of the way to the maximum
+    run_ms(MOUSE_MOVE_ACCEL_MS / 2);
+
+    // Checks
+    LONGS_EQUAL(MOUSE_MOVE_SPEED_MIN + ((MOUSE_MOVE_SPEED_MAX - MOUSE_MOVE_SPEED_MIN) / 4), internals->state->move.speed);
+
+    // Production call
+    run_ms(MOUSE_MOVE_ACCEL_MS);
+
+    // Checks
+    LONGS_EQUAL(MOUSE_MOVE_SPEED_MAX, internals->state->move.speed);
+}
+
+TEST(mouse, mouse_diagonal_is_normalised)
+{
+    // Setup: the same time along one axis, then along two
+    mouse_on_key_press(0, 0, MOUSE_R);
+    const motion_total_t straight = run_ms(500);
+    mouse_on_key_release(0, 0, MOUSE_R);
+
+    mouse_on_key_press(0, 0, MOUSE_R);
+    mouse_on_key_press(0, 1, MOUSE_D);
+
+    // Production call
+    const motion_total_t diagonal = run_ms(500);
+
+    // Checks: each axis moves 1/sqrt(2) as far, so the pointer covers the same distance
+    LONGS_EQUAL(diagonal.x, diagonal.y);
+    CHECK(abs(diagonal.x - ((straight.x * 181) / 256)) <= 2);
+}
+
+TEST(mouse, mouse_opposite_directions_cancel)
+{
+    // Setup
+    mouse_on_key_press(0, 0, MOUSE_L);
+    run_ms(1);
+    mouse_on_key_press(0, 1, MOUSE_R);
+
+    // Production call
+    const motion_total_t total = run_ms(100);
+
+    // Checks
+    LONGS_EQUAL(0, total.x);
+}
+
+TEST(mouse, mouse_wheel_and_pan_tap_one_detent)
+{
+    // Setup
+    mouse_on_key_press(0, 0, MOUSE_WU);
+    mouse_on_key_press(0, 1, MOUSE_WL);
+
+    // Production call
+    const motion_total_t total = run_ms(1);
+
+    // Checks
+    LONGS_EQUAL(1, total.wheel);
+    LONGS_EQUAL(-1, total.pan);
+    LONGS_EQUAL(0, total.x);
+    LONGS_EQUAL(0, total.y);
+}
+
+TEST(mouse, mouse_tick_limits_a_stalled_tick)
+{
+    // Setup
+    mouse_on_key_press(0, 0, MOUSE_R);
+
+    // Production call: a whole second since the last tick
+    mock_time_us += 1000000;
+    mouse_tick();
+
+    // Checks: the tap's pixel, and no more than MOUSE_TICK_MAX_US of motion
+    LONGS_EQUAL(1 + ((MOUSE_MOVE_SPEED_MAX * MOUSE_TICK_MAX_US) / 1000000), internals->report->x);
+}
+
+TEST(mouse, mouse_resolution_report_makes_wheel_fine_grained)
+{
+    // Setup
+    mouse_on_resolution_report(MOUSE_RESOLUTION_WHEEL);
+    mouse_on_key_press(0, 0, MOUSE_WU);
+    mouse_on_key_press(0, 1, MOUSE_WR);
+
+    // Production call
+    const motion_total_t tap = run_ms(1);
+
+    // Checks: a tap is still one detent, but the wheel counts it in fractions. Pan wasn't switched on
+    LONGS_EQUAL(MOUSE_WHEEL_RESOLUTION, tap.wheel);
+    LONGS_EQUAL(1, tap.pan);
+
+    // Production call: wheel alone, so there's no diagonal scaling
+    mouse_on_key_release(0, 1, MOUSE_WR);
+    const motion_total_t held = run_ms(100);
+
+    // Checks: the wheel moves a little on nearly every tick, rather than a whole detent now and then
+    const int32_t expected = (MOUSE_WHEEL_SPEED_MIN * MOUSE_WHEEL_RESOLUTION * 100) / 1000;
+    CHECK(abs(held.wheel - expected) <= 1);
+    LONGS_EQUAL(0, held.pan);
+}
+
+TEST(mouse, mouse_reset_keeps_the_resolution)
+{
+    // Setup
+    mouse_on_resolution_report(MOUSE_RESOLUTION_WHEEL | MOUSE_RESOLUTION_PAN);
+
+    // Production call
+    mouse_reset();
+
+    // Checks
+    LONGS_EQUAL(MOUSE_RESOLUTION_WHEEL | MOUSE_RESOLUTION_PAN, mouse_get_resolution_report());
+    LONGS_EQUAL(MOUSE_WHEEL_RESOLUTION, internals->state->scroll.units[1]);
+}
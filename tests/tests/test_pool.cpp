@@ -0,0 +1,242 @@
+#include "CppUTest/TestHarness.h"
+#include "bench.h"
+
+extern "C" {
+#include "pool.h"
+#include "ll_alloc.h"
+}
+
+#define BENCH_CAPACITY      (8)
+#define BENCH_ITERATIONS    (1000000)
+
+TEST_GROUP(pool) {
+    pool_t pool;
+
+    void setup() {
+        pool_init(&pool, 8, false);
+    }
+};
+
+TEST(pool, pool_init_starts_empty)
+{
+    // Checks
+    CHECK(pool_is_empty(&pool));
+    LONGS_EQUAL(0, pool_count(&pool));
+}
+
+TEST(pool, pool_alloc_hands_out_lowest_free_slot)
+{
+    // Production call
+    int first = pool_alloc(&pool);
+    int second = pool_alloc(&pool);
+    pool_free(&pool, first);
+    int third = pool_alloc(&pool);
+
+    // Checks
+    LONGS_EQUAL(0, first);
+    LONGS_EQUAL(1, second);
+    LONGS_EQUAL(0, third);
+    LONGS_EQUAL(2, pool_count(&pool));
+}
+
+TEST(pool, pool_alloc_fails_when_full)
+{
+    // Setup
+    for (uint i = 0; i < 8; i++) {
+        pool_alloc(&pool);
+    }
+
+    // Production call
+    int slot = pool_alloc(&pool);
+
+    // Checks
+    LONGS_EQUAL(POOL_SLOT_NONE, slot);
+    LONGS_EQUAL(8, pool_count(&pool));
+}
+
+TEST(pool, pool_supports_full_capacity)
+{
+    // Setup
+    pool_init(&pool, POOL_CAPACITY_MAX, false);
+
+    // Production call
+    int last = POOL_SLOT_NONE;
+    for (uint i = 0; i < POOL_CAPACITY_MAX; i++) {
+        last = pool_alloc(&pool);
+    }
+
+    // Checks
+    LONGS_EQUAL(POOL_CAPACITY_MAX - 1, last);
+    LONGS_EQUAL(POOL_SLOT_NONE, pool_alloc(&pool));
+    LONGS_EQUAL(POOL_CAPACITY_MAX, pool_count(&pool));
+}
+
+TEST(pool, pool_free_ignores_free_slots)
+{
+    // Setup
+    pool_alloc(&pool);
+
+    // Production call
+    pool_free(&pool, 3);
+
+    // Checks
+    LONGS_EQUAL(1, pool_count(&pool));
+    LONGS_EQUAL(1, pool_alloc(&pool));
+}
+
+TEST(pool, pool_for_each_visits_occupied_slots_and_allows_free)
+{
+    // Setup
+    for (uint i = 0; i < 5; i++) {
+        pool_alloc(&pool);
+    }
+    pool_free(&pool, 1);
+
+    // Production call
+    uint visited[8] = {0};
+    uint visit_count = 0;
+    POOL_FOR_EACH(&pool, slot) {
+        visited[visit_count++] = slot;
+        pool_free(&pool, slot);
+    }
+
+    // Checks
+    LONGS_EQUAL(4, visit_count);
+    LONGS_EQUAL(0, visited[0]);
+    LONGS_EQUAL(2, visited[1]);
+    LONGS_EQUAL(3, visited[2]);
+    LONGS_EQUAL(4, visited[3]);
+    CHECK(pool_is_empty(&pool));
+}
+
+TEST(pool, pool_for_each_ordered_visits_in_allocation_order)
+{
+    // Setup
+    pool_init(&pool, 8, true);
+    for (uint i = 0; i < 4; i++) {
+        pool_alloc(&pool);
+    }
+    pool_free(&pool, 0);
+    pool_free(&pool, 2);
+    pool_alloc(&pool);  // Reuses slot 0, but it's now the newest
+
+    // Production call
+    uint visited[8] = {0};
+    uint visit_count = 0;
+    POOL_FOR_EACH_ORDERED(&pool, slot) {
+        visited[visit_count++] = slot;
+    }
+
+    // Checks
+    LONGS_EQUAL(3, visit_count);
+    LONGS_EQUAL(1, visited[0]);
+    LONGS_EQUAL(3, visited[1]);
+    LONGS_EQUAL(0, visited[2]);
+}
+
+TEST(pool, pool_free_all_empties_the_pool)
+{
+    // Setup
+    pool_init(&pool, 8, true);
+    for (uint i = 0; i < 3; i++) {
+        pool_alloc(&pool);
+    }
+
+    // Production call
+    pool_free_all(&pool);
+
+    // Checks
+    CHECK(pool_is_empty(&pool));
+    LONGS_EQUAL(0, pool.order_count);
+    LONGS_EQUAL(0, pool_alloc(&pool));
+}
+
+// Host benchmarks of the pool against ll_alloc, using the pattern tap-hold sees: a few keys go down, every active
+// entry is visited each scan, then the keys are released in a different order to how they were pressed
+TEST_GROUP(pool_benchmark) {
+    typedef struct bench_data_t {
+        uint8_t row;
+        uint8_t col;
+        uint16_t counter;
+    } bench_data_t;
+
+    void report(const char* name, bench_clock::time_point start, uint32_t checksum) {
+        bench_report(name, start, BENCH_ITERATIONS, "press/scan/release cycle", checksum);
+    }
+};
+
+TEST(pool_benchmark, ll_alloc)
+{
+    static bench_data_t data[BENCH_CAPACITY];
+    static ll_node_t nodes[BENCH_CAPACITY];
+    ll_allocator_t alloc;
+    lla_init(&alloc, data, nodes, BENCH_CAPACITY, sizeof(bench_data_t));
+
+    uint32_t checksum = 0;
+    const auto start = bench_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        ll_node_t* pressed[4];
+        for (uint k = 0; k < 4; k++) {
+            pressed[k] = lla_alloc_tail(&alloc);
+            ((bench_data_t*)pressed[k]->data)->counter = k;
+        }
+        for (ll_node_t* n = alloc.active_head; n != NULL; n = n->next) {
+            checksum += ((bench_data_t*)n->data)->counter++;
+        }
+        lla_free(&alloc, pressed[2]);
+        lla_free(&alloc, pressed[0]);
+        lla_free(&alloc, pressed[3]);
+        lla_free(&alloc, pressed[1]);
+    }
+    report("ll_alloc", start, checksum);
+}
+
+TEST(pool_benchmark, pool_ordered)
+{
+    static uint16_t counter[BENCH_CAPACITY];
+    pool_t pool;
+    pool_init(&pool, BENCH_CAPACITY, true);
+
+    uint32_t checksum = 0;
+    const auto start = bench_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        int pressed[4];
+        for (uint k = 0; k < 4; k++) {
+            pressed[k] = pool_alloc(&pool);
+            counter[pressed[k]] = k;
+        }
+        POOL_FOR_EACH_ORDERED(&pool, slot) {
+            checksum += counter[slot]++;
+        }
+        pool_free(&pool, pressed[2]);
+        pool_free(&pool, pressed[0]);
+        pool_free(&pool, pressed[3]);
+        pool_free(&pool, pressed[1]);
+    }
+    report("pool (ordered)", start, checksum);
+}
+
+TEST(pool_benchmark, pool_unordered)
+{
+    static uint16_t counter[BENCH_CAPACITY];
+    pool_t pool;
+    pool_init(&pool, BENCH_CAPACITY, false);
+
+    uint32_t checksum = 0;
+    const auto start = bench_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        int pressed[4];
+        for (uint k = 0; k < 4; k++) {
+            pressed[k] = pool_alloc(&pool);
+            counter[pressed[k]] = k;
+        }
+        POOL_FOR_EACH(&pool, slot) {
+            checksum += counter[slot]++;
+        }
+        pool_free(&pool, pressed[2]);
+        pool_free(&pool, pressed[0]);
+        pool_free(&pool, pressed[3]);
+        pool_free(&pool, pressed[1]);
+    }
+    report("pool (unordered)", start, checksum);
+}
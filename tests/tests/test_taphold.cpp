@@ -0,0 +1,146 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "mock_taphold.h"
+#include "mock_keyboard.h"
+
+#define TH_A    TAP_HOLD(KC_A, KC_LSFT, 0x00)
+#define TH_Q    TAP_HOLD(KC_Q, KC_LCTL, 0x00)
+
+TEST_GROUP(taphold) {
+
+    TapholdInternals_t* internals = mock_taphold_get_internals();
+
+    void setup() {
+        taphold_init();
+        *internals->hold_delay_ms = TAP_HOLD_DELAY_MS;
+
+        mock().strictOrder();
+    }
+
+    void teardown() {
+        // Any call to keyboard_resolve_key() would be unexpected: the engine works from what it captured at press
+        mock().checkExpectations();
+        mock().clear();
+    }
+};
+
+TEST(taphold, taphold_on_key_press_captures_key_and_hold_time)
+{
+    // Expectations
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 1).withParameter("col", 2);
+
+    // Production call
+    bool handled = taphold_on_key_press(1, 2, TH_A);
+
+    // Checks
+    CHECK(handled);
+    LONGS_EQUAL(1, pool_count(&internals->tapholds->pool));
+    LONGS_EQUAL(TH_A, internals->tapholds->key[0]);
+    LONGS_EQUAL(TAP_HOLD_DELAY_MS, internals->tapholds->hold_time[0]);
+    LONGS_EQUAL(0, internals->tapholds->hold_counter[0]);
+}
+
+TEST(taphold, taphold_on_key_press_ignores_other_keys)
+{
+    // Production call
+    bool handled = taphold_on_key_press(0, 0, KC_A);
+
+    // Checks
+    CHECK_FALSE(handled);
+    CHECK(pool_is_empty(&internals->tapholds->pool));
+}
+
+TEST(taphold, taphold_release_within_tapping_period_sends_tap_key)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    taphold_on_key_press(0, 0, TH_Q);
+
+    // Expectations
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_Q);
+
+    // Production call
+    CHECK(taphold_update(TAP_HOLD_DELAY_MS - 5));
+    bool handled = taphold_on_key_release(0, 0, TH_Q);
+
+    // Checks
+    CHECK(handled);
+    CHECK(pool_is_empty(&internals->tapholds->pool));
+}
+
+TEST(taphold, taphold_update_sends_hold_key_past_the_deadline)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    taphold_on_key_press(0, 0, TH_A);
+
+    // Expectations
+    mock().expectNCalls(2, "keyboard_send_key").withParameter("key", KC_LSFT);
+
+    // Production call
+    CHECK(taphold_update(TAP_HOLD_DELAY_MS - 1));       // Still inside the tapping period
+    CHECK(tapholds_any_active());
+    CHECK_FALSE(taphold_update(2));                     // Past the deadline, the hold key is sent
+    CHECK_FALSE(taphold_update(5));                     // And sent again each scan while held
+    CHECK_FALSE(tapholds_any_active());
+
+    // Checks
+    LONGS_EQUAL(TAP_HOLD_DELAY_MS, internals->tapholds->hold_counter[0]);
+}
+
+TEST(taphold, taphold_release_after_hold_sends_nothing)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    taphold_on_key_press(0, 0, TH_Q);
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_LCTL);
+    taphold_update(TAP_HOLD_DELAY_MS + 1);
+
+    // Production call
+    bool handled = taphold_on_key_release(0, 0, TH_Q);
+
+    // Checks
+    CHECK(handled);
+    CHECK(pool_is_empty(&internals->tapholds->pool));
+}
+
+TEST(taphold, taphold_layer_change_mid_hold_keeps_the_pressed_key)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 2).withParameter("col", 3);
+    taphold_on_key_press(2, 3, TH_A);
+
+    // Expectations
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_A);
+
+    // Production call: the position now resolves to a different entry, as it would after a layer change
+    bool handled = taphold_on_key_release(2, 3, TH_Q);
+
+    // Checks
+    CHECK(handled);
+    CHECK(pool_is_empty(&internals->tapholds->pool));
+}
+
+TEST(taphold, taphold_update_sends_hold_keys_in_press_order)
+{
+    // Setup
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 0);
+    taphold_on_key_press(0, 0, TH_Q);
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 1);
+    taphold_on_key_press(0, 1, TH_A);
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 2);
+    taphold_on_key_press(0, 2, TAP_HOLD(KC_W, KC_LALT, 0x00));
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_Q);
+    taphold_on_key_release(0, 0, TH_Q);
+
+    // Expectations: slot 0 is reused by the third press, but it's still sent after the second
+    mock().expectOneCall("matrix_mark_key_as_handled").withParameter("row", 0).withParameter("col", 3);
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_LSFT);
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_LALT);
+    mock().expectOneCall("keyboard_send_key").withParameter("key", KC_LCTL);
+
+    // Production call
+    taphold_on_key_press(0, 3, TH_Q);
+    taphold_update(TAP_HOLD_DELAY_MS + 1);
+}
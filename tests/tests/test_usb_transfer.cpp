@@ -0,0 +1,220 @@
+#include "CppUTest/TestHarness.h"
+
+extern "C" {
+#include "usb_transfer.h"
+}
+
+#define MAX_PACKET_SIZE     (64)
+
+TEST_GROUP(usb_transfer) {
+    usb_transfer_t in;
+    usb_transfer_t out;
+    usb_transfer_packet_t packet;
+
+    void setup() {
+        usb_transfer_init(&in, true, MAX_PACKET_SIZE);
+        usb_transfer_init(&out, false, MAX_PACKET_SIZE);
+    }
+
+    void check_packet(uint8_t buffer, uint8_t pid, uint16_t offset, uint16_t length) {
+        LONGS_EQUAL(buffer, packet.buffer);
+        LONGS_EQUAL(pid, packet.pid);
+        LONGS_EQUAL(offset, packet.offset);
+        LONGS_EQUAL(length, packet.length);
+    }
+};
+
+TEST(usb_transfer, usb_transfer_arm_in_fills_both_buffers)
+{
+    // Setup
+    usb_transfer_begin(&in, 150);
+
+    // Production call
+    CHECK(usb_transfer_arm(&in, &packet));
+    check_packet(0, 0, 0, 64);
+    CHECK(usb_transfer_arm(&in, &packet));
+    check_packet(1, 1, 64, 64);
+
+    // Checks: the third packet waits for a free buffer
+    CHECK_FALSE(usb_transfer_arm(&in, &packet));
+    LONGS_EQUAL(2, in.armed);
+    LONGS_EQUAL(0, usb_transfer_next_done(&in));
+}
+
+TEST(usb_transfer, usb_transfer_in_done_frees_buffers_in_turn)
+{
+    // Setup
+    usb_transfer_begin(&in, 150);
+    usb_transfer_arm(&in, &packet);
+    usb_transfer_arm(&in, &packet);
+
+    // Production call
+    CHECK_FALSE(usb_transfer_in_done(&in));
+    CHECK(usb_transfer_arm(&in, &packet));
+
+    // Checks: the short last packet goes back into buffer 0, while buffer 1 is still on the bus
+    check_packet(0, 0, 128, 22);
+    LONGS_EQUAL(1, usb_transfer_next_done(&in));
+    CHECK_FALSE(usb_transfer_arm(&in, &packet));
+
+    // Production call
+    CHECK_FALSE(usb_transfer_in_done(&in));
+    CHECK(usb_transfer_in_done(&in));
+
+    // Checks
+    CHECK_FALSE(in.active);
+    LONGS_EQUAL(150, in.done_bytes);
+    LONGS_EQUAL(0, in.armed);
+}
+
+TEST(usb_transfer, usb_transfer_in_carries_buffer_and_pid_into_next_transfer)
+{
+    // Setup
+    usb_transfer_begin(&in, 10);
+    usb_transfer_arm(&in, &packet);
+    CHECK(usb_transfer_in_done(&in));
+
+    // Production call
+    usb_transfer_begin(&in, 10);
+    CHECK(usb_transfer_arm(&in, &packet));
+
+    // Checks
+    check_packet(1, 1, 0, 10);
+}
+
+TEST(usb_transfer, usb_transfer_arm_out_without_a_transfer)
+{
+    // Production call
+    CHECK(usb_transfer_arm(&out, &packet));
+    check_packet(0, 0, 0, 64);
+    CHECK(usb_transfer_arm(&out, &packet));
+    check_packet(1, 1, 0, 64);
+
+    // Checks
+    CHECK_FALSE(usb_transfer_arm(&out, &packet));
+}
+
+TEST(usb_transfer, usb_transfer_out_holds_packets_until_taken)
+{
+    // Setup: two packets arrive before anything is ready for them
+    usb_transfer_arm(&out, &packet);
+    usb_transfer_arm(&out, &packet);
+    usb_transfer_out_done(&out, 64);
+    usb_transfer_out_done(&out, 40);
+
+    // Checks: both buffers are held, so nothing more can be armed
+    CHECK_FALSE(usb_transfer_take(&out, &packet));
+    CHECK_FALSE(usb_transfer_arm(&out, &packet));
+
+    // Production call
+    usb_transfer_begin(&out, 64);
+    CHECK(usb_transfer_take(&out, &packet));
+
+    // Checks: the oldest packet first, and its buffer can be armed again
+    check_packet(0, 0, 0, 64);
+    CHECK_FALSE(out.active);
+    CHECK(usb_transfer_arm(&out, &packet));
+    LONGS_EQUAL(0, packet.buffer);
+
+    // Production call
+    usb_transfer_begin(&out, 64);
+    CHECK(usb_transfer_take(&out, &packet));
+
+    // Checks
+    check_packet(1, 0, 0, 40);
+    CHECK_FALSE(out.active);
+}
+
+TEST(usb_transfer, usb_transfer_out_spans_packets)
+{
+    // Setup
+    usb_transfer_begin(&out, 128);
+    usb_transfer_arm(&out, &packet);
+    usb_transfer_arm(&out, &packet);
+
+    // Production call
+    usb_transfer_out_done(&out, 64);
+    CHECK(usb_transfer_take(&out, &packet));
+
+    // Checks: a full packet with more to come keeps the transfer open
+    check_packet(0, 0, 0, 64);
+    CHECK(out.active);
+
+    // Production call
+    usb_transfer_out_done(&out, 64);
+    CHECK(usb_transfer_take(&out, &packet));
+
+    // Checks
+    check_packet(1, 0, 64, 64);
+    CHECK_FALSE(out.active);
+    LONGS_EQUAL(128, out.done_bytes);
+}
+
+TEST(usb_transfer, usb_transfer_out_short_packet_ends_transfer)
+{
+    // Setup
+    usb_transfer_begin(&out, 128);
+    usb_transfer_arm(&out, &packet);
+
+    // Production call
+    usb_transfer_out_done(&out, 20);
+    CHECK(usb_transfer_take(&out, &packet));
+
+    // Checks
+    check_packet(0, 0, 0, 20);
+    CHECK_FALSE(out.active);
+}
+
+TEST(usb_transfer, usb_transfer_out_drops_bytes_past_the_end)
+{
+    // Setup
+    usb_transfer_begin(&out, 16);
+    usb_transfer_arm(&out, &packet);
+    usb_transfer_out_done(&out, 64);
+
+    // Production call
+    CHECK(usb_transfer_take(&out, &packet));
+
+    // Checks
+    LONGS_EQUAL(16, packet.length);
+    CHECK_FALSE(out.active);
+}
+
+TEST(usb_transfer, usb_transfer_reset_restarts_in_from_last_packet_taken)
+{
+    // Setup
+    usb_transfer_begin(&in, 200);
+    usb_transfer_arm(&in, &packet);
+    usb_transfer_arm(&in, &packet);
+    usb_transfer_in_done(&in);
+
+    // Production call
+    usb_transfer_reset(&in);
+    CHECK(usb_transfer_arm(&in, &packet));
+
+    // Checks: the packet that was lost is sent again, from buffer 0 and DATA0
+    check_packet(0, 0, 64, 64);
+    CHECK(in.active);
+}
+
+TEST(usb_transfer, usb_transfer_gather_reads_across_segments)
+{
+    // Setup: a header, a payload and a trailer, as kb_config describes a packet
+    const uint8_t header[4] = { 1, 2, 3, 4 };
+    const uint8_t payload[6] = { 10, 11, 12, 13, 14, 15 };
+    const uint8_t trailer[2] = { 20, 21 };
+    const usb_transfer_segment_t segments[3] = {
+        { header, sizeof(header) },
+        { payload, sizeof(payload) },
+        { trailer, sizeof(trailer) },
+    };
+    uint8_t dst[9] = {0};
+
+    // Production call: from the middle of the header to the middle of the trailer
+    usb_transfer_gather(dst, segments, 3, 2, 9);
+
+    // Checks
+    LONGS_EQUAL(12, usb_transfer_segments_length(segments, 3));
+    const uint8_t expected[9] = { 3, 4, 10, 11, 12, 13, 14, 15, 20 };
+    MEMCMP_EQUAL(expected, dst, sizeof(expected));
+}